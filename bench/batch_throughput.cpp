@@ -0,0 +1,76 @@
+/*
+ * This file is part of fast-lib.
+ * Copyright (C) 2015 RWTH Aachen University - ACS
+ *
+ * This file is licensed under the GNU Lesser General Public License Version 3
+ * Version 3, 29 June 2007. For details see 'LICENSE.md' in the root directory.
+ */
+
+// Measures throughput and latency of small messages sent with and without batching.
+//
+// Usage: fastlib_batch_throughput_bench [host] [port] [messages]
+
+#include <fast-lib/mqtt_communicator.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+
+using fast::MQTT_communicator;
+
+static void run(const std::string &host, int port, unsigned int messages, std::size_t batch_size, std::chrono::microseconds batch_delay)
+{
+	const std::string topic("fast/bench/batch");
+	MQTT_communicator sender("", topic, host, port, 60, std::chrono::seconds(5));
+	MQTT_communicator receiver("", topic, host, port, 60, std::chrono::seconds(5));
+	fast::Topic_policy policy;
+	policy.qos = 0;
+	policy.batch_size = batch_size;
+	policy.batch_delay = batch_delay;
+	sender.set_topic_policy(topic, policy);
+	std::atomic<unsigned int> received(0);
+	std::atomic<long long> latency_sum(0);
+	// Messages carry their send time to measure the latency.
+	receiver.add_subscription(topic, [&received, &latency_sum](std::string msg) {
+		auto now = std::chrono::steady_clock::now().time_since_epoch();
+		latency_sum += std::chrono::duration_cast<std::chrono::nanoseconds>(now).count() - std::stoll(msg);
+		++received;
+	}, 0);
+	// Give the broker time to register the subscription.
+	std::this_thread::sleep_for(std::chrono::milliseconds(500));
+	auto start = std::chrono::steady_clock::now();
+	for (unsigned int i = 0; i != messages; ++i) {
+		auto now = std::chrono::steady_clock::now().time_since_epoch();
+		sender.post_message(std::to_string(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count()), topic);
+	}
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(60);
+	while (received != messages && std::chrono::steady_clock::now() < deadline)
+		std::this_thread::sleep_for(std::chrono::microseconds(100));
+	std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+	receiver.remove_subscription(topic);
+	std::cout << "batch size " << batch_size << ", delay " << batch_delay.count() << " us: "
+		<< static_cast<unsigned long>(received / duration.count()) << " msg/s, "
+		<< "mean latency " << (received != 0 ? latency_sum / received / 1000 : 0) << " us";
+	if (received != messages)
+		std::cout << " (" << messages - received << " messages lost)";
+	std::cout << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+	std::string host = argc > 1 ? argv[1] : "localhost";
+	int port = argc > 2 ? std::atoi(argv[2]) : 1883;
+	unsigned int messages = argc > 3 ? static_cast<unsigned int>(std::atoi(argv[3])) : 100000;
+	try {
+		run(host, port, messages, 0, std::chrono::microseconds(0));
+		for (std::size_t batch_size : {8, 64, 256})
+			run(host, port, messages, batch_size, std::chrono::microseconds(1000));
+	} catch (const std::exception &e) {
+		std::cerr << "Error: " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
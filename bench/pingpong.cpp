@@ -0,0 +1,98 @@
+/*
+ * This file is part of fast-lib.
+ * Copyright (C) 2015 RWTH Aachen University - ACS
+ *
+ * This file is licensed under the GNU Lesser General Public License Version 3
+ * Version 3, 29 June 2007. For details see 'LICENSE.md' in the root directory.
+ */
+
+// Measures the round trip latency of messages between two MQTT_communicators
+// via a local broker, with default and with low-latency transport options.
+//
+// Usage: fastlib_pingpong_bench [host] [port] [iterations]
+
+#include <fast-lib/mqtt_communicator.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using fast::MQTT_communicator;
+
+static void print_result(const std::string &name, std::vector<double> rtts)
+{
+	std::sort(rtts.begin(), rtts.end());
+	double sum = 0;
+	for (auto rtt : rtts)
+		sum += rtt;
+	std::cout << name << ": "
+		<< "mean " << sum / rtts.size() << " us, "
+		<< "median " << rtts[rtts.size() / 2] << " us, "
+		<< "p99 " << rtts[rtts.size() * 99 / 100] << " us, "
+		<< "min " << rtts.front() << " us" << std::endl;
+}
+
+static std::vector<double> run(const std::string &host, int port, unsigned int iterations, const fast::Transport_options &options)
+{
+	const std::string ping_topic("fast/bench/ping");
+	const std::string pong_topic("fast/bench/pong");
+	MQTT_communicator ping("", ping_topic, host, port, 60, std::chrono::seconds(5));
+	MQTT_communicator pong("", pong_topic, host, port, 60, std::chrono::seconds(5));
+	ping.set_transport_options(options);
+	auto pong_options = options;
+	if (pong_options.network_cpu != -1)
+		pong_options.network_cpu = (pong_options.network_cpu + 1) % static_cast<int>(std::thread::hardware_concurrency());
+	pong.set_transport_options(pong_options);
+	// Answer every ping directly from the network thread.
+	pong.add_subscription(ping_topic, [&pong, &pong_topic](std::string msg) {
+		pong.send_message(msg, pong_topic, 0, fast::Priority::high);
+	}, 0);
+	auto pong_subscription = ping.add_subscription(pong_topic, 0);
+	// Give the broker time to register both subscriptions.
+	std::this_thread::sleep_for(std::chrono::milliseconds(500));
+	const std::string payload(64, 'x');
+	std::vector<double> rtts;
+	rtts.reserve(iterations);
+	// The first round trips warm up caches and connections.
+	for (unsigned int i = 0; i != iterations + iterations / 10; ++i) {
+		auto start = std::chrono::steady_clock::now();
+		ping.send_message(payload, ping_topic, 0, fast::Priority::high);
+		pong_subscription.get_message(std::chrono::seconds(5));
+		auto rtt = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start);
+		if (i >= iterations / 10)
+			rtts.push_back(rtt.count());
+	}
+	pong.remove_subscription(ping_topic);
+	return rtts;
+}
+
+int main(int argc, char **argv)
+{
+	std::string host = argc > 1 ? argv[1] : "localhost";
+	int port = argc > 2 ? std::atoi(argv[2]) : 1883;
+	unsigned int iterations = argc > 3 ? static_cast<unsigned int>(std::atoi(argv[3])) : 10000;
+	try {
+		print_result("default", run(host, port, iterations, fast::Transport_options()));
+		fast::Transport_options low_latency;
+		low_latency.tcp_nodelay = true;
+		print_result("tcp_nodelay", run(host, port, iterations, low_latency));
+		// Spinning network threads of both communicators need a core each besides broker and main thread.
+		if (std::thread::hardware_concurrency() < 4) {
+			std::cout << "Skipping busy polling, as it needs at least 4 CPUs." << std::endl;
+			return 0;
+		}
+		low_latency.busy_poll = true;
+		low_latency.network_cpu = 2;
+		print_result("tcp_nodelay + busy_poll", run(host, port, iterations, low_latency));
+		low_latency.socket_busy_poll = 50;
+		print_result("tcp_nodelay + busy_poll + SO_BUSY_POLL", run(host, port, iterations, low_latency));
+	} catch (const std::exception &e) {
+		std::cerr << "Error: " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,80 @@
+/*
+ * This file is part of fast-lib.
+ * Copyright (C) 2015 RWTH Aachen University - ACS
+ *
+ * This file is licensed under the GNU Lesser General Public License Version 3
+ * Version 3, 29 June 2007. For details see 'LICENSE.md' in the root directory.
+ */
+
+// Measures the throughput of messages published concurrently by several threads
+// of one MQTT_communicator, with send_message() and with post_message().
+//
+// Usage: fastlib_publish_throughput_bench [host] [port] [messages per thread] [max threads]
+
+#include <fast-lib/mqtt_communicator.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using fast::MQTT_communicator;
+
+static double run(const std::string &host, int port, unsigned int messages, unsigned int thread_count, bool post)
+{
+	const std::string topic("fast/bench/throughput");
+	MQTT_communicator sender("", topic, host, port, 60, std::chrono::seconds(5));
+	MQTT_communicator receiver("", topic, host, port, 60, std::chrono::seconds(5));
+	std::atomic<unsigned int> received(0);
+	// QoS 0, as brokers drop QoS 1 messages beyond a small queue of in-flight messages per client.
+	receiver.add_subscription(topic, [&received](std::string) {
+		++received;
+	}, 0);
+	// Give the broker time to register the subscription.
+	std::this_thread::sleep_for(std::chrono::milliseconds(500));
+	const std::string payload(64, 'x');
+	auto start = std::chrono::steady_clock::now();
+	std::vector<std::thread> threads;
+	for (unsigned int t = 0; t != thread_count; ++t) {
+		threads.emplace_back([&] {
+			for (unsigned int i = 0; i != messages; ++i) {
+				if (post)
+					sender.post_message(payload, topic, 0);
+				else
+					sender.send_message(payload, topic, 0);
+			}
+		});
+	}
+	for (auto &thread : threads)
+		thread.join();
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(60);
+	while (received != messages * thread_count && std::chrono::steady_clock::now() < deadline)
+		std::this_thread::sleep_for(std::chrono::microseconds(100));
+	std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+	if (received != messages * thread_count)
+		std::cerr << "Only " << received << " of " << messages * thread_count << " messages were received." << std::endl;
+	receiver.remove_subscription(topic);
+	return received / duration.count();
+}
+
+int main(int argc, char **argv)
+{
+	std::string host = argc > 1 ? argv[1] : "localhost";
+	int port = argc > 2 ? std::atoi(argv[2]) : 1883;
+	unsigned int messages = argc > 3 ? static_cast<unsigned int>(std::atoi(argv[3])) : 10000;
+	unsigned int max_threads = argc > 4 ? static_cast<unsigned int>(std::atoi(argv[4])) : 8;
+	try {
+		for (unsigned int threads = 1; threads <= max_threads; threads *= 2) {
+			std::cout << threads << " thread(s): "
+				<< "send_message " << static_cast<unsigned long>(run(host, port, messages, threads, false)) << " msg/s, "
+				<< "post_message " << static_cast<unsigned long>(run(host, port, messages, threads, true)) << " msg/s" << std::endl;
+		}
+	} catch (const std::exception &e) {
+		std::cerr << "Error: " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,172 @@
+/*
+ * This file is part of fast-lib.
+ * Copyright (C) 2015 RWTH Aachen University - ACS
+ *
+ * This file is licensed under the GNU Lesser General Public License Version 3
+ * Version 3, 29 June 2007. For details see 'LICENSE.md' in the root directory.
+ */
+
+// Measures encoding and decoding of a Task_container with several Start tasks
+// in the YAML and in the binary wire format, peeking at its header in both formats,
+// as well as time and heap allocations
+// of constructing migfra tasks and emitting their YAML nodes.
+// Emitting a Migrate is compared with merging a temporary node per Optional, as done before emit_into().
+//
+// Encoding and decoding is repeated with the opt-in parallel path, by default on all hardware threads.
+//
+// Usage: fastlib_serialization_bench [iterations] [tasks] [threads]
+
+#include <fast-lib/message/migfra/task.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+
+using namespace fast::msg::migfra;
+
+// Count heap allocations by replacing the global operator new.
+static std::atomic<unsigned long> allocations(0);
+
+void * operator new(std::size_t size)
+{
+	++allocations;
+	if (void *ptr = std::malloc(size ? size : 1))
+		return ptr;
+	throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept
+{
+	std::free(ptr);
+}
+
+static Task_container make_container(unsigned int task_count)
+{
+	Task_container container;
+	container.id = "42";
+	for (unsigned int i = 0; i != task_count; ++i) {
+		auto start = std::make_shared<Start>();
+		start->vm_name = "vm" + std::to_string(i);
+		start->vcpus = 4;
+		start->memory = 4 * 1024 * 1024;
+		start->pci_ids.emplace_back(0x15b3, 0x1004);
+		start->ivshmem = Device_ivshmem();
+		start->ivshmem->id = "ivshmem" + std::to_string(i);
+		start->ivshmem->size = "512M";
+		start->time_measurement = true;
+		container.tasks.push_back(start);
+	}
+	return container;
+}
+
+static Task_container make_migrate()
+{
+	auto migrate = std::make_shared<Migrate>("vm0", "desthost", "live", true, false, "auto", true);
+	migrate->swap_with = Swap_with();
+	migrate->swap_with->vm_name = "vm1";
+	migrate->swap_with->vcpu_map = std::vector<std::vector<unsigned int>>{{0, 1}, {2, 3}};
+	migrate->retry_counter = 3;
+	return Task_container({migrate}, true, "43");
+}
+
+// Emit a migrate vm container by merging a temporary node per Optional into its parent.
+static YAML::Node emit_merged(const Task_container &container)
+{
+	const auto &merge_node = fast::yaml::merge_node;
+	const auto &migrate = static_cast<const Migrate &>(*container.tasks.front());
+	YAML::Node task;
+	merge_node(task, migrate.concurrent_execution.emit());
+	merge_node(task, migrate.time_measurement.emit());
+	merge_node(task, migrate.driver.emit());
+	task["vm-name"] = migrate.vm_name;
+	task["destination"] = migrate.dest_hostname;
+	YAML::Node params = task["parameter"];
+	merge_node(params, migrate.retry_counter.emit());
+	merge_node(params, migrate.migration_type.emit());
+	merge_node(params, migrate.rdma_migration.emit());
+	merge_node(params, migrate.pscom_hook_procs.emit());
+	merge_node(params, migrate.transport.emit());
+	merge_node(params, migrate.swap_with.emit());
+	merge_node(params, migrate.vcpu_map.emit());
+	if (migrate.vcpu_map.is_valid())
+		params[migrate.vcpu_map.get_tag()].SetStyle(YAML::EmitterStyle::Flow);
+	YAML::Node node;
+	node["task"] = container.type();
+	merge_node(node, task);
+	merge_node(node, container.concurrent_execution.emit());
+	merge_node(node, container.id.emit());
+	return node;
+}
+
+template<class Encode> static double time_per_call(unsigned int iterations, Encode &&encode)
+{
+	auto start = std::chrono::steady_clock::now();
+	for (unsigned int i = 0; i != iterations; ++i)
+		encode();
+	std::chrono::duration<double, std::micro> duration = std::chrono::steady_clock::now() - start;
+	return duration.count() / iterations;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int iterations = argc > 1 ? static_cast<unsigned int>(std::atoi(argv[1])) : 2000;
+	unsigned int task_count = argc > 2 ? static_cast<unsigned int>(std::atoi(argv[2])) : 8;
+	auto container = make_container(task_count);
+	std::string yaml_buffer, binary_buffer;
+	fast::yaml::to_string(container, yaml_buffer);
+	fast::binary::to_string(container, binary_buffer);
+	Task_container decoded;
+	auto yaml_encode = time_per_call(iterations, [&] { fast::yaml::to_string(container, yaml_buffer); });
+	auto yaml_decode = time_per_call(iterations, [&] { decoded.from_string(yaml_buffer); });
+	auto binary_encode = time_per_call(iterations, [&] { fast::binary::to_string(container, binary_buffer); });
+	auto binary_decode = time_per_call(iterations, [&] { decoded.from_string(binary_buffer); });
+	std::cout << "yaml: " << yaml_buffer.size() << " bytes, "
+		<< "encode " << yaml_encode << " us, decode " << yaml_decode << " us" << std::endl;
+	std::cout << "binary: " << binary_buffer.size() << " bytes, "
+		<< "encode " << binary_encode << " us, decode " << binary_decode << " us" << std::endl;
+	fast::Parallel_options parallel;
+	parallel.threads = argc > 3 ? static_cast<unsigned int>(std::atoi(argv[3])) : std::thread::hardware_concurrency();
+	auto parallel_container = container;
+	parallel_container.parallel = parallel;
+	decoded.parallel = parallel;
+	yaml_encode = time_per_call(iterations, [&] { fast::yaml::to_string(parallel_container, yaml_buffer); });
+	yaml_decode = time_per_call(iterations, [&] { decoded.from_string(yaml_buffer); });
+	binary_encode = time_per_call(iterations, [&] { fast::binary::to_string(parallel_container, binary_buffer); });
+	binary_decode = time_per_call(iterations, [&] { decoded.from_string(binary_buffer); });
+	std::cout << "parallel (" << parallel.threads << " threads) yaml: "
+		<< "encode " << yaml_encode << " us, decode " << yaml_decode << " us" << std::endl;
+	std::cout << "parallel (" << parallel.threads << " threads) binary: "
+		<< "encode " << binary_encode << " us, decode " << binary_decode << " us" << std::endl;
+	auto yaml_peek = time_per_call(iterations, [&] { Task_container::peek_header(yaml_buffer); });
+	auto binary_peek = time_per_call(iterations, [&] { Task_container::peek_header(binary_buffer); });
+	std::cout << "peek header: yaml " << yaml_peek << " us, binary " << binary_peek << " us" << std::endl;
+	auto before = allocations.load();
+	make_migrate();
+	std::cout << "construct migrate vm: " << allocations.load() - before << " allocations" << std::endl;
+	for (const auto &task : {container, make_migrate()}) {
+		auto before = allocations.load();
+		task.emit();
+		auto emit_allocations = allocations.load() - before;
+		auto emit = time_per_call(iterations, [&] { task.emit(); });
+		std::cout << "emit " << task.type() << ": " << emit << " us, " << emit_allocations << " allocations";
+		if (task.type() == "migrate vm") {
+			before = allocations.load();
+			emit_merged(task);
+			auto merged_allocations = allocations.load() - before;
+			auto merged = time_per_call(iterations, [&] { emit_merged(task); });
+			std::cout << " (merge_node: " << merged << " us, " << merged_allocations << " allocations)";
+		}
+		std::cout << std::endl;
+	}
+	return 0;
+}
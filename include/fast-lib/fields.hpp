@@ -0,0 +1,304 @@
+/*
+ * This file is part of fast-lib.
+ * Copyright (C) 2015 RWTH Aachen University - ACS
+ *
+ * This file is licensed under the GNU Lesser General Public License Version 3
+ * Version 3, 29 June 2007. For details see 'LICENSE.md' in the root directory.
+ */
+
+#ifndef FAST_LIB_FIELDS_HPP
+#define FAST_LIB_FIELDS_HPP
+
+#include <fast-lib/serializable.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <tuple>
+#include <type_traits>
+
+/**
+ * \brief Declare the fields of a message type to generate its serialization.
+ *
+ * Use in the class body after the members with a list of fast::field() and fast::constant_field(), e.g.:
+ * FASTLIB_FIELDS(fast::field("job-id", &job_description::job_id), fast::field("process-id", &job_description::process_id))
+ * Then implement emit(), load(), emit_binary(), load_binary() and operator== using the functions in fast::fields.
+ * Entries are emitted in the order of the list.
+ */
+#define FASTLIB_FIELDS(...) \
+	static auto fields() -> decltype(std::make_tuple(__VA_ARGS__)) \
+	{ \
+		return std::make_tuple(__VA_ARGS__); \
+	}
+
+namespace fast
+{
+	/**
+ 	 * \brief Describes a member of a message type and the key it is serialized with.
+ 	 */
+	template<class C, class M> struct Field
+	{
+		const char *key;
+		M C::*member;
+	};
+
+	/**
+ 	 * \brief Describes a constant entry of a message type, e.g., its task, which is emitted but not loaded.
+ 	 */
+	struct Constant_field
+	{
+		const char *key;
+		const char *value;
+	};
+
+	/**
+ 	 * \brief Describe a member of a message type for FASTLIB_FIELDS.
+ 	 */
+	template<class C, class M> constexpr Field<C, M> field(const char *key, M C::*member)
+	{
+		return Field<C, M>{key, member};
+	}
+
+	/**
+ 	 * \brief Describe a constant entry of a message type for FASTLIB_FIELDS.
+ 	 */
+	constexpr Constant_field constant_field(const char *key, const char *value)
+	{
+		return Constant_field{key, value};
+	}
+
+	/**
+ 	 * \brief Serialization generated from the fields declared with FASTLIB_FIELDS.
+ 	 *
+ 	 * The fields are unrolled at compile time, so no keys are looked up to find the members.
+ 	 */
+	namespace fields
+	{
+		namespace detail
+		{
+			template<std::size_t I, class Tuple, class Visitor>
+			typename std::enable_if<I == std::tuple_size<Tuple>::value>::type
+				for_each(const Tuple &, Visitor &)
+			{
+			}
+
+			template<std::size_t I, class Tuple, class Visitor>
+			typename std::enable_if<(I < std::tuple_size<Tuple>::value)>::type
+				for_each(const Tuple &fields, Visitor &visitor)
+			{
+				visitor(std::get<I>(fields));
+				for_each<I + 1>(fields, visitor);
+			}
+
+			template<class C> struct Emit_visitor
+			{
+				const C &obj;
+				YAML::Node &node;
+
+				template<class D, class M> void operator()(const Field<D, M> &field) const
+				{
+					node[field.key] = obj.*field.member;
+				}
+				void operator()(const Constant_field &field) const
+				{
+					node[field.key] = field.value;
+				}
+			};
+
+			// Serializable members are loaded in place, others are converted by yaml-cpp.
+			template<class M> typename std::enable_if<std::is_base_of<Serializable, M>::value>::type
+				load_member(M &member, const YAML::Node &node)
+			{
+				if (!node)
+					throw std::runtime_error("Error loading YAML-node: Node is not valid.");
+				member.load(node);
+			}
+			template<class M> typename std::enable_if<!std::is_base_of<Serializable, M>::value>::type
+				load_member(M &member, const YAML::Node &node)
+			{
+				fast::load(member, node);
+			}
+
+			template<class C> struct Load_visitor
+			{
+				C &obj;
+				const YAML::Node &node;
+
+				template<class D, class M> void operator()(const Field<D, M> &field) const
+				{
+					load_member(obj.*field.member, node[field.key]);
+				}
+				void operator()(const Constant_field &) const
+				{
+				}
+			};
+
+			template<class C> struct Binary_visitor
+			{
+				const C &obj;
+				std::string &buffer;
+
+				template<class D, class M> void operator()(const Field<D, M> &field) const
+				{
+					binary::append_value(buffer, field.key);
+					binary::append_value(buffer, obj.*field.member);
+				}
+				void operator()(const Constant_field &field) const
+				{
+					binary::append_value(buffer, field.key);
+					binary::append_value(buffer, field.value);
+				}
+			};
+
+			// Reads the value of an entry into the field with a matching key and marks the field as found.
+			template<class C> struct Binary_load_visitor
+			{
+				C &obj;
+				binary::Reader &in;
+				const char *key;
+				std::size_t size;
+				std::size_t index;
+				std::uint64_t found;
+
+				template<class D, class M> void operator()(const Field<D, M> &field)
+				{
+					if (found == 0 && binary::read_entry(in, key, size, field.key, obj.*field.member))
+						found = std::uint64_t(1) << index;
+					++index;
+				}
+				void operator()(const Constant_field &)
+				{
+					++index;
+				}
+			};
+
+			// Marks the fields, which must be found when loading.
+			struct Required_visitor
+			{
+				std::size_t index;
+				std::uint64_t required;
+
+				template<class D, class M> void operator()(const Field<D, M> &)
+				{
+					required |= std::uint64_t(1) << index++;
+				}
+				void operator()(const Constant_field &)
+				{
+					++index;
+				}
+			};
+
+			// Names the first missing field.
+			struct Missing_visitor
+			{
+				std::uint64_t missing;
+				std::size_t index;
+				const char *key;
+
+				template<class D, class M> void operator()(const Field<D, M> &field)
+				{
+					if (!key && (missing >> index & 1))
+						key = field.key;
+					++index;
+				}
+				void operator()(const Constant_field &)
+				{
+					++index;
+				}
+			};
+
+			template<class C> struct Equal_visitor
+			{
+				const C &lhs;
+				const C &rhs;
+				bool equal;
+
+				template<class D, class M> void operator()(const Field<D, M> &field)
+				{
+					equal = equal && lhs.*field.member == rhs.*field.member;
+				}
+				void operator()(const Constant_field &)
+				{
+				}
+			};
+		}
+
+		/**
+ 		 * \brief Add the fields of obj to a YAML node.
+ 		 */
+		template<class C> void emit_into(const C &obj, YAML::Node &node)
+		{
+			detail::Emit_visitor<C> visitor{obj, node};
+			detail::for_each<0>(C::fields(), visitor);
+		}
+
+		/**
+ 		 * \brief Emit the fields of obj as YAML node.
+ 		 */
+		template<class C> YAML::Node emit(const C &obj)
+		{
+			YAML::Node node;
+			emit_into(obj, node);
+			return node;
+		}
+
+		/**
+ 		 * \brief Load the fields of obj from a YAML node.
+ 		 *
+ 		 * Throws if a field is missing. Constant fields are not checked.
+ 		 */
+		template<class C> void load(C &obj, const YAML::Node &node)
+		{
+			detail::Load_visitor<C> visitor{obj, node};
+			detail::for_each<0>(C::fields(), visitor);
+		}
+
+		/**
+ 		 * \brief Append the fields of obj to a buffer in the binary format.
+ 		 */
+		template<class C> void emit_binary(const C &obj, std::string &buffer)
+		{
+			binary::append_map_header(buffer, std::tuple_size<decltype(C::fields())>::value);
+			detail::Binary_visitor<C> visitor{obj, buffer};
+			detail::for_each<0>(C::fields(), visitor);
+		}
+
+		/**
+ 		 * \brief Load the fields of obj from the binary format without building a YAML node.
+ 		 *
+ 		 * Loads the same as load() with the decoded node: Throws if a field is missing and skips unknown
+ 		 * entries. Constant fields are not checked.
+ 		 */
+		template<class C> void load_binary(C &obj, binary::Reader &in)
+		{
+			using Fields = decltype(C::fields());
+			static_assert(std::tuple_size<Fields>::value <= 64, "Too many fields to track while loading");
+			std::uint64_t found = 0;
+			binary::read_map(in, [&](const char *key, std::size_t size) {
+				detail::Binary_load_visitor<C> visitor{obj, in, key, size, 0, 0};
+				detail::for_each<0>(C::fields(), visitor);
+				found |= visitor.found;
+				return visitor.found != 0;
+			});
+			detail::Required_visitor required{0, 0};
+			detail::for_each<0>(C::fields(), required);
+			if (found != required.required) {
+				detail::Missing_visitor missing{required.required & ~found, 0, nullptr};
+				detail::for_each<0>(C::fields(), missing);
+				binary::require_entry(false, missing.key);
+			}
+		}
+
+		/**
+ 		 * \brief Compare all fields of two objects.
+ 		 */
+		template<class C> bool equal(const C &lhs, const C &rhs)
+		{
+			detail::Equal_visitor<C> visitor{lhs, rhs, true};
+			detail::for_each<0>(C::fields(), visitor);
+			return visitor.equal;
+		}
+	}
+}
+
+#endif
@@ -9,7 +9,7 @@
 #ifndef FAST_LIB_MESSAGE_INIT_HPP
 #define FAST_LIB_MESSAGE_INIT_HPP
 
-#include <fast-lib/serializable.hpp>
+#include <fast-lib/fields.hpp>
 
 namespace fast {
 namespace msg {
@@ -28,8 +28,17 @@ struct init : public fast::Serializable
 
 	YAML::Node emit() const override;
 	void load(const YAML::Node &node) override;
+	void emit_binary(std::string &buffer) const override;
+	void load_binary(fast::binary::Reader &in) override;
+
+	bool operator==(const init &rhs) const;
 
 	std::string hostname;
+
+	FASTLIB_FIELDS(
+		fast::constant_field("task", "init"),
+		fast::field("hostname", &init::hostname)
+	)
 };
 
 }
@@ -9,7 +9,7 @@
 #ifndef FAST_LIB_MESSAGE_AGENT_INIT_AGENT
 #define FAST_LIB_MESSAGE_AGENT_INIT_AGENT
 
-#include <fast-lib/serializable.hpp>
+#include <fast-lib/fields.hpp>
 
 #include <map>
 #include <string>
@@ -39,9 +39,18 @@ struct kpis : public fast::Serializable
 
 	YAML::Node emit() const override;
 	void load(const YAML::Node &node) override;
+	void emit_binary(std::string &buffer) const override;
+	void load_binary(fast::binary::Reader &in) override;
+
+	bool operator==(const kpis &rhs) const;
 
 	std::map<std::string, std::string> categories;
 	unsigned int kpi_repeat;
+
+	FASTLIB_FIELDS(
+		fast::field("categories", &kpis::categories),
+		fast::field("repeat", &kpis::kpi_repeat)
+	)
 };
 
 struct init_agent : public fast::Serializable
@@ -51,8 +60,17 @@ struct init_agent : public fast::Serializable
 
 	YAML::Node emit() const override;
 	void load(const YAML::Node &node) override;
+	void emit_binary(std::string &buffer) const override;
+	void load_binary(fast::binary::Reader &in) override;
+
+	bool operator==(const init_agent &rhs) const;
 
 	kpis KPIs;
+
+	FASTLIB_FIELDS(
+		fast::constant_field("task", "init agent"),
+		fast::field("KPI", &init_agent::KPIs)
+	)
 };
 
 }
@@ -32,6 +32,8 @@ struct ack : public fast::Serializable
 
 	YAML::Node emit() const override;
 	void load(const YAML::Node &node) override;
+	void emit_binary(std::string &buffer) const override;
+	void load_binary(fast::binary::Reader &in) override;
 };
 
 }
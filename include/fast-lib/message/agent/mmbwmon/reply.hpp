@@ -9,7 +9,7 @@
 #ifndef FAST_LIB_MESSAGE_AGENT_MMBWMON_REPLY
 #define FAST_LIB_MESSAGE_AGENT_MMBWMON_REPLY
 
-#include <fast-lib/serializable.hpp>
+#include <fast-lib/fields.hpp>
 
 #include <map>
 #include <string>
@@ -35,9 +35,18 @@ struct reply : public fast::Serializable
 
 	YAML::Node emit() const override;
 	void load(const YAML::Node &node) override;
+	void emit_binary(std::string &buffer) const override;
+	void load_binary(fast::binary::Reader &in) override;
+
+	bool operator==(const reply &rhs) const;
 
 	std::vector<size_t> cores;
 	double result;
+
+	FASTLIB_FIELDS(
+		fast::field("cores", &reply::cores),
+		fast::field("result", &reply::result)
+	)
 };
 
 }
@@ -9,7 +9,7 @@
 #ifndef FAST_LIB_MESSAGE_AGENT_MMBWMON_REQUEST
 #define FAST_LIB_MESSAGE_AGENT_MMBWMON_REQUEST
 
-#include <fast-lib/serializable.hpp>
+#include <fast-lib/fields.hpp>
 
 #include <map>
 #include <string>
@@ -34,8 +34,16 @@ struct request : public fast::Serializable
 
 	YAML::Node emit() const override;
 	void load(const YAML::Node &node) override;
+	void emit_binary(std::string &buffer) const override;
+	void load_binary(fast::binary::Reader &in) override;
+
+	bool operator==(const request &rhs) const;
 
 	std::vector<size_t> cores;
+
+	FASTLIB_FIELDS(
+		fast::field("cores", &request::cores)
+	)
 };
 
 }
@@ -9,7 +9,7 @@
 #ifndef FAST_LIB_MESSAGE_AGENT_MMBWMON_RESTART
 #define FAST_LIB_MESSAGE_AGENT_MMBWMON_RESTART
 
-#include <fast-lib/serializable.hpp>
+#include <fast-lib/fields.hpp>
 
 #include <map>
 #include <string>
@@ -33,8 +33,16 @@ struct restart : public fast::Serializable
 
 	YAML::Node emit() const override;
 	void load(const YAML::Node &node) override;
+	void emit_binary(std::string &buffer) const override;
+	void load_binary(fast::binary::Reader &in) override;
+
+	bool operator==(const restart &rhs) const;
 
 	std::string cgroup;
+
+	FASTLIB_FIELDS(
+		fast::field("cgroup", &restart::cgroup)
+	)
 };
 
 }
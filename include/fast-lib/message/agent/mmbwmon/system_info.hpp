@@ -9,7 +9,7 @@
 #ifndef FAST_LIB_MESSAGE_AGENT_MMBWMON_SYSTEM_INFO
 #define FAST_LIB_MESSAGE_AGENT_MMBWMON_SYSTEM_INFO
 
-#include <fast-lib/serializable.hpp>
+#include <fast-lib/fields.hpp>
 
 #include <map>
 #include <string>
@@ -37,11 +37,22 @@ struct system_info : public fast::Serializable
 
 	YAML::Node emit() const override;
 	void load(const YAML::Node &node) override;
+	void emit_binary(std::string &buffer) const override;
+	void load_binary(fast::binary::Reader &in) override;
+
+	bool operator==(const system_info &rhs) const;
 
 	size_t threads;
 	size_t smt;
 	size_t numa;
 	std::vector<double> membw;
+
+	FASTLIB_FIELDS(
+		fast::field("threads", &system_info::threads),
+		fast::field("smt", &system_info::smt),
+		fast::field("numa", &system_info::numa),
+		fast::field("bandwidth", &system_info::membw)
+	)
 };
 
 }
@@ -9,7 +9,7 @@
 #ifndef FAST_LIB_MESSAGE_AGENT_STOP_MONITOR_HPP
 #define FAST_LIB_MESSAGE_AGENT_STOP_MONITOR_HPP
 
-#include <fast-lib/serializable.hpp>
+#include <fast-lib/fields.hpp>
 
 #include <map>
 #include <string>
@@ -34,9 +34,18 @@ struct job_description : public fast::Serializable
 
 	YAML::Node emit() const override;
 	void load(const YAML::Node &node) override;
+	void emit_binary(std::string &buffer) const override;
+	void load_binary(fast::binary::Reader &in) override;
+
+	bool operator==(const job_description &rhs) const;
 
 	std::string job_id;
 	unsigned int process_id;
+
+	FASTLIB_FIELDS(
+		fast::field("job-id", &job_description::job_id),
+		fast::field("process-id", &job_description::process_id)
+	)
 };
 
 struct stop_monitoring : public fast::Serializable
@@ -46,8 +55,17 @@ struct stop_monitoring : public fast::Serializable
 
 	YAML::Node emit() const override;
 	void load(const YAML::Node &node) override;
+	void emit_binary(std::string &buffer) const override;
+	void load_binary(fast::binary::Reader &in) override;
+
+	bool operator==(const stop_monitoring &rhs) const;
 
 	job_description job_desc;
+
+	FASTLIB_FIELDS(
+		fast::constant_field("task", "stop monitoring"),
+		fast::field("job-description", &stop_monitoring::job_desc)
+	)
 };
 
 }
@@ -18,6 +18,10 @@ namespace fast {
 namespace msg {
 namespace migfra {
 
+namespace tags {
+FASTLIB_OPTIONAL_TAG(path, "path")
+}
+
 struct Device_ivshmem :
 	public fast::Serializable
 {
@@ -25,10 +29,13 @@ struct Device_ivshmem :
 
 	YAML::Node emit() const override;
 	void load(const YAML::Node &node) override;
+	void emit_stream(YAML::Emitter &out) const override;
+	void emit_binary(std::string &buffer) const override;
+	void load_binary(fast::binary::Reader &in) override;
 
 	std::string id;
 	std::string size;
-	Optional<std::string> path;
+	Inline_optional<std::string, tags::path> path;
 };
 
 }
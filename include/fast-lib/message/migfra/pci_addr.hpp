@@ -38,6 +38,9 @@ namespace fast {
 
 				YAML::Node emit() const override;
 				void load(const YAML::Node &node) override;
+				void emit_stream(YAML::Emitter &out) const override;
+				void emit_binary(std::string &buffer) const override;
+				void load_binary(fast::binary::Reader &in) override;
 			};
 
 			std::ostream & operator<<(std::ostream &os, const PCI_addr &rhs);
@@ -69,6 +69,18 @@ struct PCI_id :
  	 * \brief Initialize from YAML.
  	 */
 	void load(const YAML::Node &node) override;
+	/**
+ 	 * \brief Serialize to a YAML emitter.
+ 	 */
+	void emit_stream(YAML::Emitter &out) const override;
+	/**
+ 	 * \brief Serialize to the binary format.
+ 	 */
+	void emit_binary(std::string &buffer) const override;
+	/**
+ 	 * \brief Initialize from the binary format.
+ 	 */
+	void load_binary(fast::binary::Reader &in) override;
 
 	/**
  	 * \brief vendor ID part.
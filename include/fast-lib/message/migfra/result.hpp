@@ -10,6 +10,7 @@
 #define FAST_LIB_MESSAGE_MIGFRA_RESULT_HPP
 
 #include <fast-lib/message/migfra/time_measurement.hpp>
+#include <fast-lib/parallel.hpp>
 #include <fast-lib/serializable.hpp>
 
 #include <vector>
@@ -55,6 +56,21 @@ struct Result : public fast::Serializable
  	 * \brief Initialize Result from YAML.
  	 */
 	void load(const YAML::Node &node) override;
+	/**
+ 	 * \brief Serialize Result to a buffer in the binary format.
+ 	 */
+	void emit_binary(std::string &buffer) const override;
+	/**
+ 	 * \brief Initialize Result from the binary format.
+ 	 */
+	void load_binary(fast::binary::Reader &in) override;
+	/**
+ 	 * \brief Append the entries of Result to the enclosing mapping in the binary format.
+ 	 *
+ 	 * Used by Result_container to merge the entries of a result.
+ 	 * \return The number of appended entries.
+ 	 */
+	std::size_t append_entries(std::string &buffer) const;
 
 	/**
  	 * \brief Name of the domain the result concerns.
@@ -109,6 +125,14 @@ struct Result_container : public fast::Serializable
  	 * \brief Initialize Results from YAML.
  	 */
 	void load(const YAML::Node &node) override;
+	/**
+ 	 * \brief Serialize all Results to a buffer in the binary format.
+ 	 */
+	void emit_binary(std::string &buffer) const override;
+	/**
+ 	 * \brief Initialize Results from the binary format.
+ 	 */
+	void load_binary(fast::binary::Reader &in) override;
 
 	/**
  	 * \brief Type of tasks the results are from.
@@ -122,6 +146,12 @@ struct Result_container : public fast::Serializable
  	 * \brief Used to track tasks and corresponding results.
  	 */
 	std::string id;
+	/**
+ 	 * \brief Options to emit and load long lists of results on several threads.
+ 	 *
+ 	 * Used by load(), emit(), emit_binary() and load_binary(). Not serialized. Sequential by default.
+ 	 */
+	fast::Parallel_options parallel;
 };
 
 }
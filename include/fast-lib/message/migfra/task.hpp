@@ -14,6 +14,7 @@
 #include <fast-lib/message/migfra/pci_addr.hpp>
 #include <fast-lib/message/migfra/time_measurement.hpp>
 #include <fast-lib/optional.hpp>
+#include <fast-lib/parallel.hpp>
 #include <fast-lib/serializable.hpp>
 
 #include <memory>
@@ -24,6 +25,37 @@ namespace fast {
 namespace msg {
 namespace migfra {
 
+/**
+ * \brief Tags of the optional members of tasks.
+ */
+namespace tags {
+FASTLIB_OPTIONAL_TAG(concurrent_execution, "concurrent-execution")
+FASTLIB_OPTIONAL_TAG(time_measurement, "time-measurement")
+FASTLIB_OPTIONAL_TAG(driver, "driver")
+FASTLIB_OPTIONAL_TAG(id, "id")
+FASTLIB_OPTIONAL_TAG(vm_name, "vm-name")
+FASTLIB_OPTIONAL_TAG(vcpus, "vcpus")
+FASTLIB_OPTIONAL_TAG(memory, "memory")
+FASTLIB_OPTIONAL_TAG(memnode_map, "memnode-map")
+FASTLIB_OPTIONAL_TAG(xml, "xml")
+FASTLIB_OPTIONAL_TAG(ivshmem, "ivshmem")
+FASTLIB_OPTIONAL_TAG(transient, "transient")
+FASTLIB_OPTIONAL_TAG(vcpu_map, "vcpu-map")
+FASTLIB_OPTIONAL_TAG(probe_with_ssh, "probe-with-ssh")
+FASTLIB_OPTIONAL_TAG(probe_hostname, "probe-hostname")
+FASTLIB_OPTIONAL_TAG(regex, "regex")
+FASTLIB_OPTIONAL_TAG(force, "force")
+FASTLIB_OPTIONAL_TAG(undefine, "undefine")
+FASTLIB_OPTIONAL_TAG(pscom_hook_procs, "pscom-hook-procs")
+FASTLIB_OPTIONAL_TAG(retry_counter, "retry_counter")
+FASTLIB_OPTIONAL_TAG(migration_type, "migration-type")
+FASTLIB_OPTIONAL_TAG(rdma_migration, "rdma-migration")
+FASTLIB_OPTIONAL_TAG(transport, "transport")
+FASTLIB_OPTIONAL_TAG(swap_with, "swap-with")
+FASTLIB_OPTIONAL_TAG(mode, "mode")
+FASTLIB_OPTIONAL_TAG(overbooking, "overbooking")
+}
+
 /**
  * \brief An abstract struct to provide an interface for a Task.
  */
@@ -47,26 +79,70 @@ struct Task :
 	virtual ~Task() = default;
 
 	/**
- 	 * \brief Serialize this Task to YAML.
+ 	 * \brief Serialize this Task to YAML using emit_into().
  	 */
 	YAML::Node emit() const override;
+	/**
+ 	 * \brief Add the entries of this Task to a YAML node.
+ 	 *
+ 	 * Derived tasks override this instead of emit(). Used by Task_container to merge the entries of a task.
+ 	 */
+	void emit_into(YAML::Node &node) const override;
 	/**
  	 * \brief Deserialize this Task from YAML.
  	 */
 	void load(const YAML::Node &node) override;
+	/**
+ 	 * \brief Serialize this Task to a YAML emitter.
+ 	 */
+	void emit_stream(YAML::Emitter &out) const override;
+	/**
+ 	 * \brief Stream the entries of this Task into the enclosing mapping in the order of emit().
+ 	 *
+ 	 * Derived tasks override this along with emit(). Used by Task_container to merge the entries of a task.
+ 	 */
+	virtual void emit_entries(YAML::Emitter &out) const;
+	/**
+ 	 * \brief Check if emit_entries() streams any entry.
+ 	 *
+ 	 * emit() returns a null node for tasks without entries, which emit_stream() reproduces.
+ 	 */
+	virtual bool has_entries() const;
+	/**
+ 	 * \brief Serialize this Task to a buffer in the binary format using append_entries().
+ 	 */
+	void emit_binary(std::string &buffer) const override;
+	/**
+ 	 * \brief Deserialize this Task from the binary format.
+ 	 */
+	void load_binary(fast::binary::Reader &in) override;
+	/**
+ 	 * \brief Append the entries of this Task to the enclosing mapping in the binary format in the order of emit().
+ 	 *
+ 	 * Derived tasks override this along with emit_entries(). Used by Task_container to merge the entries of a task.
+ 	 * \return The number of appended entries.
+ 	 */
+	virtual std::size_t append_entries(std::string &buffer) const;
+	/**
+ 	 * \brief Read an entry of the enclosing mapping in the binary format if it is an entry of Task.
+ 	 *
+ 	 * Used by load_binary() of derived tasks.
+ 	 * \return True if the value was read.
+ 	 */
+	bool load_entry(fast::binary::Reader &in, const char *key, std::size_t size);
 
 	/**
  	 * \brief Flag to enable threaded rather than serial execution of this task by the Migration Framework.
  	 */
-	Optional<bool> concurrent_execution;
+	Inline_optional<bool, tags::concurrent_execution> concurrent_execution;
 	/**
  	 * \brief Enables time measurement in the Migration Framework.
  	 */
-	Optional<bool> time_measurement;
+	Inline_optional<bool, tags::time_measurement> time_measurement;
 	/**
  	 * \brief Denotes the driver of the Hypervisor to be used (e.g. "qemu", "lxctools" for libvirt)
  	 */
-	Optional<std::string> driver;
+	Inline_optional<std::string, tags::driver> driver;
 };
 
 /**
@@ -107,6 +183,18 @@ struct Task_container :
  	 * \brief Initialize tasks from YAML.
  	 */
 	void load(const YAML::Node &node) override;
+	/**
+ 	 * \brief Serialize all Tasks to a YAML emitter.
+ 	 */
+	void emit_stream(YAML::Emitter &out) const override;
+	/**
+ 	 * \brief Serialize all Tasks to a buffer in the binary format.
+ 	 */
+	void emit_binary(std::string &buffer) const override;
+	/**
+ 	 * \brief Initialize tasks from the binary format.
+ 	 */
+	void load_binary(fast::binary::Reader &in) override;
 
 	/**
  	 * \brief vector of tasks.
@@ -115,11 +203,18 @@ struct Task_container :
 	/**
  	 * \brief Denotes the execution of tasks in separate threads rather than sequential execution.
  	 */
-	Optional<bool> concurrent_execution;
+	Inline_optional<bool, tags::concurrent_execution> concurrent_execution;
 	/**
  	 * \brief The id may be used to track tasks/messages.
  	 */
-	Optional<std::string> id;
+	Inline_optional<std::string, tags::id> id;
+	/**
+ 	 * \brief Options to emit and load long lists of tasks on several threads.
+ 	 *
+ 	 * Used by load(), emit(), emit_binary() and load_binary(), while emit_stream() stays sequential.
+ 	 * Not serialized. Sequential by default.
+ 	 */
+	fast::Parallel_options parallel;
 
 	/**
 	 * \brief Get readable type of tasks.
@@ -128,6 +223,31 @@ struct Task_container :
 	 * \param enable_result_format Set to true if type should be stored in Result, else Task format is used.
 	 */
 	std::string type(bool enable_result_format = false) const;
+
+	/**
+	 * \brief The top level entries of a Task_container, which identify it without its tasks.
+	 */
+	struct Header
+	{
+		/**
+		 * \brief The type of the tasks, e.g., "start vm".
+		 */
+		std::string task;
+		/**
+		 * \brief The id of the Task_container if present.
+		 */
+		Inline_optional<std::string, tags::id> id;
+	};
+
+	/**
+	 * \brief Read the header of a serialized Task_container without loading its tasks.
+	 *
+	 * Scans the raw YAML or binary message with fast::peek_scalar() and stops at the requested keys,
+	 * so messages can be routed, deduplicated or rejected before paying for from_string().
+	 * Throws no_task_exception if the message has no task.
+	 * \param str The serialized Task_container.
+	 */
+	static Header peek_header(const std::string &str);
 };
 
 /**
@@ -160,30 +280,46 @@ struct Start :
 	Start(std::string xml, std::vector<PCI_id> pci_ids, std::vector<PCI_addr> pci_addrs, bool concurrent_execution);
 
 	/**
- 	 * \brief Serialize Start task to YAML.
+ 	 * \brief Add the entries of Start task to a YAML node.
  	 */
-	YAML::Node emit() const override;
+	void emit_into(YAML::Node &node) const override;
 	/**
  	 * \brief Initialize Start task from YAML.
  	 */
 	void load(const YAML::Node &node) override;
+	/**
+ 	 * \brief Stream the entries of Start task to YAML.
+ 	 */
+	void emit_entries(YAML::Emitter &out) const override;
+	/**
+ 	 * \brief Check if Start task has any entry to stream.
+ 	 */
+	bool has_entries() const override;
+	/**
+ 	 * \brief Append the entries of Start task in the binary format.
+ 	 */
+	std::size_t append_entries(std::string &buffer) const override;
+	/**
+ 	 * \brief Initialize Start task from the binary format.
+ 	 */
+	void load_binary(fast::binary::Reader &in) override;
 
 	/**
  	 * \brief Name of the domain.
  	 */
-	Optional<std::string> vm_name;
+	Inline_optional<std::string, tags::vm_name> vm_name;
 	/**
  	 * \brief Number of CPUs assigned to the domain.
  	 */
-	Optional<unsigned int> vcpus;
+	Inline_optional<unsigned int, tags::vcpus> vcpus;
 	/**
  	 * \brief Amount of memory assigned to the domain in MiB.
  	 */
-	Optional<unsigned long> memory;
+	Inline_optional<unsigned long, tags::memory> memory;
 	/**
  	 * \brief Used by ponci hypervisor.
  	 */
-	Optional<std::vector<std::vector<unsigned int>>> memnode_map;
+	Inline_optional<std::vector<std::vector<unsigned int>>, tags::memnode_map> memnode_map;
 	/**
 	 * \brief A vector of PCI IDs for which devices should be searched and attached.
 	 */
@@ -195,27 +331,27 @@ struct Start :
 	/**
 	 * \brief Description of the domain using XML.
 	 */
-	Optional<std::string> xml;
+	Inline_optional<std::string, tags::xml> xml;
 	/**
  	 * \brief ivshmem device to assign to the domain.
  	 */
-	Optional<Device_ivshmem> ivshmem;
+	Inline_optional<Device_ivshmem, tags::ivshmem> ivshmem;
 	/**
  	 * \brief Create a transient domain which ceases to exist after shutdown.
  	 */
-	Optional<bool> transient;
+	Inline_optional<bool, tags::transient> transient;
 	/**
  	 * \brief Map of how vcpus are assigned to physical cpus.
  	 */
-	Optional<std::vector<std::vector<unsigned int>>> vcpu_map;
+	Inline_optional<std::vector<std::vector<unsigned int>>, tags::vcpu_map> vcpu_map;
 	/**
  	 * \brief Enable to test if the domain finished starting by probing via ssh.
  	 */
-	Optional<bool> probe_with_ssh;
+	Inline_optional<bool, tags::probe_with_ssh> probe_with_ssh;
 	/**
  	 * \brief Used to provide a hostname to probe an ssh connection after startup.
  	 */
-	Optional<std::string> probe_hostname;
+	Inline_optional<std::string, tags::probe_hostname> probe_hostname;
 };
 
 /**
@@ -239,30 +375,46 @@ struct Stop :
 	Stop(std::string vm_name, bool force, bool undefine, bool concurrent_execution);
 
 	/**
- 	 * \brief Serialize Stop task to YAML.
+ 	 * \brief Add the entries of Stop task to a YAML node.
  	 */
-	YAML::Node emit() const override;
+	void emit_into(YAML::Node &node) const override;
 	/**
  	 * \brief Initialize Stop task from YAML.
  	 */
 	void load(const YAML::Node &node) override;
+	/**
+ 	 * \brief Stream the entries of Stop task to YAML.
+ 	 */
+	void emit_entries(YAML::Emitter &out) const override;
+	/**
+ 	 * \brief Check if Stop task has any entry to stream.
+ 	 */
+	bool has_entries() const override;
+	/**
+ 	 * \brief Append the entries of Stop task in the binary format.
+ 	 */
+	std::size_t append_entries(std::string &buffer) const override;
+	/**
+ 	 * \brief Initialize Stop task from the binary format.
+ 	 */
+	void load_binary(fast::binary::Reader &in) override;
 
 	/**
  	 * \brief Name of the domain.
  	 */
-	Optional<std::string> vm_name;
+	Inline_optional<std::string, tags::vm_name> vm_name;
 	/**
  	 * \brief Used to stop all domains which names are matched by the regex.
  	 */
-	Optional<std::string> regex;
+	Inline_optional<std::string, tags::regex> regex;
 	/**
  	 * \brief Forced shutdown of domain.
  	 */
-	Optional<bool> force;
+	Inline_optional<bool, tags::force> force;
 	/**
  	 * \brief Undefine domain after shutdown.
  	 */
-	Optional<bool> undefine;
+	Inline_optional<bool, tags::undefine> undefine;
 };
 
 /**
@@ -284,6 +436,18 @@ struct Swap_with :
  	 * \brief Initialize Swap_with object from YAML.
  	 */
 	void load(const YAML::Node &node) override;
+	/**
+ 	 * \brief Serialize Swap_with object to a YAML emitter.
+ 	 */
+	void emit_stream(YAML::Emitter &out) const override;
+	/**
+ 	 * \brief Serialize Swap_with object to a buffer in the binary format.
+ 	 */
+	void emit_binary(std::string &buffer) const override;
+	/**
+ 	 * \brief Initialize Swap_with object from the binary format.
+ 	 */
+	void load_binary(fast::binary::Reader &in) override;
 
 	/**
  	 * \brief Name of the domain to swap with.
@@ -292,11 +456,11 @@ struct Swap_with :
 	/**
  	 * \brief Number of pscom processes to suspend.
  	 */
-	Optional<std::string> pscom_hook_procs;
+	Inline_optional<std::string, tags::pscom_hook_procs> pscom_hook_procs;
 	/**
  	 * \brief Map of how vcpus are assigned to physical cpus.
  	 */
-	Optional<std::vector<std::vector<unsigned int>>> vcpu_map;
+	Inline_optional<std::vector<std::vector<unsigned int>>, tags::vcpu_map> vcpu_map;
 };
 
 
@@ -336,13 +500,29 @@ struct Migrate :
 	Migrate(std::string vm_name, std::string dest_hostname, std::string migration_type, bool rdma_migration, bool concurrent_execution, std::string pscom_hook_procs, bool time_measurement);
 
 	/**
- 	 * \brief Serialize Migrate task to YAML.
+ 	 * \brief Add the entries of Migrate task to a YAML node.
  	 */
-	YAML::Node emit() const override;
+	void emit_into(YAML::Node &node) const override;
 	/**
  	 * \brief Initialize Migrate task from YAML.
  	 */
 	void load(const YAML::Node &node) override;
+	/**
+ 	 * \brief Stream the entries of Migrate task to YAML.
+ 	 */
+	void emit_entries(YAML::Emitter &out) const override;
+	/**
+ 	 * \brief Check if Migrate task has any entry to stream.
+ 	 */
+	bool has_entries() const override;
+	/**
+ 	 * \brief Append the entries of Migrate task in the binary format.
+ 	 */
+	std::size_t append_entries(std::string &buffer) const override;
+	/**
+ 	 * \brief Initialize Migrate task from the binary format.
+ 	 */
+	void load_binary(fast::binary::Reader &in) override;
 
 	/**
  	 * \brief Name of the domain to Migrate.
@@ -355,31 +535,31 @@ struct Migrate :
 	/**
  	 * \brief Number of times migration should be retried on failure.
  	 */
-	Optional<unsigned int> retry_counter;
+	Inline_optional<unsigned int, tags::retry_counter> retry_counter;
 	/**
  	 * \brief Type of migration (e.g. cold/warm/live)
  	 */
-	Optional<std::string> migration_type;
+	Inline_optional<std::string, tags::migration_type> migration_type;
 	/**
  	 * \brief Enable migration via RDMA.
  	 */
-	Optional<bool> rdma_migration;
+	Inline_optional<bool, tags::rdma_migration> rdma_migration;
 	/**
  	 * \brief Number of pscom processes to suspend during migration.
  	 */
-	Optional<std::string> pscom_hook_procs;
+	Inline_optional<std::string, tags::pscom_hook_procs> pscom_hook_procs;
 	/**
  	 * \brief Type of transport (e.g. ssh or tcp).
  	 */
-	Optional<std::string> transport;
+	Inline_optional<std::string, tags::transport> transport;
 	/**
  	 * \brief Swap with domain on destination.
  	 */
-	Optional<Swap_with> swap_with;
+	Inline_optional<Swap_with, tags::swap_with> swap_with;
 	/**
  	 * \brief Map of how vcpus are assigned to physical cpus on destination.
  	 */
-	Optional<std::vector<std::vector<unsigned int>>> vcpu_map;
+	Inline_optional<std::vector<std::vector<unsigned int>>, tags::vcpu_map> vcpu_map;
 };
 
 /**
@@ -406,8 +586,12 @@ struct Evacuate :
 	 */
 	Evacuate(std::vector<std::string> destinations, std::string mode, bool overbooking, std::string migration_type, bool rdma_migration, bool concurrent_execution, std::string pscom_hook_procs, bool time_measurement);
 
-	YAML::Node emit() const override;
+	void emit_into(YAML::Node &node) const override;
 	void load(const YAML::Node &node) override;
+	void emit_entries(YAML::Emitter &out) const override;
+	bool has_entries() const override;
+	std::size_t append_entries(std::string &buffer) const override;
+	void load_binary(fast::binary::Reader &in) override;
 
 	/**
 	 * \brief List of hosts to migrate to.
@@ -416,36 +600,36 @@ struct Evacuate :
 	/**
  	 * \brief Evacuation mode (auto/compact/scatter).
  	 */
-	Optional<std::string> mode;
+	Inline_optional<std::string, tags::mode> mode;
 	/**
 	 * \brief Allows overbooking of destination nodes.
 	 */
-	Optional<bool> overbooking;
+	Inline_optional<bool, tags::overbooking> overbooking;
 	/**
  	 * \brief Number of retry attempts on failure.
  	 */
-	Optional<unsigned int> retry_counter;
+	Inline_optional<unsigned int, tags::retry_counter> retry_counter;
 	/**
 	 * \brief Option to enable live migration.
 	 */
-	Optional<std::string> migration_type;
+	Inline_optional<std::string, tags::migration_type> migration_type;
 	/**
 	 * \brief Option to enable rdma migration.
 	 */
-	Optional<bool> rdma_migration;
+	Inline_optional<bool, tags::rdma_migration> rdma_migration;
 	/**
 	 * \brief Number of processes to suspend during migration as string or "auto" for auto detection.
 	 */
-	Optional<std::string> pscom_hook_procs;
+	Inline_optional<std::string, tags::pscom_hook_procs> pscom_hook_procs;
 	/**
  	 * \brief Type of transport (e.g. ssh or tcp).
  	 */
-	Optional<std::string> transport;
+	Inline_optional<std::string, tags::transport> transport;
 
 	/**
  	 * \brief Used internally by migration framework
  	 */
-	Optional<std::string> vm_name;
+	Inline_optional<std::string, tags::vm_name> vm_name;
 };
 
 /**
@@ -464,13 +648,29 @@ struct Repin :
 	Repin(std::string vm_name, std::vector<std::vector<unsigned int>> vcpu_map, bool concurrent_execution = true);
 
 	/**
- 	 * \brief Serialize Repin task to YAML.
+ 	 * \brief Add the entries of Repin task to a YAML node.
  	 */
-	YAML::Node emit() const override;
+	void emit_into(YAML::Node &node) const override;
 	/**
  	 * \brief Initialize Repin task from YAML.
  	 */
 	void load(const YAML::Node &node) override;
+	/**
+ 	 * \brief Stream the entries of Repin task to YAML.
+ 	 */
+	void emit_entries(YAML::Emitter &out) const override;
+	/**
+ 	 * \brief Check if Repin task has any entry to stream.
+ 	 */
+	bool has_entries() const override;
+	/**
+ 	 * \brief Append the entries of Repin task in the binary format.
+ 	 */
+	std::size_t append_entries(std::string &buffer) const override;
+	/**
+ 	 * \brief Initialize Repin task from the binary format.
+ 	 */
+	void load_binary(fast::binary::Reader &in) override;
 
 	/**
  	 * \brief Name of the domain to repin.
@@ -501,13 +701,29 @@ struct Suspend :
 	Suspend(std::string vm_name, bool concurrent_execution);
 
 	/**
- 	 * \brief Serialize Suspend task to YAML.
+ 	 * \brief Add the entries of Suspend task to a YAML node.
  	 */
-	YAML::Node emit() const override;
+	void emit_into(YAML::Node &node) const override;
 	/**
  	 * \brief Initialize Suspend task from YAML.
  	 */
 	void load(const YAML::Node &node) override;
+	/**
+ 	 * \brief Stream the entries of Suspend task to YAML.
+ 	 */
+	void emit_entries(YAML::Emitter &out) const override;
+	/**
+ 	 * \brief Check if Suspend task has any entry to stream.
+ 	 */
+	bool has_entries() const override;
+	/**
+ 	 * \brief Append the entries of Suspend task in the binary format.
+ 	 */
+	std::size_t append_entries(std::string &buffer) const override;
+	/**
+ 	 * \brief Initialize Suspend task from the binary format.
+ 	 */
+	void load_binary(fast::binary::Reader &in) override;
 
 	/**
  	 * \brief Name of the domain to suspend.
@@ -534,13 +750,29 @@ struct Resume :
 	Resume(std::string vm_name, bool concurrent_execution);
 
 	/**
- 	 * \brief Serialize Resume task to YAML.
+ 	 * \brief Add the entries of Resume task to a YAML node.
  	 */
-	YAML::Node emit() const override;
+	void emit_into(YAML::Node &node) const override;
 	/**
  	 * \brief Initialize Resume task from YAML.
  	 */
 	void load(const YAML::Node &node) override;
+	/**
+ 	 * \brief Stream the entries of Resume task to YAML.
+ 	 */
+	void emit_entries(YAML::Emitter &out) const override;
+	/**
+ 	 * \brief Check if Resume task has any entry to stream.
+ 	 */
+	bool has_entries() const override;
+	/**
+ 	 * \brief Append the entries of Resume task in the binary format.
+ 	 */
+	std::size_t append_entries(std::string &buffer) const override;
+	/**
+ 	 * \brief Initialize Resume task from the binary format.
+ 	 */
+	void load_binary(fast::binary::Reader &in) override;
 
 	/**
  	 * \brief Name of the domain to resume.
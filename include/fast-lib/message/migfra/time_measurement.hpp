@@ -62,6 +62,7 @@ public:
 
 	YAML::Node emit() const override;
 	void load(const YAML::Node &node) override;
+	void emit_binary(std::string &buffer) const override;
 private:
 	bool enabled;
 	std::unordered_map<std::string, Timer> timers;
@@ -0,0 +1,90 @@
+/*
+ * This file is part of fast-lib.
+ * Copyright (C) 2015 RWTH Aachen University - ACS
+ *
+ * This file is licensed under the GNU Lesser General Public License Version 3
+ * Version 3, 29 June 2007. For details see 'LICENSE.md' in the root directory.
+ */
+
+#ifndef FAST_LIB_MESSAGE_ROUTER_HPP
+#define FAST_LIB_MESSAGE_ROUTER_HPP
+
+#include <fast-lib/mqtt_communicator.hpp>
+#include <fast-lib/serializable.hpp>
+
+#include <functional>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+
+namespace fast {
+
+/**
+ * \brief Dispatches received messages to typed handlers by topic filter and task.
+ *
+ * Messages are parsed once, in YAML or the binary format. The value of the top level key "task" (e.g. "init agent" or
+ * "start vm") selects the handler, which is looked up in a hash table per topic filter.
+ * The handler gets the message loaded from the parsed YAML into its type.
+ * Handlers must be added before messages are routed, as routing does not lock.
+ */
+class Message_router
+{
+public:
+	/**
+	 * \brief A handler getting the parsed message.
+	 */
+	using node_handler_t = std::function<void(const YAML::Node &)>;
+
+	/**
+	 * \brief Add a handler for messages of type T.
+	 *
+	 * Replaces the handler previously added for the same topic filter and task.
+	 * \param topic_filter The topic filter of the subscription the messages are received on.
+	 * \param task The value of the key "task" of the messages. Empty for messages without task.
+	 * \param handler The function called with the loaded message.
+	 */
+	template<class T> void add_handler(const std::string &topic_filter, const std::string &task, std::function<void(T &)> handler)
+	{
+		static_assert(std::is_base_of<Serializable, T>::value, "T is not derived from fast::Serializable");
+		add_node_handler(topic_filter, task, [handler](const YAML::Node &node) {
+			T msg;
+			msg.load(node);
+			handler(msg);
+		});
+	}
+
+	/**
+	 * \brief Add a handler getting the parsed message.
+	 *
+	 * Replaces the handler previously added for the same topic filter and task.
+	 * \param topic_filter The topic filter of the subscription the messages are received on.
+	 * \param task The value of the key "task" of the messages. Empty for messages without task.
+	 * \param handler The function called with the parsed message.
+	 */
+	void add_node_handler(const std::string &topic_filter, const std::string &task, node_handler_t handler);
+
+	/**
+	 * \brief Route a message to its handler.
+	 *
+	 * Throws if the message cannot be parsed or loaded and rethrows exceptions of the handler.
+	 * \param topic_filter The topic filter of the subscription the message was received on.
+	 * \param message The received message.
+	 * \return False if there is no handler for the topic filter and task of the message.
+	 */
+	bool route(const std::string &topic_filter, const std::string &message) const;
+
+	/**
+	 * \brief Subscribe to all topic filters with handlers and route the received messages.
+	 *
+	 * Messages without handler and errors are logged. The router must outlive the subscriptions.
+	 * \param comm The communicator to add the subscriptions to.
+	 * \param qos The quality of service of the subscriptions. -1 uses the topic policies.
+	 */
+	void subscribe(const MQTT_communicator &comm, int qos = -1) const;
+private:
+	std::unordered_map<std::string, std::unordered_map<std::string, node_handler_t>> handlers;
+};
+
+} // namespace fast
+
+#endif
@@ -10,19 +10,269 @@
 #define FAST_LIB_MQTT_COMMUNICATOR_HPP
 
 #include <fast-lib/communicator.hpp>
+#include <fast-lib/serializable.hpp>
 
 #include <mosquittopp.h>
 
+#include <array>
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <mutex>
 #include <string>
+#include <thread>
 #include <unordered_map>
+#include <vector>
 
 namespace fast {
 
+/**
+ * \brief The address of a MQTT broker.
+ */
+struct Broker_endpoint
+{
+	/**
+	 * \brief The host the broker runs on.
+	 */
+	std::string host;
+	/**
+	 * \brief The port the broker listens on.
+	 */
+	int port;
+};
+
+/**
+ * \brief The health of a broker as determined by probing.
+ *
+ * Used internally to select the broker to fail over to.
+ */
+struct Broker_health
+{
+	/**
+	 * \brief This flag states, if the last probe succeeded.
+	 */
+	bool reachable;
+	/**
+	 * \brief The time the last successful probe took to open a TCP connection.
+	 */
+	std::chrono::microseconds rtt;
+};
+
+/**
+ * \brief The round trip latency of messages through the broker as measured by the latency probe.
+ *
+ * See MQTT_communicator::set_latency_probe().
+ */
+struct Broker_latency
+{
+	/**
+	 * \brief The number of round trips in the window of recent round trips.
+	 */
+	std::size_t samples;
+	/**
+	 * \brief The most recent round trip time.
+	 */
+	std::chrono::microseconds last;
+	/**
+	 * \brief The median of the round trip times in the window.
+	 */
+	std::chrono::microseconds median;
+	/**
+	 * \brief The 99th percentile of the round trip times in the window.
+	 */
+	std::chrono::microseconds p99;
+	/**
+	 * \brief The maximum of the round trip times in the window.
+	 */
+	std::chrono::microseconds max;
+	/**
+	 * \brief The number of round trips in the window per bucket.
+	 *
+	 * Bucket i counts round trips taking [2^i, 2^(i+1)) microseconds, bucket 0 includes faster ones.
+	 */
+	std::array<std::uint32_t, 32> histogram;
+	/**
+	 * \brief This flag states, if no probe returned within the staleness timeout.
+	 */
+	bool stale;
+};
+
+/**
+ * \brief Settings of the threads and socket trading CPU time for latency and placing the threads.
+ *
+ * See MQTT_communicator::set_transport_options().
+ */
+struct Transport_options
+{
+	/**
+	 * \brief This flag states, if the network thread spins instead of blocking until the socket is ready.
+	 *
+	 * Saves the wake up latency at the cost of keeping a core busy, so it should be combined with network_cpu.
+	 */
+	bool busy_poll = false;
+	/**
+	 * \brief The CPU to pin the network thread to, -1 for no pinning.
+	 */
+	int network_cpu = -1;
+	/**
+	 * \brief The CPUs to pin all threads of the communicator to, empty for no pinning.
+	 *
+	 * Applies to the network thread unless network_cpu is set, the thread sending held back
+	 * messages, the probe threads and the dispatch threads of subscriptions in deferred mode.
+	 * Keeps the communication off CPUs reserved for other work, e.g., pinned VMs. Pinning alone does
+	 * not place the queue memory, as held back and posted messages are allocated by the sending
+	 * threads. Set bind_memory to place it on the NUMA nodes of these CPUs.
+	 */
+	std::vector<int> thread_cpus;
+	/**
+	 * \brief This flag states, if the queue memory is bound to the NUMA nodes of thread_cpus, or of network_cpu if thread_cpus is empty.
+	 *
+	 * Applies to the queues of held back and posted messages including their payloads and to the
+	 * message queues of subscriptions, no matter which thread allocates them. Memory allocated from
+	 * then on is taken from the nodes and memory bound before, e.g., to other CPUs, is moved. Received
+	 * payloads are allocated by the pinned network thread. Set the option before posting messages,
+	 * as the queues of posting threads are allocated once.
+	 * Requires fast-lib to be built with libnuma, see memory_binding_available().
+	 */
+	bool bind_memory = false;
+	/**
+	 * \brief This flag states, if small packets are sent immediately (TCP_NODELAY).
+	 */
+	bool tcp_nodelay = false;
+	/**
+	 * \brief The size of the socket send buffer in bytes (SO_SNDBUF), 0 for the system default.
+	 */
+	int send_buffer_size = 0;
+	/**
+	 * \brief The size of the socket receive buffer in bytes (SO_RCVBUF), 0 for the system default.
+	 */
+	int receive_buffer_size = 0;
+	/**
+	 * \brief The time in microseconds the kernel busy polls the device for incoming packets (SO_BUSY_POLL), 0 to disable.
+	 */
+	int socket_busy_poll = 0;
+};
+
+/**
+ * \brief The priority of messages.
+ *
+ * Messages with higher priority are delivered and sent before messages with lower priority.
+ */
+enum class Priority
+{
+	by_policy = -1, ///< Use the priority of the topic policy.
+	low,
+	normal,
+	high
+};
+
+/**
+ * \brief The way callbacks of subscriptions are called.
+ */
+enum class Dispatch_mode
+{
+	direct, ///< Call the callback in the network thread as soon as a message arrives.
+	deferred ///< Queue messages and call the callback in a thread of the subscription, so slow callbacks do not stall receiving.
+};
+
+/**
+ * \brief Algorithms to compress the payload of sent messages.
+ */
+enum class Compression
+{
+	none,
+	lz4, ///< Fast compression, available if fast-lib is built with liblz4.
+	zlib ///< Available if fast-lib is built with zlib.
+};
+
+/**
+ * \brief The settings applied to messages of topics matching a topic filter.
+ *
+ * See MQTT_communicator::set_topic_policy().
+ */
+struct Topic_policy
+{
+	/**
+	 * \brief The quality of service (0|1|2 - see mosquitto documentation for further information)
+	 */
+	int qos = 2;
+	/**
+	 * \brief This flag states, if the broker retains sent messages for future subscribers.
+	 */
+	bool retain = false;
+	/**
+	 * \brief The maximum number of messages queued per subscription, 0 for no limit.
+	 *
+	 * If the limit is reached, a message with a higher priority than the lowest queued one replaces
+	 * the oldest message with the lowest priority. Other messages are dropped on arrival.
+	 */
+	std::size_t queue_bound = 0;
+	/**
+	 * \brief The way callbacks of subscriptions are called.
+	 */
+	Dispatch_mode dispatch = Dispatch_mode::direct;
+	/**
+	 * \brief The priority of sent and received messages.
+	 */
+	Priority priority = Priority::normal;
+	/**
+	 * \brief The maximum number of sent messages packed into one payload, 0 or 1 to disable batching.
+	 *
+	 * Batches are split by receiving MQTT_communicators, so subscriptions get the messages one by one.
+	 * Batching trades latency for throughput of small messages, as it saves the MQTT framing,
+	 * routing by the broker and wakeups of the receiver per message. Messages which are sent in
+	 * chunks are not batched and batches are sent before they need to be sent in chunks.
+	 */
+	std::size_t batch_size = 0;
+	/**
+	 * \brief The maximum time the first message of a batch waits for the batch to fill up.
+	 *
+	 * This bounds the latency added by batching.
+	 */
+	std::chrono::microseconds batch_delay = std::chrono::microseconds(1000);
+	/**
+	 * \brief The algorithm to compress sent messages with.
+	 *
+	 * Compressed messages are decompressed by receiving MQTT_communicators, so subscriptions get
+	 * the original message. Messages are sent uncompressed if compression does not reduce their size.
+	 */
+	Compression compression = Compression::none;
+	/**
+	 * \brief The minimum size of messages to compress in bytes.
+	 */
+	std::size_t compression_threshold = 1024;
+};
+
+/**
+ * \brief Statistics of a subscription.
+ */
+struct Subscription_stats
+{
+	/**
+	 * \brief The number of messages received on the subscription.
+	 */
+	std::uint64_t received;
+	/**
+	 * \brief The number of received messages discarded because they expired.
+	 */
+	std::uint64_t expired;
+	/**
+	 * \brief The number of received messages discarded because they were duplicates.
+	 */
+	std::uint64_t duplicates;
+	/**
+	 * \brief The number of received messages dropped because the queue bound was reached.
+	 */
+	std::uint64_t dropped;
+	/**
+	 * \brief The number of received messages discarded by the filter of the subscription.
+	 */
+	std::uint64_t filtered;
+};
+
 /**
  * \brief A handler for subscriptions.
  *
@@ -30,6 +280,75 @@ namespace fast {
  */
 class MQTT_subscription;
 
+/**
+ * \brief A queue for outgoing messages with one lane per priority.
+ *
+ * Used internally to hold back lower priority messages while mosquitto is busy sending.
+ */
+class MQTT_outbound_queue;
+
+/**
+ * \brief A store for chunks of messages which are not yet complete.
+ *
+ * Used internally to reassemble chunked messages.
+ */
+class MQTT_reassembly;
+
+/**
+ * \brief The state of the latency probe.
+ *
+ * Used internally to measure the round trip latency through the broker.
+ */
+class MQTT_latency_probe;
+
+/**
+ * \brief A handle to a subscription as returned by MQTT_communicator::add_subscription().
+ *
+ * The handle shares ownership of the subscription. Receiving messages and getting statistics
+ * through the handle neither looks up the topic nor locks the subscriptions of the communicator,
+ * so it is the preferred way for tight consumer loops.
+ * After the subscription is removed the handle stays valid, but receives no new messages.
+ * Copies of a handle refer to the same subscription. A default constructed handle is empty.
+ */
+class Subscription_handle
+{
+public:
+	Subscription_handle() = default;
+
+	/**
+	 * \brief Get a message of the subscription.
+	 *
+	 * Behaves like MQTT_communicator::get_message(), except that the connection is not checked.
+	 * Subscriptions with a callback can not be used to get messages.
+	 * \param duration The duration until a timeout exception is thrown. The max() value means no timeout.
+	 * \param actual_topic Returns the topic the message was actually published on.
+	 */
+	std::string get_message(const std::chrono::duration<double> &duration = std::chrono::duration<double>::max(),
+				std::string *actual_topic = nullptr) const;
+
+	/**
+	 * \brief Get statistics about received, dropped and filtered messages of the subscription.
+	 */
+	Subscription_stats get_stats() const;
+
+	/**
+	 * \brief Get the topic the subscription is listening on.
+	 */
+	const std::string & get_topic() const;
+
+	/**
+	 * \brief Check if the handle refers to a subscription.
+	 */
+	explicit operator bool() const;
+private:
+	friend class MQTT_communicator;
+
+	Subscription_handle(std::string topic, std::shared_ptr<MQTT_subscription> subscription);
+
+	std::string topic;
+	std::shared_ptr<MQTT_subscription> subscription;
+};
+
 /**
  * \brief A specialized Communicator to provide communication using the MQTT framework mosquitto.
  *
@@ -116,21 +435,33 @@ public:
 	 *
 	 * Adds a subscription on a topic. The messages can be retrieved by calling get_message().
 	 * Messages are queued seperate per topic. Therefore multiple topics can be subscribed simultaneously.
+	 * Within a subscription messages are queued per priority and get_message() returns messages with
+	 * higher priority first. A message gets the highest priority of all subscriptions matching its topic.
+	 * QoS, priority and queue bound are taken from the topic policy (see set_topic_policy()), unless
+	 * passed explicitly.
+	 * If there already is a subscription on topic, it is kept and a handle to it is returned.
 	 * \param topic The topic to listen on.
-	 * \param qos The quality of service (0|1|2 - see mosquitto documentation for further information)
+	 * \param qos The quality of service (0|1|2 - see mosquitto documentation for further information). -1 uses the topic policy.
+	 * \param priority The priority of messages received on this subscription.
+	 * \return A handle to get messages and statistics without looking up the topic.
 	 */
-	void add_subscription(const std::string &topic, int qos = 2) const;
+	Subscription_handle add_subscription(const std::string &topic, int qos = -1, Priority priority = Priority::by_policy) const;
 
 	/**
 	 * \brief Add a subscription with a callback to retrieve messages.
 	 *
 	 * Adds a subscription on a topic. On each message that arrives the callback is called with the payload
 	 * string as parameter. All exceptions derived from std::exception are caught if thrown by callback.
+	 * If a message matches several subscriptions, callbacks of subscriptions with higher priority are called first.
+	 * QoS, priority, queue bound and dispatch mode are taken from the topic policy (see set_topic_policy()),
+	 * unless passed explicitly.
 	 * \param topic The topic to listen on.
 	 * \param callback The function to call when a new message arrives on topic.
-	 * \param qos The quality of service (see mosquitto documentation for further information)
+	 * \param qos The quality of service (see mosquitto documentation for further information). -1 uses the topic policy.
+	 * \param priority The priority of messages received on this subscription.
+	 * \return A handle to get statistics without looking up the topic.
 	 */
-	void add_subscription(const std::string &topic, std::function<void(std::string)> callback, int qos = 2) const;
+	Subscription_handle add_subscription(const std::string &topic, std::function<void(std::string)> callback, int qos = -1, Priority priority = Priority::by_policy) const;
 
 	/**
 	 * \brief Remove a subscription.
@@ -139,10 +470,140 @@ public:
 	 */
 	void remove_subscription(const std::string &topic) const;
 
+	/**
+	 * \brief Remove the subscription a handle refers to.
+	 *
+	 * Does nothing if the subscription has already been removed or replaced.
+	 * \param handle The handle returned by add_subscription().
+	 */
+	void remove_subscription(const Subscription_handle &handle) const;
+
+	/**
+	 * \brief Set the policy for topics matching a topic filter.
+	 *
+	 * The policy provides QoS, retain flag and priority of sent messages as well as QoS, priority,
+	 * queue bound and dispatch mode of subscriptions, wherever they are not passed explicitly.
+	 * If several topic filters match, the longest one is used. Topics without matching filter
+	 * use a default constructed Topic_policy. The policy of a topic is resolved once and cached.
+	 * Subscriptions use the policy in effect when they are added.
+	 * \param topic_filter The topic filter, which may contain the wildcards "+" and "#".
+	 * \param policy The policy for matching topics.
+	 */
+	void set_topic_policy(const std::string &topic_filter, const Topic_policy &policy) const;
+
+	/**
+	 * \brief Continuously measure the round trip latency of messages through the broker.
+	 *
+	 * A thread publishes a tiny ping with QoS 0 every interval on a topic private to this
+	 * communicator and measures the time until the broker delivers it back. The latency of
+	 * recent pings is queryable without locks by get_broker_latency().
+	 * \param interval The time between two pings. Zero disables the probe.
+	 * \param stale_after The time after which the latency is stale if no ping returned.
+	 */
+	void set_latency_probe(const timeout_duration_t &interval,
+			       const timeout_duration_t &stale_after = std::chrono::seconds(5)) const;
+
+	/**
+	 * \brief Get the round trip latency through the broker measured by the latency probe.
+	 *
+	 * Does not lock, so it may be called on latency sensitive paths.
+	 */
+	Broker_latency get_broker_latency() const;
+
+	/**
+	 * \brief Check if the latency probe got no ping back within the staleness timeout.
+	 *
+	 * Returns false if the probe is disabled.
+	 */
+	bool is_broker_latency_stale() const;
+
+	/**
+	 * \brief Check if fast-lib is built with support for a compression algorithm.
+	 */
+	static bool compression_available(Compression compression);
+
+	/**
+	 * \brief Check if queue memory can be bound to NUMA nodes, i.e., fast-lib is built with libnuma and the system supports NUMA.
+	 */
+	static bool memory_binding_available();
+
+	/**
+	 * \brief Get the policy in effect for a topic.
+	 *
+	 * \param topic The topic or subscription topic filter.
+	 */
+	Topic_policy get_topic_policy(const std::string &topic) const;
+
+	/**
+	 * \brief Set the time to live of messages received on a subscription.
+	 *
+	 * Messages which are not retrieved within ttl after their arrival are discarded unprocessed
+	 * and counted as expired. Messages carrying an expiry (see send_message()) are discarded
+	 * when it is reached, independent of the time to live of the subscription.
+	 * Throws std::out_of_range if the topic is not subscribed.
+	 * \param topic The topic the subscription is listening on.
+	 * \param ttl The time to live. timeout_duration_t::max() is reserved for no expiry (default).
+	 */
+	void set_subscription_ttl(const std::string &topic, const timeout_duration_t &ttl) const;
+
+	/**
+	 * \brief Type of functions extracting the key identifying a message.
+	 *
+	 * An empty key marks a message which is never treated as duplicate.
+	 */
+	using message_key_function_t = std::function<std::string(const std::string &)>;
+
+	/**
+	 * \brief Drop duplicate messages received on a subscription.
+	 *
+	 * QoS 1 and failover may deliver a message more than once. Messages whose key was already
+	 * seen within window are discarded before they reach the application and counted as duplicates.
+	 * The key should be extracted cheaply, e.g., using fast::peek_scalar() to read the id of
+	 * a Task_container without parsing the message.
+	 * The seen keys are bounded by capacity, evicting the oldest keys first.
+	 * Throws std::out_of_range if the topic is not subscribed.
+	 * \param topic The topic the subscription is listening on.
+	 * \param key_function The function extracting the key of a message. An empty function disables the filter.
+	 * \param window The time a key is remembered.
+	 * \param capacity The maximum number of remembered keys.
+	 */
+	void set_subscription_dedup(const std::string &topic,
+				    message_key_function_t key_function,
+				    const timeout_duration_t &window = std::chrono::seconds(60),
+				    std::size_t capacity = 4096) const;
+
+	/**
+	 * \brief Type of predicates deciding on messages by the value of a key.
+	 */
+	using message_filter_t = std::function<bool(const std::string &)>;
+
+	/**
+	 * \brief Filter messages received on a subscription by the value of a top level key.
+	 *
+	 * The value is extracted by scanning the raw YAML or binary payload with fast::peek_scalar(),
+	 * so consumers only interested in some messages, e.g., Task_containers with "task: migrate vm",
+	 * do not need to parse all of them. Messages are dropped before they are queued or handed to
+	 * the callback, if they lack the key or the predicate returns false, and are counted as filtered.
+	 * Throws std::out_of_range if the topic is not subscribed.
+	 * \param topic The topic the subscription is listening on.
+	 * \param key The key in the top level mapping of the messages.
+	 * \param predicate Returns true for values of messages to keep. An empty function disables the filter.
+	 */
+	void set_subscription_filter(const std::string &topic, const std::string &key, message_filter_t predicate) const;
+
+	/**
+	 * \brief Get the statistics of a subscription.
+	 *
+	 * Throws std::out_of_range if the topic is not subscribed.
+	 * \param topic The topic the subscription is listening on.
+	 */
+	Subscription_stats get_subscription_stats(const std::string &topic) const;
+
 	/**
 	 * \brief Send a message to the default publish topic.
 	 *
 	 * The default publish topic can be set in the constructor.
+	 * The message is sent with QoS 1, unless a topic policy matches the default publish topic.
 	 * \param message The message string to send on the default topic.
 	 */
 	void send_message(const std::string &message) const override;
@@ -150,11 +611,142 @@ public:
 	/**
 	 * \brief Send a message to a specific topic.
 	 *
+	 * Messages with high priority are always handed to mosquitto immediately.
+	 * Messages with lower priority are held back in a queue per priority while mosquitto has
+	 * not yet written previous messages to the network, so they cannot delay messages with
+	 * higher priority. Held back messages are sent by a dedicated thread, highest priority first.
+	 * Messages larger than the chunk size (see set_chunking()) are split into chunks, which are sent
+	 * by the dedicated thread in turn with other held back messages of the same priority and
+	 * reassembled transparently by receiving MQTT_communicators.
+	 * If a time to live is given, the message is wrapped in an envelope carrying its expiry, so
+	 * receiving MQTT_communicators discard it unprocessed once expired. The expiry is based on the
+	 * system clock, so the clocks of sender and receiver should be synchronized.
+	 * QoS, priority and retain flag are taken from the topic policy (see set_topic_policy()), unless
+	 * passed explicitly. Retained messages should not exceed the chunk size, as the broker only
+	 * retains the last chunk.
 	 * \param message The message string to send on the topic.
 	 * \param topic The topic to send the message on.
-	 * \param qos The quality of service (0|1|2 - see mosquitto documentation for further information)
+	 * \param qos The quality of service (0|1|2 - see mosquitto documentation for further information). -1 uses the topic policy.
+	 * \param priority The priority of the message.
+	 * \param ttl The time to live of the message. timeout_duration_t::max() is reserved for no expiry.
+	 */
+	void send_message(const std::string &message,
+			  const std::string &topic,
+			  int qos = -1,
+			  Priority priority = Priority::by_policy,
+			  const timeout_duration_t &ttl = timeout_duration_t::max()) const;
+
+	/**
+	 * \brief Send a message to several topics.
+	 *
+	 * Behaves like calling send_message() for each topic, but the message is wrapped only once
+	 * and held back messages share a single copy of the payload. All messages are handed to
+	 * mosquitto at once, which writes them in the network thread.
+	 * Serialize the message once before calling this, e.g., to broadcast a task to all agents.
+	 * \param message The message string to send on the topics.
+	 * \param topics The topics to send the message on.
+	 * \param qos The quality of service (0|1|2 - see mosquitto documentation for further information). -1 uses the topic policies.
+	 * \param priority The priority of the messages.
+	 * \param ttl The time to live of the messages. timeout_duration_t::max() is reserved for no expiry.
 	 */
-	void send_message(const std::string &message, const std::string &topic, int qos = 2) const;
+	void multicast_message(const std::string &message,
+			       const std::vector<std::string> &topics,
+			       int qos = -1,
+			       Priority priority = Priority::by_policy,
+			       const timeout_duration_t &ttl = timeout_duration_t::max()) const;
+
+	/**
+	 * \brief Send a typed message.
+	 *
+	 * Encodes the message with Message_codec<T> into a buffer of the calling thread, which is
+	 * reused by subsequent calls, and sends it like send_message().
+	 * \param msg The message to send.
+	 * \param topic The topic to send the message on.
+	 * \param qos The quality of service (0|1|2 - see mosquitto documentation for further information). -1 uses the topic policy.
+	 * \param priority The priority of the message.
+	 * \param ttl The time to live of the message. timeout_duration_t::max() is reserved for no expiry.
+	 */
+	template<class T> void send(const T &msg,
+				    const std::string &topic,
+				    int qos = -1,
+				    Priority priority = Priority::by_policy,
+				    const timeout_duration_t &ttl = timeout_duration_t::max()) const
+	{
+		auto &buffer = thread_buffer();
+		Message_codec<T>::encode(msg, buffer);
+		send_message(buffer, topic, qos, priority, ttl);
+	}
+
+	/**
+	 * \brief Receive a typed message.
+	 *
+	 * Waits for a message like get_message() and decodes it with Message_codec<T> in place.
+	 * \param topic The topic of the subscription to get the message from.
+	 * \param msg Is initialized from the received message.
+	 * \param duration The maximum time to wait for a message.
+	 * \param actual_topic Is set to the topic the message was published on if not nullptr.
+	 */
+	template<class T> void receive(const std::string &topic,
+				       T &msg,
+				       const timeout_duration_t &duration = timeout_duration_t::max(),
+				       std::string *actual_topic = nullptr) const
+	{
+		Message_codec<T>::decode(get_message(topic, duration, actual_topic), msg);
+	}
+
+	/**
+	 * \brief Send a message asynchronously.
+	 *
+	 * Behaves like send_message(), but returns right after the message is put into a lock-free
+	 * queue of the calling thread, which is drained by the thread sending held back messages.
+	 * Therefore concurrent producers neither contend on a lock nor wake each other up and only the
+	 * sending thread hands messages to mosquitto. Topic policies are cached per thread.
+	 * Messages posted while not connected are sent after (re-)connecting. Errors are logged, as
+	 * messages are sent after this method returns. Messages posted by one thread keep their order
+	 * within a priority, but are not ordered relative to messages sent with send_message().
+	 * \param message The message string to send on the topic.
+	 * \param topic The topic to send the message on.
+	 * \param qos The quality of service (0|1|2 - see mosquitto documentation for further information). -1 uses the topic policy.
+	 * \param priority The priority of the message.
+	 * \param ttl The time to live of the message. timeout_duration_t::max() is reserved for no expiry.
+	 */
+	void post_message(const std::string &message,
+			  const std::string &topic,
+			  int qos = -1,
+			  Priority priority = Priority::by_policy,
+			  const timeout_duration_t &ttl = timeout_duration_t::max()) const;
+
+	/**
+	 * \brief Configure the chunking of large messages.
+	 *
+	 * Messages larger than chunk_size are sent in chunks of chunk_size bytes. This keeps large
+	 * messages from blocking other messages and from exceeding the message size limit of the broker.
+	 * Received chunks of messages which are not complete within reassembly_timeout after their last
+	 * chunk arrived are discarded. Received chunks of messages larger than max_message_size are discarded
+	 * before allocating memory for the message, as the size is stated by the sender. The first chunk
+	 * of a message is discarded as well if all incomplete messages would take more than
+	 * max_reassembly_size. A topic holds at most 16 incomplete messages; a further one evicts the oldest.
+	 * \param chunk_size The maximum size of the payload of a single publish (default: 256 KiB). 0 disables chunking.
+	 * \param reassembly_timeout The time to wait for the missing chunks of a message. Chunks received twice do not restart it.
+	 * \param max_message_size The maximum size of a received message reassembled from chunks or decompressed (default: 64 MiB).
+	 * \param max_reassembly_size The maximum memory taken by all incomplete messages together (default: 256 MiB).
+	 */
+	void set_chunking(std::size_t chunk_size,
+			  const timeout_duration_t &reassembly_timeout = std::chrono::seconds(30),
+			  std::size_t max_message_size = 64 * 1024 * 1024,
+			  std::size_t max_reassembly_size = 256 * 1024 * 1024) const;
+
+	/**
+	 * \brief Configure the network thread and the socket for low latency.
+	 *
+	 * Socket options are applied to the current connection and every future connection.
+	 * Failing to set an option, e.g., SO_BUSY_POLL without CAP_NET_ADMIN, is logged as warning.
+	 * Throws std::runtime_error if network_cpu or thread_cpus contain a CPU which does not exist,
+	 * threads cannot be pinned to them or memory cannot be bound to their NUMA nodes. The previous
+	 * options are kept in this case.
+	 * \param options The options to use.
+	 */
+	void set_transport_options(const Transport_options &options) const;
 
 	/**
 	 * \brief Get a message from the default subscribe topic.
@@ -213,6 +805,27 @@ public:
 				int keepalive,
 				const timeout_duration_t &timeout = timeout_duration_t::max()) const;
 
+	/**
+	 * \brief Connect to one of several mosquitto brokers with automatic failover.
+	 *
+	 * All brokers are probed by opening a TCP connection and the reachable broker with the lowest
+	 * round trip time is connected to.
+	 * While connected, the brokers are probed continuously every probe_interval. If the connection
+	 * is lost or the active broker stops answering probes, the communicator switches to the
+	 * healthiest remaining broker. Subscriptions are restored on every (re-)connect and
+	 * unacknowledged publishes with QoS 1 and 2 are replayed by mosquitto.
+	 * If no broker can be connected to, it retries every second until success or timeout.
+	 * If a previous connection is still active, std::runtime_error is thrown.
+	 * \param brokers The brokers to choose from. Must not be empty.
+	 * \param keepalive The number of seconds the broker sends periodically ping messages to test if client is still alive.
+	 * \param timeout The timeout of establishing a connection to the MQTT broker e.g. std::chrono::seconds(10). timeout_duration_t::max() is reserved for no timeout.
+	 * \param probe_interval The time between two health probes of the brokers.
+	 */
+	void connect_to_broker(const std::vector<Broker_endpoint> &brokers,
+				int keepalive,
+				const timeout_duration_t &timeout = timeout_duration_t::max(),
+				const timeout_duration_t &probe_interval = std::chrono::seconds(1)) const;
+
 	/**
 	 * \brief Disconnect from the mosquitto broker.
 	 *
@@ -220,10 +833,30 @@ public:
 	 */
 	void disconnect_from_broker() const;
 
+	/**
+	 * \brief Shut down gracefully within a deadline.
+	 *
+	 * Stops accepting new messages, so sending or posting throws std::runtime_error afterwards.
+	 * Waits until all held back and posted messages are handed to mosquitto and all of them are
+	 * written (QoS 0) or acknowledged by the broker (QoS 1 and 2), then disconnects from the
+	 * broker and stops the network thread. Gives up waiting when the deadline is reached or the
+	 * connection is lost. Subscriptions are not delivered messages anymore afterwards.
+	 * \param deadline The maximum time to wait for outstanding messages.
+	 * \return True if all messages were delivered, else false.
+	 */
+	bool shutdown(const timeout_duration_t &deadline) const;
+
 	/**
 	 * \brief Check if a connection is established.
 	 */
 	bool is_connected() const;
+
+	/**
+	 * \brief Get the broker which is currently used.
+	 *
+	 * Throws std::runtime_error if connect_to_broker() has not been called.
+	 */
+	Broker_endpoint get_active_broker() const;
 private:
 	void resubscribe() const;
 	/**
@@ -247,6 +880,53 @@ private:
 	 */
 	void on_message(const mosquitto_message *msg) override;
 
+	/**
+	 * \brief Callback for sent messages.
+	 *
+	 * \param mid The id of the message sent.
+	 */
+	void on_publish(int mid) override;
+
+	/**
+	 * \brief Get the buffer of the calling thread for encoding typed messages.
+	 */
+	static std::string & thread_buffer();
+
+	/**
+	 * \brief Get the buffer of the calling thread for compressing messages.
+	 */
+	static std::string & compression_buffer();
+
+	/**
+	 * \brief Publish a message and count it as in flight until on_publish is called.
+	 */
+	int publish_tracked(const std::string &topic, const char *payload, std::size_t size, int qos, bool retain) const;
+
+	/**
+	 * \brief Pin a thread to the CPUs set by the transport options, if any.
+	 */
+	void pin_to_thread_cpus(std::thread &thread) const;
+
+	/**
+	 * \brief Apply the socket options of the transport options to the current socket.
+	 */
+	void apply_socket_options() const;
+
+	/**
+	 * \brief Get the policy of a topic and whether a topic filter matched.
+	 */
+	std::pair<bool, Topic_policy> resolve_policy(const std::string &topic) const;
+
+	/**
+	 * \brief Publish a message to several topics, holding it back if needed.
+	 */
+	void publish_to_topics(const std::string &message,
+			       const std::string *topics,
+			       std::size_t topic_count,
+			       int qos,
+			       Priority priority,
+			       const timeout_duration_t &ttl) const;
+
 	/**
 	 * \brief Initializes the mosquitto library if necessary.
 	 *
@@ -277,6 +957,62 @@ private:
 	 */
 	void stop_mosq_loop() const;
 
+	/**
+	 * \brief The network loop run by the network thread.
+	 *
+	 * Handles all traffic and (re-)connects to the healthiest broker if the connection is lost.
+	 */
+	void run_network_loop() const;
+
+	/**
+	 * \brief Connects to the healthiest broker.
+	 *
+	 * Called by the network thread only. Returns false if no broker could be connected to.
+	 */
+	bool connect_to_healthiest_broker() const;
+
+	/**
+	 * \brief The loop run by the probe thread to continuously probe all brokers.
+	 */
+	void run_probe_loop() const;
+
+	/**
+	 * \brief Probes all brokers and updates their health.
+	 */
+	void probe_brokers() const;
+
+	/**
+	 * \brief Stops the probe thread if running.
+	 */
+	void stop_probe_thread() const;
+
+	/**
+	 * \brief The loop run by the latency probe thread to ping via the broker.
+	 */
+	void run_latency_probe_loop() const;
+
+	/**
+	 * \brief Stops the latency probe thread if running.
+	 */
+	void stop_latency_probe() const;
+
+	/**
+	 * \brief Starts the thread sending held back messages.
+	 */
+	void start_outbound_thread() const;
+
+	/**
+	 * \brief Stops the thread sending held back messages.
+	 *
+	 * Messages still held back are discarded.
+	 */
+	void stop_outbound_thread() const;
+
+	/**
+	 * \brief The loop run by the outbound thread to send held back messages.
+	 */
+	void run_outbound_loop() const;
+
 	/**
 	 * \brief The topic to get messages from by default.
 	 */
@@ -312,6 +1048,133 @@ private:
 	 */
 	mutable std::condition_variable connected_cv;
 
+	/**
+	 * \brief The brokers passed to connect_to_broker().
+	 */
+	mutable std::vector<Broker_endpoint> brokers;
+
+	/**
+	 * \brief The health of the brokers (same order as brokers).
+	 */
+	mutable std::vector<Broker_health> brokers_health;
+
+	/**
+	 * \brief The index of the broker currently used.
+	 */
+	mutable std::size_t active_broker;
+
+	/**
+	 * \brief The keepalive passed to connect_to_broker().
+	 */
+	mutable int keepalive;
+
+	/**
+	 * \brief This flag states, if the network thread should (re-)connect if there is no connection.
+	 */
+	mutable bool reconnect_enabled;
+
+	/**
+	 * \brief The mutex for safe access to the brokers, their health and the reconnect_enabled flag.
+	 */
+	mutable std::mutex brokers_mutex;
+
+	/**
+	 * \brief The condition variable to wake the network thread waiting for a connect request.
+	 */
+	mutable std::condition_variable reconnect_cv;
+
+	/**
+	 * \brief Set by the probe thread to make the network thread switch to another broker.
+	 */
+	mutable std::atomic<bool> switch_requested;
+
+	/**
+	 * \brief The thread running the mosquitto loop.
+	 */
+	mutable std::thread network_thread;
+
+	/**
+	 * \brief This flag states, if the network thread should keep running.
+	 */
+	mutable std::atomic<bool> network_loop_running;
+
+	/**
+	 * \brief The thread probing the health of the brokers.
+	 */
+	mutable std::thread probe_thread;
+
+	/**
+	 * \brief This flag states, if the probe thread should keep running.
+	 */
+	mutable bool probe_running;
+
+	/**
+	 * \brief The condition variable to wake the probe thread on stop.
+	 */
+	mutable std::condition_variable probe_cv;
+
+	/**
+	 * \brief The time between two health probes of the brokers.
+	 */
+	mutable timeout_duration_t probe_interval;
+
+	/**
+	 * \brief The queue holding back messages with lower priority.
+	 */
+	std::unique_ptr<MQTT_outbound_queue> outbound_queue;
+
+	/**
+	 * \brief The thread sending held back messages.
+	 */
+	mutable std::thread outbound_thread;
+
+	/**
+	 * \brief The settings of the network thread and socket.
+	 */
+	mutable Transport_options transport_options;
+
+	/**
+	 * \brief The mutex for safe access to the transport options.
+	 */
+	mutable std::mutex transport_mutex;
+
+	/**
+	 * \brief This flag states, if the network thread spins.
+	 */
+	mutable std::atomic<bool> busy_poll;
+
+	/**
+	 * \brief The topic filters and their policies.
+	 */
+	mutable std::vector<std::pair<std::string, Topic_policy>> policies;
+
+	/**
+	 * \brief The version of the policies, which is incremented on every change.
+	 */
+	mutable std::atomic<std::uint64_t> policies_version;
+
+	/**
+	 * \brief The cached policies of topics.
+	 *
+	 * The cache is cleared when it reaches a fixed number of topics.
+	 */
+	mutable std::unordered_map<std::string, std::pair<bool, Topic_policy>> resolved_policies;
+
+	/**
+	 * \brief The mutex for safe access to the policies.
+	 */
+	mutable std::mutex policies_mutex;
+
+	/**
+	 * \brief The chunks of received messages which are not yet complete.
+	 */
+	std::unique_ptr<MQTT_reassembly> reassembly;
+
+	/**
+	 * \brief The state of the latency probe.
+	 */
+	std::unique_ptr<MQTT_latency_probe> latency_probe;
+
 	/**
 	 * The mutex for safe access to the ref_count.
 	 */
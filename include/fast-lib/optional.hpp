@@ -13,6 +13,9 @@
 #include <yaml-cpp/yaml.h>
 
 #include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
 
 namespace fast
 {
@@ -161,6 +164,24 @@ public:
 	 * \brief Used to deserialize from YAML.
 	 */
 	void load(const YAML::Node &node) override;
+	/**
+	 * \brief Add tag and value to parent if valid, unless parent already has the tag.
+	 *
+	 * Used in emit() of composed classes instead of merging the node returned by emit().
+	 */
+	void emit_into(YAML::Node &parent) const override;
+	/**
+	 * \brief Used to serialize to a YAML emitter like emit().
+	 */
+	void emit_stream(YAML::Emitter &out) const override;
+	/**
+	 * \brief Stream tag and value as entry of the enclosing mapping if valid.
+	 *
+	 * Used in emit_stream() of composed classes instead of merging the node returned by emit().
+	 * \param out The emitter, which must be inside a mapping.
+	 * \param flow Emit the value in flow style, e.g., for nested sequences.
+	 */
+	void emit_entry(YAML::Emitter &out, bool flow = false) const;
 private:
 	/**
 	 * \brief The tag of this Optional used for serialization.
@@ -355,5 +376,562 @@ void Optional<T>::load(const YAML::Node &node)
 	}
 }
 
+template<typename T>
+void Optional<T>::emit_into(YAML::Node &parent) const
+{
+	if (valid && !static_cast<const YAML::Node &>(parent)[tag])
+		parent[tag] = *ptr;
+}
+
+template<typename T>
+void Optional<T>::emit_stream(YAML::Emitter &out) const
+{
+	if (!valid) {
+		out << YAML::Null;
+		return;
+	}
+	out << YAML::BeginMap;
+	emit_entry(out);
+	out << YAML::EndMap;
+}
+
+template<typename T>
+void Optional<T>::emit_entry(YAML::Emitter &out, bool flow) const
+{
+	if (!valid)
+		return;
+	out << YAML::Key << tag << YAML::Value;
+	if (flow)
+		out << YAML::Flow;
+	fast::yaml::stream(out, *ptr);
+}
+
+/**
+ * \brief Define a tag type for Inline_optional.
+ *
+ * Usage:
+ * `FASTLIB_OPTIONAL_TAG(vm_name_tag, "vm-name")`
+ * defines a struct vm_name_tag whose tag() returns "vm-name".
+ */
+#define FASTLIB_OPTIONAL_TAG(NAME, TAG) \
+	struct NAME \
+	{ \
+		static constexpr const char * tag() \
+		{ \
+			return TAG; \
+		} \
+	};
+
+/**
+ * \brief An Optional storing its value inline and its tag in the type.
+ *
+ * Provides the interface of Optional, but never allocates: The value is constructed in place within
+ * the object and the tag used for serialization is taken from Tag::tag(), see FASTLIB_OPTIONAL_TAG.
+ * Use it for members of messages, which are built and copied frequently.
+ */
+template<typename T, typename Tag>
+class Inline_optional :
+	public fast::Serializable
+{
+public:
+	using value_type = T;
+
+	/**
+	 * \brief Construct an empty Inline_optional.
+	 */
+	Inline_optional() noexcept;
+	/**
+	 * \brief Construct an Inline_optional with an object copied from val.
+	 *
+	 * \param val The value used to initilize the contained object.
+	 */
+	explicit Inline_optional(const T &val);
+	/**
+	 * \brief Construct an Inline_optional with an object moved from val.
+	 *
+	 * \param val The value used to initilize the contained object.
+	 */
+	explicit Inline_optional(T &&val);
+	/**
+	 * \brief Copy construct from l-value.
+	 *
+	 * \param rhs The Inline_optional to copy from.
+	 */
+	Inline_optional(const Inline_optional &rhs);
+	/**
+	 * \brief Move construct from r-value, which is invalid afterwards.
+	 *
+	 * \param rhs The Inline_optional to move from.
+	 */
+	Inline_optional(Inline_optional &&rhs) noexcept(std::is_nothrow_move_constructible<T>::value);
+	/**
+	 * \brief Destroy the contained object if valid.
+	 */
+	~Inline_optional();
+	/**
+	 * \brief Copy-assign a value to this Inline_optional from an l-value.
+	 *
+	 * \param val The value to be assigned.
+	 */
+	Inline_optional & operator=(const T &val);
+	/**
+	 * \brief Move-assign a value to this Inline_optional from an r-value.
+	 *
+	 * \param val The value to be assigned.
+	 */
+	Inline_optional & operator=(T &&val);
+	/**
+	 * \brief Copy-assign from another Inline_optional.
+	 *
+	 * \param rhs Another Inline_optional to copy assign from.
+	 */
+	Inline_optional & operator=(const Inline_optional &rhs);
+	/**
+	 * \brief Move-assign from another Inline_optional, which is invalid afterwards.
+	 *
+	 * \param rhs Another Inline_optional to move assign from.
+	 */
+	Inline_optional & operator=(Inline_optional &&rhs);
+
+	/**
+	 * \brief Check two Inline_optionals for equality in validity and value.
+	 *
+	 * \param rhs The other Inline_optional to compare with.
+	 */
+	bool operator==(const Inline_optional &rhs) const;
+	/**
+	 * \brief Check this Inline_optional and a value for equality.
+	 *
+	 * \param val The value to compare with.
+	 */
+	bool operator==(const T &val) const;
+
+	/**
+	 * \brief Check if this Inline_optional is valid i.e. contains a value.
+	 */
+	bool is_valid() const noexcept;
+	/**
+	 * \brief bool operator to make checks for validity implicit.
+	 */
+	operator bool() const noexcept;
+
+	/**
+	 * \brief Get reference to value of the contained object and throw exception if not valid.
+	 */
+	T & get();
+	/**
+	 * \brief Get const reference to value of the contained object and throw exception if not valid.
+	 */
+	const T & get() const;
+	/**
+	 * \brief Get the value if valid or default_value otherwise.
+	 *
+	 * \param default_value This value is returned if this Inline_optional is not valid.
+	 */
+	const T & get_or(const T &default_value) const;
+
+	/**
+	 * \brief Shortcut for get().
+	 */
+	T & operator*();
+	/**
+	 * \brief Shortcut for get().
+	 */
+	const T & operator*() const;
+	/**
+	 * \brief Shortcut for get() on pointer.
+	 */
+	T * operator->();
+	/**
+	 * \brief Shortcut for get() on pointer.
+	 */
+	const T * operator->() const;
+
+	/**
+	 * \brief Return the tag of this Inline_optional.
+	 */
+	static constexpr const char * get_tag();
+
+	/**
+	 * \brief Set the value of this Inline_optional.
+	 *
+	 * \param val The value to initilize the object from (copy).
+	 */
+	void set(const T &val);
+	/**
+	 * \brief Set the value of this Inline_optional.
+	 *
+	 * \param val The value to initilize the object from (move).
+	 */
+	void set(T &&val);
+	/**
+	 * \brief Construct the value in place, replacing the current value.
+	 *
+	 * \param args The arguments passed to the constructor of T.
+	 */
+	template<typename... Args> T & emplace(Args&&... args);
+	/**
+	 * \brief Destroy the contained object, making this Inline_optional invalid.
+	 */
+	void reset() noexcept;
+
+	/**
+	 * \brief Used to serialize to YAML.
+	 */
+	YAML::Node emit() const override;
+	/**
+	 * \brief Used to deserialize from YAML.
+	 */
+	void load(const YAML::Node &node) override;
+	/**
+	 * \brief Add tag and value to parent if valid, unless parent already has the tag.
+	 */
+	void emit_into(YAML::Node &parent) const override;
+	/**
+	 * \brief Used to serialize to a YAML emitter like emit().
+	 */
+	void emit_stream(YAML::Emitter &out) const override;
+	/**
+	 * \brief Stream tag and value as entry of the enclosing mapping if valid.
+	 *
+	 * \param out The emitter, which must be inside a mapping.
+	 * \param flow Emit the value in flow style, e.g., for nested sequences.
+	 */
+	void emit_entry(YAML::Emitter &out, bool flow = false) const;
+	/**
+	 * \brief Used to serialize to the binary format like emit().
+	 */
+	void emit_binary(std::string &buffer) const override;
+	/**
+	 * \brief Used to deserialize from the binary format like load().
+	 */
+	void load_binary(binary::Reader &in) override;
+	/**
+	 * \brief Append tag and value to a buffer in the binary format as entry of the enclosing mapping if valid.
+	 *
+	 * \return True if the entry was appended, so the caller can count the entries of the mapping.
+	 */
+	bool append_entry(std::string &buffer) const;
+	/**
+	 * \brief Read the value of an entry of the enclosing mapping in the binary format if key is the tag.
+	 *
+	 * \param in Positioned at the value of the entry.
+	 * \param key The key of the entry as read with binary::Reader::scalar().
+	 * \param size The size of the key.
+	 * \return True if the value was read.
+	 */
+	bool load_entry(binary::Reader &in, const char *key, std::size_t size);
+private:
+	T * ptr() noexcept;
+	const T * ptr() const noexcept;
+
+	/**
+	 * \brief The storage of the contained object.
+	 */
+	typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+	/**
+	 * \brief Denote if the storage actually contains a valid object.
+	 */
+	bool valid;
+};
+
+template<typename T, typename Tag>
+Inline_optional<T, Tag>::Inline_optional() noexcept :
+	valid(false)
+{
+}
+
+template<typename T, typename Tag>
+Inline_optional<T, Tag>::Inline_optional(const T &val) :
+	valid(false)
+{
+	emplace(val);
+}
+
+template<typename T, typename Tag>
+Inline_optional<T, Tag>::Inline_optional(T &&val) :
+	valid(false)
+{
+	emplace(std::move(val));
+}
+
+template<typename T, typename Tag>
+Inline_optional<T, Tag>::Inline_optional(const Inline_optional &rhs) :
+	Serializable(rhs),
+	valid(false)
+{
+	if (rhs.valid)
+		emplace(*rhs.ptr());
+}
+
+template<typename T, typename Tag>
+Inline_optional<T, Tag>::Inline_optional(Inline_optional &&rhs) noexcept(std::is_nothrow_move_constructible<T>::value) :
+	Serializable(rhs),
+	valid(false)
+{
+	if (rhs.valid) {
+		emplace(std::move(*rhs.ptr()));
+		rhs.reset();
+	}
+}
+
+template<typename T, typename Tag>
+Inline_optional<T, Tag>::~Inline_optional()
+{
+	reset();
+}
+
+template<typename T, typename Tag>
+Inline_optional<T, Tag> & Inline_optional<T, Tag>::operator=(const T &val)
+{
+	if (valid)
+		*ptr() = val;
+	else
+		emplace(val);
+	return *this;
+}
+
+template<typename T, typename Tag>
+Inline_optional<T, Tag> & Inline_optional<T, Tag>::operator=(T &&val)
+{
+	if (valid)
+		*ptr() = std::move(val);
+	else
+		emplace(std::move(val));
+	return *this;
+}
+
+template<typename T, typename Tag>
+Inline_optional<T, Tag> & Inline_optional<T, Tag>::operator=(const Inline_optional &rhs)
+{
+	if (!rhs.valid)
+		reset();
+	else
+		*this = *rhs.ptr();
+	return *this;
+}
+
+template<typename T, typename Tag>
+Inline_optional<T, Tag> & Inline_optional<T, Tag>::operator=(Inline_optional &&rhs)
+{
+	if (!rhs.valid) {
+		reset();
+	} else if (this != &rhs) {
+		*this = std::move(*rhs.ptr());
+		rhs.reset();
+	}
+	return *this;
+}
+
+template<typename T, typename Tag>
+bool Inline_optional<T, Tag>::operator==(const Inline_optional &rhs) const
+{
+	if (valid != rhs.valid)
+		return false;
+	if (valid)
+		return *ptr() == *rhs.ptr();
+	return true;
+}
+
+template<typename T, typename Tag>
+bool Inline_optional<T, Tag>::operator==(const T &val) const
+{
+	return valid && *ptr() == val;
+}
+
+template<typename T, typename Tag>
+bool Inline_optional<T, Tag>::is_valid() const noexcept
+{
+	return valid;
+}
+
+template<typename T, typename Tag>
+Inline_optional<T, Tag>::operator bool() const noexcept
+{
+	return valid;
+}
+
+template<typename T, typename Tag>
+T & Inline_optional<T, Tag>::get()
+{
+	if (!valid)
+		throw std::runtime_error("Optional value not valid.");
+	return *ptr();
+}
+
+template<typename T, typename Tag>
+const T & Inline_optional<T, Tag>::get() const
+{
+	if (!valid)
+		throw std::runtime_error("Optional value not valid.");
+	return *ptr();
+}
+
+template<typename T, typename Tag>
+const T & Inline_optional<T, Tag>::get_or(const T &default_value) const
+{
+	return valid ? *ptr() : default_value;
+}
+
+template<typename T, typename Tag>
+T & Inline_optional<T, Tag>::operator*()
+{
+	return get();
+}
+
+template<typename T, typename Tag>
+const T & Inline_optional<T, Tag>::operator*() const
+{
+	return get();
+}
+
+template<typename T, typename Tag>
+T * Inline_optional<T, Tag>::operator->()
+{
+	return &get();
+}
+
+template<typename T, typename Tag>
+const T * Inline_optional<T, Tag>::operator->() const
+{
+	return &get();
+}
+
+template<typename T, typename Tag>
+constexpr const char * Inline_optional<T, Tag>::get_tag()
+{
+	return Tag::tag();
+}
+
+template<typename T, typename Tag>
+void Inline_optional<T, Tag>::set(const T &val)
+{
+	*this = val;
+}
+
+template<typename T, typename Tag>
+void Inline_optional<T, Tag>::set(T &&val)
+{
+	*this = std::move(val);
+}
+
+template<typename T, typename Tag>
+template<typename... Args>
+T & Inline_optional<T, Tag>::emplace(Args&&... args)
+{
+	reset();
+	new (&storage) T(std::forward<Args>(args)...);
+	valid = true;
+	return *ptr();
+}
+
+template<typename T, typename Tag>
+void Inline_optional<T, Tag>::reset() noexcept
+{
+	if (valid) {
+		ptr()->~T();
+		valid = false;
+	}
+}
+
+template<typename T, typename Tag>
+T * Inline_optional<T, Tag>::ptr() noexcept
+{
+	return reinterpret_cast<T *>(&storage);
+}
+
+template<typename T, typename Tag>
+const T * Inline_optional<T, Tag>::ptr() const noexcept
+{
+	return reinterpret_cast<const T *>(&storage);
+}
+
+template<typename T, typename Tag>
+YAML::Node Inline_optional<T, Tag>::emit() const
+{
+	YAML::Node node;
+	if (valid)
+		node[get_tag()] = *ptr();
+	return node;
+}
+
+template<typename T, typename Tag>
+void Inline_optional<T, Tag>::load(const YAML::Node &node)
+{
+	auto value = node[get_tag()];
+	if (value)
+		emplace(value.template as<T>());
+}
+
+template<typename T, typename Tag>
+void Inline_optional<T, Tag>::emit_into(YAML::Node &parent) const
+{
+	if (valid && !static_cast<const YAML::Node &>(parent)[get_tag()])
+		parent[get_tag()] = *ptr();
+}
+
+template<typename T, typename Tag>
+void Inline_optional<T, Tag>::emit_stream(YAML::Emitter &out) const
+{
+	if (!valid) {
+		out << YAML::Null;
+		return;
+	}
+	out << YAML::BeginMap;
+	emit_entry(out);
+	out << YAML::EndMap;
+}
+
+template<typename T, typename Tag>
+void Inline_optional<T, Tag>::emit_entry(YAML::Emitter &out, bool flow) const
+{
+	if (!valid)
+		return;
+	out << YAML::Key << get_tag() << YAML::Value;
+	if (flow)
+		out << YAML::Flow;
+	fast::yaml::stream(out, *ptr());
+}
+
+template<typename T, typename Tag>
+void Inline_optional<T, Tag>::emit_binary(std::string &buffer) const
+{
+	if (!valid) {
+		binary::append_null(buffer);
+		return;
+	}
+	binary::append_map_header(buffer, 1);
+	append_entry(buffer);
+}
+
+template<typename T, typename Tag>
+void Inline_optional<T, Tag>::load_binary(binary::Reader &in)
+{
+	binary::read_map(in, [&](const char *key, std::size_t size) {
+		return load_entry(in, key, size);
+	});
+}
+
+template<typename T, typename Tag>
+bool Inline_optional<T, Tag>::append_entry(std::string &buffer) const
+{
+	if (!valid)
+		return false;
+	binary::append_value(buffer, get_tag());
+	binary::append_value(buffer, *ptr());
+	return true;
+}
+
+template<typename T, typename Tag>
+bool Inline_optional<T, Tag>::load_entry(binary::Reader &in, const char *key, std::size_t size)
+{
+	if (!binary::key_equals(key, size, get_tag()))
+		return false;
+	T value;
+	binary::read_value(in, value);
+	*this = std::move(value);
+	return true;
+}
+
 }
 #endif
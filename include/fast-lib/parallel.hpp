@@ -0,0 +1,161 @@
+/*
+ * This file is part of fast-lib.
+ * Copyright (C) 2015 RWTH Aachen University - ACS
+ *
+ * This file is licensed under the GNU Lesser General Public License Version 3
+ * Version 3, 29 June 2007. For details see 'LICENSE.md' in the root directory.
+ */
+
+#ifndef FAST_LIB_PARALLEL_HPP
+#define FAST_LIB_PARALLEL_HPP
+
+#include <fast-lib/serializable.hpp>
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace fast
+{
+	/**
+ 	 * \brief Options to encode and decode long sequences of messages on several threads.
+ 	 *
+ 	 * The default of one thread keeps encoding and decoding sequential.
+ 	 */
+	struct Parallel_options
+	{
+		/**
+ 		 * \brief The maximum number of threads including the calling thread.
+ 		 */
+		unsigned int threads = 1;
+		/**
+ 		 * \brief The minimum number of elements per chunk, so short sequences stay on the calling thread.
+ 		 */
+		std::size_t min_chunk_size = 32;
+	};
+
+	/**
+ 	 * \brief Encoding and decoding of sequences split into contiguous chunks processed concurrently.
+ 	 *
+ 	 * The order of the elements is preserved. Elements must not share state, which is modified while
+ 	 * emitting or loading them.
+ 	 */
+	namespace parallel
+	{
+		/**
+ 		 * \brief Call func for contiguous chunks [begin, end) of the range [0, size).
+ 		 *
+ 		 * The first chunk is processed on the calling thread, the others on threads started for the call.
+ 		 * Returns after all chunks are processed and rethrows the exception of the first failed chunk.
+ 		 */
+		void for_chunks(std::size_t size, const Parallel_options &options, const std::function<void(std::size_t, std::size_t)> &func);
+
+		namespace detail
+		{
+			template<class T> void load_element(T &value, const YAML::Node &node)
+			{
+				fast::load(value, node);
+			}
+			template<class T> void load_element(std::shared_ptr<T> &value, const YAML::Node &node)
+			{
+				value = std::make_shared<T>();
+				value->load(node);
+			}
+
+			template<class T> void append_element(std::string &buffer, const T &value)
+			{
+				binary::append_value(buffer, value);
+			}
+			template<class T> void append_element(std::string &buffer, const std::shared_ptr<T> &value)
+			{
+				binary::append_value(buffer, *value);
+			}
+		}
+
+		/**
+ 		 * \brief Load a vector from a YAML sequence, constructing its elements concurrently.
+ 		 *
+ 		 * Reads the sequence without modifying it, so the chunks can share the YAML node.
+ 		 * Throws std::runtime_error if node is not a sequence.
+ 		 */
+		template<class T> void load(std::vector<T> &values, const YAML::Node &node, const Parallel_options &options)
+		{
+			if (!node.IsSequence())
+				throw std::runtime_error("Error loading YAML-node: Node is not a sequence.");
+			// Index the elements first, as iterating a sequence from several threads is not supported.
+			std::vector<YAML::Node> elements(node.begin(), node.end());
+			std::vector<T> loaded(elements.size());
+			for_chunks(elements.size(), options, [&](std::size_t begin, std::size_t end) {
+				for (auto i = begin; i != end; ++i)
+					detail::load_element(loaded[i], elements[i]);
+			});
+			values = std::move(loaded);
+		}
+
+		/**
+ 		 * \brief Read a vector from the binary format, loading its elements concurrently.
+ 		 *
+ 		 * The elements are located by skipping over them first, then each chunk reads its elements
+ 		 * with its own binary::Reader. Throws std::runtime_error if the next element is not a sequence.
+ 		 */
+		template<class T> void load(std::vector<T> &values, binary::Reader &in, const Parallel_options &options)
+		{
+			if (options.threads <= 1) {
+				binary::read_value(in, values);
+				return;
+			}
+			auto size = in.sequence_header();
+			std::vector<binary::Reader> elements;
+			elements.reserve(size);
+			for (std::size_t i = 0; i != size; ++i) {
+				elements.push_back(in);
+				in.skip();
+			}
+			std::vector<T> loaded(elements.size());
+			for_chunks(elements.size(), options, [&](std::size_t begin, std::size_t end) {
+				auto element = elements[begin];
+				for (auto i = begin; i != end; ++i)
+					binary::read_value(element, loaded[i]);
+			});
+			values = std::move(loaded);
+		}
+
+		/**
+ 		 * \brief Emit a vector as YAML sequence, building the nodes of its elements concurrently.
+ 		 */
+		template<class T> YAML::Node emit(const std::vector<T> &values, const Parallel_options &options)
+		{
+			std::vector<YAML::Node> elements(values.size());
+			for_chunks(values.size(), options, [&](std::size_t begin, std::size_t end) {
+				for (auto i = begin; i != end; ++i)
+					elements[i] = YAML::Node(values[i]);
+			});
+			YAML::Node node(YAML::NodeType::Sequence);
+			for (const auto &element : elements)
+				node.push_back(element);
+			return node;
+		}
+
+		/**
+ 		 * \brief Append a vector to a buffer in the binary format, encoding chunks concurrently.
+ 		 *
+ 		 * Each chunk is encoded into its own buffer and the buffers are concatenated in order.
+ 		 */
+		template<class T> void append_value(std::string &buffer, const std::vector<T> &values, const Parallel_options &options)
+		{
+			binary::append_sequence_header(buffer, values.size());
+			// Each chunk is stored at the index of its first element.
+			std::vector<std::string> chunks(values.size());
+			for_chunks(values.size(), options, [&](std::size_t begin, std::size_t end) {
+				for (auto i = begin; i != end; ++i)
+					detail::append_element(chunks[begin], values[i]);
+			});
+			for (const auto &chunk : chunks)
+				buffer.append(chunk);
+		}
+	}
+}
+
+#endif
@@ -11,13 +11,22 @@
 
 #include <yaml-cpp/yaml.h>
 
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
 #include <stdexcept>
 #include <string>
 #include <type_traits>
+#include <vector>
 
 
 namespace fast
 {
+	namespace binary {
+		class Reader;
+	}
+
 	/**
  	 * \brief Other classes can be derived from Serilizable to enable YAML serialization.
  	 *
@@ -51,17 +60,468 @@ namespace fast
  		 * \brief Override this function to define how the derived class should be deserialized.
  		 */
 		virtual void load(const YAML::Node &node) = 0;
+		/**
+ 		 * \brief Override this function to add the entries of the derived class to the mapping of a parent node.
+ 		 *
+ 		 * Composed classes use it to emit into the node of the enclosing object instead of merging nodes.
+ 		 * The default merges the node returned by emit() into parent using yaml::merge_node().
+ 		 */
+		virtual void emit_into(YAML::Node &parent) const;
+		/**
+ 		 * \brief Override this function to stream the derived class to a YAML emitter without building a node.
+ 		 *
+ 		 * Must produce the same YAML as emitting the node returned by emit(), which is the default.
+ 		 */
+		virtual void emit_stream(YAML::Emitter &out) const;
+		/**
+ 		 * \brief Override this function to encode the derived class in the binary format without building a node.
+ 		 *
+ 		 * Must append the same bytes as encoding the node returned by emit(), which is the default.
+ 		 * \param buffer The encoded object is appended to it.
+ 		 */
+		virtual void emit_binary(std::string &buffer) const;
+		/**
+ 		 * \brief Override this function to decode the derived class from the binary format without building a node.
+ 		 *
+ 		 * Must load the same as load() with the node decoded from the binary format, which is the default.
+ 		 * \param in Reads the encoded object completely.
+ 		 */
+		virtual void load_binary(binary::Reader &in);
 
 		/**
- 		 * \brief Convert to YAML string using emit.
+ 		 * \brief Convert to YAML string using emit_stream.
  		 */
 		virtual std::string to_string() const;
 		/**
  		 * \brief Initilize from YAML string using load.
+ 		 *
+ 		 * Strings in the binary wire format (see binary::to_string()) are detected and decoded as well.
  		 */
 		virtual void from_string(const std::string &str);
 	};
 
+	namespace yaml {
+		/**
+ 		 * \brief Convert to YAML string using emit_stream, reusing the memory of a buffer.
+ 		 *
+ 		 * Produces the same string as Serializable::to_string().
+ 		 * \param obj The object to serialize.
+ 		 * \param buffer Is replaced by the YAML string.
+ 		 */
+		void to_string(const Serializable &obj, std::string &buffer);
+
+		/**
+ 		 * \brief Stream a value to a YAML emitter like emitting the YAML node converted from it.
+ 		 *
+ 		 * Serializable objects use emit_stream(), vectors and shared pointers are streamed element wise.
+ 		 */
+		template<class T> typename std::enable_if<!std::is_base_of<Serializable, T>::value>::type
+			stream(YAML::Emitter &out, const T &value);
+		void stream(YAML::Emitter &out, const Serializable &value);
+		template<class T> void stream(YAML::Emitter &out, const std::vector<T> &values);
+		template<class T> void stream(YAML::Emitter &out, const std::shared_ptr<T> &value);
+
+		template<class T> typename std::enable_if<!std::is_base_of<Serializable, T>::value>::type
+			stream(YAML::Emitter &out, const T &value)
+		{
+			out << value;
+		}
+		inline void stream(YAML::Emitter &out, const Serializable &value)
+		{
+			value.emit_stream(out);
+		}
+		template<class T> void stream(YAML::Emitter &out, const std::vector<T> &values)
+		{
+			out << YAML::BeginSeq;
+			for (const auto &value : values)
+				stream(out, value);
+			out << YAML::EndSeq;
+		}
+		template<class T> void stream(YAML::Emitter &out, const std::shared_ptr<T> &value)
+		{
+			stream(out, *value);
+		}
+	}
+
+	/**
+ 	 * \brief Compact binary wire format for Serializable objects.
+ 	 *
+ 	 * Encodes the node produced by emit() as MessagePack prefixed by the byte content_type.
+ 	 * Types overriding Serializable::emit_binary() and Serializable::load_binary() write and read
+ 	 * their members directly, others go through emit() and load().
+ 	 * Scalars are encoded as strings, so any type that round trips through YAML also round trips here.
+ 	 * Serializable::from_string() detects the content type, so receivers accept YAML and binary messages.
+ 	 */
+	namespace binary {
+		/**
+ 		 * \brief The first byte of binary encoded messages.
+ 		 *
+ 		 * 0xC1 is never used by MessagePack and can not start UTF-8 text, thus YAML.
+ 		 */
+		constexpr char content_type = static_cast<char>(0xC1);
+
+		/**
+ 		 * \brief Convert to the binary format using emit, reusing the memory of a buffer.
+ 		 * \param obj The object to serialize.
+ 		 * \param buffer Is replaced by the encoded object.
+ 		 */
+		void to_string(const Serializable &obj, std::string &buffer);
+		/**
+ 		 * \brief Convert to the binary format using emit.
+ 		 */
+		std::string to_string(const Serializable &obj);
+		/**
+ 		 * \brief Check if a string starts with the content type of the binary format.
+ 		 */
+		bool is_binary(const std::string &str);
+		/**
+ 		 * \brief Initialize obj from a string in the binary format using load_binary.
+ 		 *
+ 		 * Throws std::runtime_error if the string is not valid.
+ 		 */
+		void from_string(Serializable &obj, const std::string &str);
+		/**
+ 		 * \brief Decode a string in the binary format into a YAML node.
+ 		 *
+ 		 * Throws std::runtime_error if the string is not valid.
+ 		 */
+		YAML::Node load(const std::string &str);
+		/**
+ 		 * \brief Read a scalar of the top level mapping of a string in the binary format without decoding it.
+ 		 *
+ 		 * Other entries are skipped over without building YAML nodes.
+ 		 * Throws std::runtime_error if the string is not valid up to the key.
+ 		 * \param str The string in the binary format to scan.
+ 		 * \param key The key of the scalar in the top level mapping.
+ 		 * \param value Is set to the scalar if found.
+ 		 * \return True if the key was found with a scalar value.
+ 		 */
+		bool peek_scalar(const std::string &str, const std::string &key, std::string &value);
+
+		/**
+ 		 * \brief Append a string to a buffer in the binary format.
+ 		 */
+		void append_string(std::string &buffer, const char *str, std::size_t size);
+		/**
+ 		 * \brief Append the header of a sequence with size elements to a buffer in the binary format.
+ 		 */
+		void append_sequence_header(std::string &buffer, std::size_t size);
+		/**
+ 		 * \brief Append the header of a mapping with size entries to a buffer in the binary format.
+ 		 */
+		void append_map_header(std::string &buffer, std::size_t size);
+		/**
+ 		 * \brief Insert the header of a mapping with size entries at pos of a buffer.
+ 		 *
+ 		 * Used to prefix entries, which are counted while appending them.
+ 		 */
+		void insert_map_header(std::string &buffer, std::string::size_type pos, std::size_t size);
+		/**
+ 		 * \brief Append a null value to a buffer in the binary format, like an empty node.
+ 		 */
+		void append_null(std::string &buffer);
+		/**
+ 		 * \brief Append a YAML node to a buffer in the binary format.
+ 		 */
+		void append_node(std::string &buffer, const YAML::Node &node);
+
+		/**
+ 		 * \brief Append a value to a buffer in the binary format like the YAML node converted from it.
+ 		 *
+ 		 * Used by Serializable::emit_binary() of derived classes.
+ 		 */
+		inline void append_value(std::string &buffer, const std::string &value);
+		inline void append_value(std::string &buffer, const char *value);
+		template<class T> typename std::enable_if<std::is_arithmetic<T>::value>::type
+			append_value(std::string &buffer, const T &value);
+		inline void append_value(std::string &buffer, const Serializable &value);
+		template<class T> void append_value(std::string &buffer, const std::vector<T> &values);
+		template<class K, class V> void append_value(std::string &buffer, const std::map<K, V> &values);
+
+		inline void append_value(std::string &buffer, const std::string &value)
+		{
+			append_string(buffer, value.data(), value.size());
+		}
+		inline void append_value(std::string &buffer, const char *value)
+		{
+			append_string(buffer, value, std::char_traits<char>::length(value));
+		}
+		template<class T> typename std::enable_if<std::is_arithmetic<T>::value>::type
+			append_value(std::string &buffer, const T &value)
+		{
+			// Scalars are strings, formatted like by YAML::convert in the node returned by emit().
+			if (std::is_same<T, bool>::value)
+				append_value(buffer, value ? "true" : "false");
+			else if (std::is_integral<T>::value && sizeof(T) > 1)
+				append_value(buffer, std::to_string(value));
+			else
+				append_value(buffer, YAML::convert<T>::encode(value).Scalar());
+		}
+		inline void append_value(std::string &buffer, const Serializable &value)
+		{
+			value.emit_binary(buffer);
+		}
+		template<class T> void append_value(std::string &buffer, const std::vector<T> &values)
+		{
+			append_sequence_header(buffer, values.size());
+			for (const auto &value : values)
+				append_value(buffer, value);
+		}
+		template<class K, class V> void append_value(std::string &buffer, const std::map<K, V> &values)
+		{
+			append_map_header(buffer, values.size());
+			for (const auto &value : values) {
+				append_value(buffer, value.first);
+				append_value(buffer, value.second);
+			}
+		}
+
+		/**
+ 		 * \brief Reads the elements of a string in the binary format in place.
+ 		 *
+ 		 * Used by Serializable::load_binary() of derived classes to decode without building YAML nodes.
+ 		 * Copies read independently from the same position. Throws std::runtime_error on malformed input.
+ 		 */
+		class Reader
+		{
+		public:
+			enum class Kind { scalar, sequence, map, null };
+
+			/**
+ 			 * \brief Read str starting at pos, by default after the content type.
+ 			 */
+			Reader(const std::string &str, std::string::size_type pos = 1);
+
+			/**
+ 			 * \brief Read the header of the next element and the number of its bytes, elements or entries.
+ 			 */
+			Kind header(std::uint64_t &size);
+			/**
+ 			 * \brief Read the next element, which must be a scalar.
+ 			 *
+ 			 * \param size Is set to the size of the scalar.
+ 			 * \return Points to the scalar within the string, which is not null terminated.
+ 			 */
+			const char * scalar(std::size_t &size);
+			/**
+ 			 * \brief Read the content of a scalar whose header was read.
+ 			 */
+			const char * content(std::uint64_t size);
+			/**
+ 			 * \brief Read the header of the next element, which must be a sequence, and return its size.
+ 			 */
+			std::size_t sequence_header();
+			/**
+ 			 * \brief Skip the next element.
+ 			 */
+			void skip();
+			/**
+ 			 * \brief Skip the content of an element whose header was read.
+ 			 */
+			void skip(Kind kind, std::uint64_t size);
+			/**
+ 			 * \brief Decode the next element into a YAML node.
+ 			 */
+			YAML::Node node();
+			/**
+ 			 * \brief Check if the whole string was read.
+ 			 */
+			bool at_end() const;
+		private:
+			std::uint64_t read(unsigned int size);
+			void check(std::uint64_t size) const;
+
+			const std::string *str;
+			std::string::size_type pos;
+		};
+
+		/**
+ 		 * \brief Read a scalar of the mapping starting at the position of in without decoding it.
+ 		 *
+ 		 * in is copied, so it is not moved forward. See peek_scalar(const std::string &, ...).
+ 		 */
+		bool peek_scalar(Reader in, const std::string &key, std::string &value);
+
+		/**
+ 		 * \brief Compare a key read with Reader::scalar() to name.
+ 		 */
+		inline bool key_equals(const char *key, std::size_t size, const char *name)
+		{
+			return std::strlen(name) == size && std::memcmp(key, name, size) == 0;
+		}
+
+		/**
+ 		 * \brief Throw std::runtime_error if an entry required by load_binary() was not found.
+ 		 */
+		void require_entry(bool found, const char *key);
+
+		/**
+ 		 * \brief Read the entries of a mapping, calling entry(key, size) for each key.
+ 		 *
+ 		 * entry reads the value and returns true if it knows the key, otherwise the value is skipped.
+ 		 * A null element is read as empty mapping like looking up keys in a null node.
+ 		 */
+		template<class Entry> void read_map(Reader &in, Entry &&entry)
+		{
+			std::uint64_t entries;
+			auto kind = in.header(entries);
+			if (kind == Reader::Kind::null)
+				return;
+			if (kind != Reader::Kind::map)
+				throw std::runtime_error("Expected a mapping in binary format.");
+			for (std::uint64_t i = 0; i != entries; ++i) {
+				std::size_t size;
+				auto key = in.scalar(size);
+				if (!entry(key, size))
+					in.skip();
+			}
+		}
+
+		namespace detail
+		{
+			// Parse scalars as formatted by append_value(). Returns false for other formats,
+			// which are converted by yaml-cpp instead.
+			bool parse_scalar(const char *str, std::size_t size, bool &value);
+			bool parse_scalar(const char *str, std::size_t size, short &value);
+			bool parse_scalar(const char *str, std::size_t size, unsigned short &value);
+			bool parse_scalar(const char *str, std::size_t size, int &value);
+			bool parse_scalar(const char *str, std::size_t size, unsigned int &value);
+			bool parse_scalar(const char *str, std::size_t size, long &value);
+			bool parse_scalar(const char *str, std::size_t size, unsigned long &value);
+			bool parse_scalar(const char *str, std::size_t size, long long &value);
+			bool parse_scalar(const char *str, std::size_t size, unsigned long long &value);
+			bool parse_scalar(const char *str, std::size_t size, float &value);
+			bool parse_scalar(const char *str, std::size_t size, double &value);
+			template<class T> bool parse_scalar(const char *, std::size_t, T &)
+			{
+				return false;
+			}
+		}
+
+		/**
+ 		 * \brief Read a value written by append_value() like loading it from the YAML node converted from it.
+ 		 *
+ 		 * Used by Serializable::load_binary() of derived classes.
+ 		 */
+		inline void read_value(Reader &in, std::string &value);
+		template<class T> typename std::enable_if<std::is_arithmetic<T>::value>::type
+			read_value(Reader &in, T &value);
+		inline void read_value(Reader &in, Serializable &value);
+		template<class T> void read_value(Reader &in, std::vector<T> &values);
+		template<class T> void read_value(Reader &in, std::shared_ptr<T> &value);
+		template<class K, class V> void read_value(Reader &in, std::map<K, V> &values);
+
+		inline void read_value(Reader &in, std::string &value)
+		{
+			std::size_t size;
+			auto str = in.scalar(size);
+			value.assign(str, size);
+		}
+		template<class T> typename std::enable_if<std::is_arithmetic<T>::value>::type
+			read_value(Reader &in, T &value)
+		{
+			std::size_t size;
+			auto str = in.scalar(size);
+			if (!detail::parse_scalar(str, size, value))
+				value = YAML::Node(std::string(str, size)).as<T>();
+		}
+		inline void read_value(Reader &in, Serializable &value)
+		{
+			value.load_binary(in);
+		}
+		template<class T> void read_value(Reader &in, std::vector<T> &values)
+		{
+			std::vector<T> loaded(in.sequence_header());
+			for (auto &value : loaded)
+				read_value(in, value);
+			values = std::move(loaded);
+		}
+		template<class T> void read_value(Reader &in, std::shared_ptr<T> &value)
+		{
+			auto loaded = std::make_shared<T>();
+			read_value(in, *loaded);
+			value = std::move(loaded);
+		}
+		template<class K, class V> void read_value(Reader &in, std::map<K, V> &values)
+		{
+			std::uint64_t entries;
+			if (in.header(entries) != Reader::Kind::map)
+				throw std::runtime_error("Expected a mapping in binary format.");
+			std::map<K, V> loaded;
+			for (std::uint64_t i = 0; i != entries; ++i) {
+				K key;
+				read_value(in, key);
+				read_value(in, loaded[key]);
+			}
+			values = std::move(loaded);
+		}
+
+		/**
+ 		 * \brief Read the value of an entry if key matches name.
+ 		 *
+ 		 * \return True if the value was read.
+ 		 */
+		template<class T> bool read_entry(Reader &in, const char *key, std::size_t size, const char *name, T &value)
+		{
+			if (!key_equals(key, size, name))
+				return false;
+			read_value(in, value);
+			return true;
+		}
+	}
+
+	/**
+ 	 * \brief The wire format of messages of type T used by typed sending and receiving.
+ 	 *
+ 	 * The default encodes messages derived from Serializable as YAML like Serializable::to_string().
+ 	 * Specialize this template to use another wire format for a message type.
+ 	 */
+	template<class T> struct Message_codec
+	{
+		static_assert(std::is_base_of<Serializable, T>::value, "T is not derived from fast::Serializable");
+		/**
+ 		 * \brief Replace the content of buffer by the encoded message.
+ 		 */
+		static void encode(const T &msg, std::string &buffer)
+		{
+			yaml::to_string(msg, buffer);
+		}
+		/**
+ 		 * \brief Initialize message from the encoded buffer.
+ 		 */
+		static void decode(const std::string &buffer, T &msg)
+		{
+			msg.from_string(buffer);
+		}
+	};
+
+	/**
+ 	 * \brief A Message_codec using the binary wire format.
+ 	 *
+ 	 * High-rate links opt in per message type by deriving the specialization of Message_codec from it, e.g.:
+ 	 * template<> struct Message_codec<Task_container> : Binary_message_codec<Task_container> {};
+ 	 */
+	template<class T> struct Binary_message_codec
+	{
+		static_assert(std::is_base_of<Serializable, T>::value, "T is not derived from fast::Serializable");
+		/**
+ 		 * \brief Replace the content of buffer by the encoded message.
+ 		 */
+		static void encode(const T &msg, std::string &buffer)
+		{
+			binary::to_string(msg, buffer);
+		}
+		/**
+ 		 * \brief Initialize message from the encoded buffer.
+ 		 *
+ 		 * Accepts YAML as well.
+ 		 */
+		static void decode(const std::string &buffer, T &msg)
+		{
+			msg.from_string(buffer);
+		}
+	};
+
 	template<class T, class S> void load(T &var, const YAML::Node &node, const S &fallback)
 	{
 		if (node)
@@ -138,9 +598,34 @@ namespace yaml {
 	/**
  	 * \brief Merge two YAML nodes.
  	 *
- 	 * Uses this in emit to merge with emitted nodes from composed classes.
+ 	 * Adds the entries of rhs, which are not in lhs yet. Prefer Serializable::emit_into() in emit
+ 	 * over merging with emitted nodes from composed classes.
  	 */
 	void merge_node(YAML::Node &lhs, const YAML::Node &rhs);
 
+	/**
+ 	 * \brief Read a scalar of the top level mapping of a YAML string without parsing it.
+ 	 *
+ 	 * Scans the lines of the first document for "key: value" without indentation, as emitted by
+ 	 * Serializable::to_string(). Plain, single quoted and double quoted scalars on the same line are
+ 	 * supported, followed by an optional comment. Escape sequences in double quoted scalars are decoded
+ 	 * like yaml-cpp does; the key is not found if a sequence is invalid.
+ 	 * Use this to cheaply inspect messages, e.g., to read the id of a Task_container.
+ 	 * \param str The YAML string to scan.
+ 	 * \param key The key of the scalar in the top level mapping.
+ 	 * \param value Is set to the scalar if found.
+ 	 * \return True if the key was found with a scalar value.
+ 	 */
+	bool peek_scalar(const std::string &str, const std::string &key, std::string &value);
+
 }
+
+	/**
+ 	 * \brief Read a scalar of the top level mapping of a message in YAML or the binary format.
+ 	 *
+ 	 * Detects the content type like Serializable::from_string() and uses yaml::peek_scalar() or
+ 	 * binary::peek_scalar() accordingly.
+ 	 */
+	bool peek_scalar(const std::string &str, const std::string &key, std::string &value);
+
 }
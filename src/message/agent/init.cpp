@@ -11,15 +11,27 @@ init::init(std::string hostname) :
 
 YAML::Node init::emit() const
 {
-	YAML::Node node;
-	node["task"] = "init";
-	node["hostname"] = hostname;
-	return node;
+	return fast::fields::emit(*this);
 }
 
 void init::load(const YAML::Node &node)
 {
-	fast::load(hostname, node["hostname"]);
+	fast::fields::load(*this, node);
+}
+
+void init::emit_binary(std::string &buffer) const
+{
+	fast::fields::emit_binary(*this, buffer);
+}
+
+void init::load_binary(fast::binary::Reader &in)
+{
+	fast::fields::load_binary(*this, in);
+}
+
+bool init::operator==(const init &rhs) const
+{
+	return fast::fields::equal(*this, rhs);
 }
 
 }
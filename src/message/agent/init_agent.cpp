@@ -16,20 +16,27 @@ kpis::kpis(std::map<std::string, std::string> categories, unsigned int kpi_repea
 
 YAML::Node kpis::emit() const
 {
-	YAML::Node node;
-	YAML::Node cat;
-	for (auto &p : categories) {
-		cat[p.first] = p.second;
-	}
-	node["categories"] = cat;
-	node["repeat"] = kpi_repeat;
-	return node;
+	return fast::fields::emit(*this);
 }
 
 void kpis::load(const YAML::Node &node)
 {
-	fast::load(kpi_repeat, node["repeat"]);
-	fast::load(categories, node["categories"]);
+	fast::fields::load(*this, node);
+}
+
+void kpis::emit_binary(std::string &buffer) const
+{
+	fast::fields::emit_binary(*this, buffer);
+}
+
+void kpis::load_binary(fast::binary::Reader &in)
+{
+	fast::fields::load_binary(*this, in);
+}
+
+bool kpis::operator==(const kpis &rhs) const
+{
+	return fast::fields::equal(*this, rhs);
 }
 
 //
@@ -43,16 +50,27 @@ init_agent::init_agent(std::map<std::string, std::string> categories, unsigned i
 
 YAML::Node init_agent::emit() const
 {
-	YAML::Node node;
-	node["task"] = "init agent";
-	node["KPI"] = KPIs.emit();
-	return node;
+	return fast::fields::emit(*this);
 }
 
 void init_agent::load(const YAML::Node &node)
 {
-	fast::load(KPIs.kpi_repeat, node["KPI"]["repeat"]);
-	fast::load(KPIs.categories, node["KPI"]["categories"]);
+	fast::fields::load(*this, node);
+}
+
+void init_agent::emit_binary(std::string &buffer) const
+{
+	fast::fields::emit_binary(*this, buffer);
+}
+
+void init_agent::load_binary(fast::binary::Reader &in)
+{
+	fast::fields::load_binary(*this, in);
+}
+
+bool init_agent::operator==(const init_agent &rhs) const
+{
+	return fast::fields::equal(*this, rhs);
 }
 
 }
@@ -16,6 +16,16 @@ void ack::load(const YAML::Node &/*node*/)
 {
 }
 
+void ack::emit_binary(std::string &buffer) const
+{
+	fast::binary::append_null(buffer);
+}
+
+void ack::load_binary(fast::binary::Reader &in)
+{
+	in.skip();
+}
+
 }
 }
 }
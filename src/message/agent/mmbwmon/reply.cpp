@@ -11,16 +11,27 @@ reply::reply(const std::vector<size_t> &_cores, double _result) : cores(_cores),
 
 YAML::Node reply::emit() const
 {
-	YAML::Node node;
-	node["cores"] = cores;
-	node["result"] = result;
-	return node;
+	return fast::fields::emit(*this);
 }
 
 void reply::load(const YAML::Node &node)
 {
-	fast::load(cores, node["cores"]);
-	fast::load(result, node["result"]);
+	fast::fields::load(*this, node);
+}
+
+void reply::emit_binary(std::string &buffer) const
+{
+	fast::fields::emit_binary(*this, buffer);
+}
+
+void reply::load_binary(fast::binary::Reader &in)
+{
+	fast::fields::load_binary(*this, in);
+}
+
+bool reply::operator==(const reply &rhs) const
+{
+	return fast::fields::equal(*this, rhs);
 }
 
 }
@@ -11,14 +11,27 @@ request::request(const std::vector<size_t> &_cores) : cores(_cores)
 
 YAML::Node request::emit() const
 {
-	YAML::Node node;
-	node["cores"] = cores;
-	return node;
+	return fast::fields::emit(*this);
 }
 
 void request::load(const YAML::Node &node)
 {
-	fast::load(cores, node["cores"]);
+	fast::fields::load(*this, node);
+}
+
+void request::emit_binary(std::string &buffer) const
+{
+	fast::fields::emit_binary(*this, buffer);
+}
+
+void request::load_binary(fast::binary::Reader &in)
+{
+	fast::fields::load_binary(*this, in);
+}
+
+bool request::operator==(const request &rhs) const
+{
+	return fast::fields::equal(*this, rhs);
 }
 
 }
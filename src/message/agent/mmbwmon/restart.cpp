@@ -11,14 +11,27 @@ restart::restart(const std::string _cgroup) : cgroup(_cgroup)
 
 YAML::Node restart::emit() const
 {
-	YAML::Node node;
-	node["cgroup"] = cgroup;
-	return node;
+	return fast::fields::emit(*this);
 }
 
 void restart::load(const YAML::Node &node)
 {
-	fast::load(cgroup, node["cgroup"]);
+	fast::fields::load(*this, node);
+}
+
+void restart::emit_binary(std::string &buffer) const
+{
+	fast::fields::emit_binary(*this, buffer);
+}
+
+void restart::load_binary(fast::binary::Reader &in)
+{
+	fast::fields::load_binary(*this, in);
+}
+
+bool restart::operator==(const restart &rhs) const
+{
+	return fast::fields::equal(*this, rhs);
 }
 
 }
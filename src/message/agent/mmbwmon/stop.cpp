@@ -11,14 +11,27 @@ stop::stop(const std::string _cgroup) : cgroup(_cgroup)
 
 YAML::Node stop::emit() const
 {
-	YAML::Node node;
-	node["cgroup"] = cgroup;
-	return node;
+	return fast::fields::emit(*this);
 }
 
 void stop::load(const YAML::Node &node)
 {
-	fast::load(cgroup, node["cgroup"]);
+	fast::fields::load(*this, node);
+}
+
+void stop::emit_binary(std::string &buffer) const
+{
+	fast::fields::emit_binary(*this, buffer);
+}
+
+void stop::load_binary(fast::binary::Reader &in)
+{
+	fast::fields::load_binary(*this, in);
+}
+
+bool stop::operator==(const stop &rhs) const
+{
+	return fast::fields::equal(*this, rhs);
 }
 
 }
@@ -11,20 +11,27 @@ system_info::system_info(const size_t _threads, const size_t _smt, const size_t
 
 YAML::Node system_info::emit() const
 {
-	YAML::Node node;
-	node["threads"] = threads;
-	node["smt"] = smt;
-	node["numa"] = numa;
-	node["bandwidth"] = membw;
-	return node;
+	return fast::fields::emit(*this);
 }
 
 void system_info::load(const YAML::Node &node)
 {
-	fast::load(threads, node["threads"]);
-	fast::load(smt, node["smt"]);
-	fast::load(numa, node["numa"]);
-	fast::load(membw, node["bandwidth"]);
+	fast::fields::load(*this, node);
+}
+
+void system_info::emit_binary(std::string &buffer) const
+{
+	fast::fields::emit_binary(*this, buffer);
+}
+
+void system_info::load_binary(fast::binary::Reader &in)
+{
+	fast::fields::load_binary(*this, in);
+}
+
+bool system_info::operator==(const system_info &rhs) const
+{
+	return fast::fields::equal(*this, rhs);
 }
 
 }
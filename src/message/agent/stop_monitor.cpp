@@ -16,16 +16,27 @@ job_description::job_description(std::string job_id, unsigned int process_id) :
 
 YAML::Node job_description::emit() const
 {
-	YAML::Node node;
-	node["job-id"] = job_id;
-	node["process-id"] = process_id;
-	return node;
+	return fast::fields::emit(*this);
 }
 
 void job_description::load(const YAML::Node &node)
 {
-	fast::load(job_id, node["job-id"]);
-	fast::load(process_id, node["process-id"]);
+	fast::fields::load(*this, node);
+}
+
+void job_description::emit_binary(std::string &buffer) const
+{
+	fast::fields::emit_binary(*this, buffer);
+}
+
+void job_description::load_binary(fast::binary::Reader &in)
+{
+	fast::fields::load_binary(*this, in);
+}
+
+bool job_description::operator==(const job_description &rhs) const
+{
+	return fast::fields::equal(*this, rhs);
 }
 
 //
@@ -39,16 +50,27 @@ stop_monitoring::stop_monitoring(std::string job_id, unsigned int process_id) :
 
 YAML::Node stop_monitoring::emit() const
 {
-	YAML::Node node;
-	node["task"] = "stop monitoring";
-	node["job-description"] = job_desc.emit();
-	return node;
+	return fast::fields::emit(*this);
 }
 
 void stop_monitoring::load(const YAML::Node &node)
 {
-	fast::load(job_desc.job_id, node["job-description"]["job-id"]);
-	fast::load(job_desc.process_id, node["job-description"]["process-id"]);
+	fast::fields::load(*this, node);
+}
+
+void stop_monitoring::emit_binary(std::string &buffer) const
+{
+	fast::fields::emit_binary(*this, buffer);
+}
+
+void stop_monitoring::load_binary(fast::binary::Reader &in)
+{
+	fast::fields::load_binary(*this, in);
+}
+
+bool stop_monitoring::operator==(const stop_monitoring &rhs) const
+{
+	return fast::fields::equal(*this, rhs);
 }
 
 }
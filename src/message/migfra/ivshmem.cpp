@@ -13,8 +13,7 @@ namespace msg {
 namespace migfra {
 
 Device_ivshmem::Device_ivshmem() :
-	size("0"),
-	path("path")
+	size("0")
 {
 }
 
@@ -23,10 +22,19 @@ YAML::Node Device_ivshmem::emit() const
 	YAML::Node node;
 	node["id"] = id;
 	node["size"] = size;
-	fast::yaml::merge_node(node, path.emit());
+	path.emit_into(node);
 	return node;
 }
 
+void Device_ivshmem::emit_stream(YAML::Emitter &out) const
+{
+	out << YAML::BeginMap;
+	out << YAML::Key << "id" << YAML::Value << id;
+	out << YAML::Key << "size" << YAML::Value << size;
+	path.emit_entry(out);
+	out << YAML::EndMap;
+}
+
 void Device_ivshmem::load(const YAML::Node &node)
 {
 	fast::load(id, node["id"]);
@@ -34,6 +42,30 @@ void Device_ivshmem::load(const YAML::Node &node)
 	path.load(node);
 }
 
+void Device_ivshmem::emit_binary(std::string &buffer) const
+{
+	fast::binary::append_map_header(buffer, 2 + path.is_valid());
+	fast::binary::append_value(buffer, "id");
+	fast::binary::append_value(buffer, id);
+	fast::binary::append_value(buffer, "size");
+	fast::binary::append_value(buffer, size);
+	path.append_entry(buffer);
+}
+
+void Device_ivshmem::load_binary(fast::binary::Reader &in)
+{
+	bool has_id = false, has_size = false;
+	fast::binary::read_map(in, [&](const char *key, std::size_t key_size) {
+		if (fast::binary::read_entry(in, key, key_size, "id", id))
+			return has_id = true;
+		if (fast::binary::read_entry(in, key, key_size, "size", size))
+			return has_size = true;
+		return path.load_entry(in, key, key_size);
+	});
+	fast::binary::require_entry(has_id, "id");
+	fast::binary::require_entry(has_size, "size");
+}
+
 }
 }
 }
@@ -50,17 +50,17 @@ namespace fast {
 				return node;
 			}
 
-			void PCI_addr::load(const YAML::Node &node)
+			// Parses "[domain:]bus:device.function" in hex format.
+			static void parse_pci_addr(PCI_addr &addr, std::string pci_str)
 			{
-				std::string pci_str = node["pci-addr"].as<std::string>();
 				size_t token_pos;
 				switch (std::count(pci_str.begin(), pci_str.end(), ':')) {
 					case 1: 
-						domain = 0;
+						addr.domain = 0;
 						break;
 					case 2: 
 						token_pos = pci_str.find(":");
-						domain = std::stoul(pci_str.substr(0, token_pos), nullptr, 16);
+						addr.domain = std::stoul(pci_str.substr(0, token_pos), nullptr, 16);
 						pci_str.erase(0, pci_str.find(":") + 1); // Remove Domain
 						break;
 					default:
@@ -68,14 +68,44 @@ namespace fast {
 				}
 
 				token_pos = pci_str.find(":");
-				bus = std::stoul(pci_str.substr(0, token_pos), nullptr, 16);
+				addr.bus = std::stoul(pci_str.substr(0, token_pos), nullptr, 16);
 				pci_str.erase(0, token_pos + 1); // Remove Bus
 
 				token_pos = pci_str.find(".");
-				device = std::stoul(pci_str.substr(0, token_pos), nullptr, 16);
+				addr.device = std::stoul(pci_str.substr(0, token_pos), nullptr, 16);
 				pci_str.erase(0, token_pos + 1); // Remove Device
 
-				funct = std::stoul(pci_str, nullptr, 16);
+				addr.funct = std::stoul(pci_str, nullptr, 16);
+			}
+
+			void PCI_addr::load(const YAML::Node &node)
+			{
+				parse_pci_addr(*this, node["pci-addr"].as<std::string>());
+			}
+
+			void PCI_addr::emit_stream(YAML::Emitter &out) const
+			{
+				out << YAML::BeginMap << YAML::Key << "addr" << YAML::Value << str() << YAML::EndMap;
+			}
+
+			void PCI_addr::emit_binary(std::string &buffer) const
+			{
+				fast::binary::append_map_header(buffer, 1);
+				fast::binary::append_value(buffer, "addr");
+				fast::binary::append_value(buffer, str());
+			}
+
+			void PCI_addr::load_binary(fast::binary::Reader &in)
+			{
+				std::string pci_str;
+				bool has_pci_str = false;
+				fast::binary::read_map(in, [&](const char *key, std::size_t size) {
+					if (fast::binary::read_entry(in, key, size, "pci-addr", pci_str))
+						return has_pci_str = true;
+					return false;
+				});
+				fast::binary::require_entry(has_pci_str, "pci-addr");
+				parse_pci_addr(*this, std::move(pci_str));
 			}
 
 			std::ostream & operator<<(std::ostream &os, const PCI_addr &rhs)
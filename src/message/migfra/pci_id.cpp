@@ -67,6 +67,40 @@ void PCI_id::load(const YAML::Node &node)
 	device = static_cast<device_t>(std::stoul(node["device"].as<std::string>(), nullptr, 0));
 }
 
+void PCI_id::emit_binary(std::string &buffer) const
+{
+	fast::binary::append_map_header(buffer, 2);
+	fast::binary::append_value(buffer, "vendor");
+	fast::binary::append_value(buffer, vendor_hex());
+	fast::binary::append_value(buffer, "device");
+	fast::binary::append_value(buffer, device_hex());
+}
+
+void PCI_id::load_binary(fast::binary::Reader &in)
+{
+	std::string vendor_str, device_str;
+	bool has_vendor = false, has_device = false;
+	fast::binary::read_map(in, [&](const char *key, std::size_t size) {
+		if (fast::binary::read_entry(in, key, size, "vendor", vendor_str))
+			return has_vendor = true;
+		if (fast::binary::read_entry(in, key, size, "device", device_str))
+			return has_device = true;
+		return false;
+	});
+	fast::binary::require_entry(has_vendor, "vendor");
+	fast::binary::require_entry(has_device, "device");
+	vendor = static_cast<vendor_t>(std::stoul(vendor_str, nullptr, 0));
+	device = static_cast<device_t>(std::stoul(device_str, nullptr, 0));
+}
+
+void PCI_id::emit_stream(YAML::Emitter &out) const
+{
+	out << YAML::BeginMap;
+	out << YAML::Key << "vendor" << YAML::Value << vendor_hex();
+	out << YAML::Key << "device" << YAML::Value << device_hex();
+	out << YAML::EndMap;
+}
+
 std::ostream & operator<<(std::ostream &os, const PCI_id &rhs)
 {
 	return os << rhs.str();
@@ -29,14 +29,36 @@ YAML::Node Result_container::emit() const
 	YAML::Node node;
 	node["result"] = title;
 	if (title == "vm migrated")
-		fast::yaml::merge_node(node, results.at(0).emit());
+		results.at(0).emit_into(node);
 	else
-		node["list"] = results;
+		node["list"] = fast::parallel::emit(results, parallel);
 	if (id != "")
 		node["id"] = id;
 	return node;
 }
 
+void Result_container::emit_binary(std::string &buffer) const
+{
+	// Same entries as emit(), counted while appending them.
+	auto pos = buffer.size();
+	std::size_t entries = 1;
+	fast::binary::append_value(buffer, "result");
+	fast::binary::append_value(buffer, title);
+	if (title == "vm migrated") {
+		entries += results.at(0).append_entries(buffer);
+	} else {
+		fast::binary::append_value(buffer, "list");
+		fast::parallel::append_value(buffer, results, parallel);
+		++entries;
+	}
+	if (id != "") {
+		fast::binary::append_value(buffer, "id");
+		fast::binary::append_value(buffer, id);
+		++entries;
+	}
+	fast::binary::insert_map_header(buffer, pos, entries);
+}
+
 void Result_container::load(const YAML::Node &node)
 {
 	fast::load(title, node["result"]);
@@ -44,11 +66,34 @@ void Result_container::load(const YAML::Node &node)
 		results.emplace_back();
 		fast::load(results[0], node);
 	} else {
-		fast::load(results, node["list"]);
+		fast::parallel::load(results, node["list"], parallel);
 	}
 	fast::load(id, node["id"], "");
 }
 
+void Result_container::load_binary(fast::binary::Reader &in)
+{
+	// The title decides how the other entries are read, so look it up first.
+	if (!fast::binary::peek_scalar(in, "result", title))
+		fast::binary::require_entry(false, "result");
+	if (title == "vm migrated") {
+		results.emplace_back();
+		auto entries = in;
+		results[0].load_binary(entries);
+	}
+	bool has_list = false;
+	id.clear();
+	fast::binary::read_map(in, [&](const char *key, std::size_t size) {
+		if (title != "vm migrated" && fast::binary::key_equals(key, size, "list")) {
+			fast::parallel::load(results, in, parallel);
+			return has_list = true;
+		}
+		return fast::binary::read_entry(in, key, size, "id", id);
+	});
+	if (title != "vm migrated")
+		fast::binary::require_entry(has_list, "list");
+}
+
 Result::Result(std::string vm_name, std::string status, std::string details) :
 	vm_name(std::move(vm_name)),
 	status(std::move(status)),
@@ -64,6 +109,32 @@ Result::Result(std::string vm_name, std::string status, Time_measurement time_me
 {
 }
 
+void Result::emit_binary(std::string &buffer) const
+{
+	auto pos = buffer.size();
+	fast::binary::insert_map_header(buffer, pos, append_entries(buffer));
+}
+
+std::size_t Result::append_entries(std::string &buffer) const
+{
+	fast::binary::append_value(buffer, "vm-name");
+	fast::binary::append_value(buffer, vm_name);
+	fast::binary::append_value(buffer, "status");
+	fast::binary::append_value(buffer, status);
+	std::size_t entries = 2;
+	if (details != "") {
+		fast::binary::append_value(buffer, "details");
+		fast::binary::append_value(buffer, details);
+		++entries;
+	}
+	if (!time_measurement.empty()) {
+		fast::binary::append_value(buffer, "time-measurement");
+		fast::binary::append_value(buffer, time_measurement);
+		++entries;
+	}
+	return entries;
+}
+
 YAML::Node Result::emit() const
 {
 	YAML::Node node;
@@ -83,6 +154,22 @@ void Result::load(const YAML::Node &node)
 	fast::load(details, node["details"], "");
 }
 
+void Result::load_binary(fast::binary::Reader &in)
+{
+	// Like load(), the time measurement is not loaded.
+	bool has_vm_name = false, has_status = false;
+	details.clear();
+	fast::binary::read_map(in, [&](const char *key, std::size_t size) {
+		if (fast::binary::read_entry(in, key, size, "vm-name", vm_name))
+			return has_vm_name = true;
+		if (fast::binary::read_entry(in, key, size, "status", status))
+			return has_status = true;
+		return fast::binary::read_entry(in, key, size, "details", details);
+	});
+	fast::binary::require_entry(has_vm_name, "vm-name");
+	fast::binary::require_entry(has_status, "status");
+}
+
 }
 }
 }
@@ -10,9 +10,6 @@
 
 #include <iostream>
 
-// Alias merge_node function
-const auto &merge_node = fast::yaml::merge_node;
-
 namespace fast {
 namespace msg {
 namespace migfra {
@@ -21,29 +18,30 @@ namespace migfra {
 // Task implementation
 //
 
-Task::Task() :
-	concurrent_execution("concurrent-execution"),
-	time_measurement("time-measurement"),
-	driver("driver")
+Task::Task()
 {
 }
 
 Task::Task(bool concurrent_execution, bool time_measurement) :
-	concurrent_execution("concurrent-execution", concurrent_execution),
-	time_measurement("time-measurement", time_measurement),
-	driver("driver")
+	concurrent_execution(concurrent_execution),
+	time_measurement(time_measurement)
 {
 }
 
 YAML::Node Task::emit() const
 {
 	YAML::Node node;
-	merge_node(node, concurrent_execution.emit());
-	merge_node(node, time_measurement.emit());
-	merge_node(node, driver.emit());
+	emit_into(node);
 	return node;
 }
 
+void Task::emit_into(YAML::Node &node) const
+{
+	concurrent_execution.emit_into(node);
+	time_measurement.emit_into(node);
+	driver.emit_into(node);
+}
+
 void Task::load(const YAML::Node &node)
 {
 	concurrent_execution.load(node);
@@ -51,20 +49,74 @@ void Task::load(const YAML::Node &node)
 	driver.load(node);
 }
 
+void Task::emit_stream(YAML::Emitter &out) const
+{
+	if (!has_entries()) {
+		out << YAML::Null;
+		return;
+	}
+	out << YAML::BeginMap;
+	emit_entries(out);
+	out << YAML::EndMap;
+}
+
+void Task::emit_entries(YAML::Emitter &out) const
+{
+	concurrent_execution.emit_entry(out);
+	time_measurement.emit_entry(out);
+	driver.emit_entry(out);
+}
+
+bool Task::has_entries() const
+{
+	return concurrent_execution || time_measurement || driver;
+}
+
+void Task::emit_binary(std::string &buffer) const
+{
+	// Like emit(), a task without entries is null.
+	auto pos = buffer.size();
+	auto entries = append_entries(buffer);
+	if (entries == 0)
+		fast::binary::append_null(buffer);
+	else
+		fast::binary::insert_map_header(buffer, pos, entries);
+}
+
+void Task::load_binary(fast::binary::Reader &in)
+{
+	fast::binary::read_map(in, [&](const char *key, std::size_t size) {
+		return load_entry(in, key, size);
+	});
+}
+
+std::size_t Task::append_entries(std::string &buffer) const
+{
+	std::size_t entries = concurrent_execution.append_entry(buffer);
+	entries += time_measurement.append_entry(buffer);
+	entries += driver.append_entry(buffer);
+	return entries;
+}
+
+bool Task::load_entry(fast::binary::Reader &in, const char *key, std::size_t size)
+{
+	return concurrent_execution.load_entry(in, key, size) ||
+		time_measurement.load_entry(in, key, size) ||
+		driver.load_entry(in, key, size);
+}
+
 //
 // Task_container implementation
 //
 
-Task_container::Task_container() :
-	concurrent_execution("concurrent-execution"),
-	id("id")
+Task_container::Task_container()
 {
 }
 
 Task_container::Task_container(std::vector<std::shared_ptr<Task>> tasks, bool concurrent_execution, std::string id) :
 	tasks(std::move(tasks)),
-	concurrent_execution("concurrent-execution", concurrent_execution),
-	id("id", std::move(id))
+	concurrent_execution(concurrent_execution),
+	id(std::move(id))
 {
 }
 
@@ -98,6 +150,17 @@ std::string Task_container::type(bool enable_result_format) const
 
 }
 
+Task_container::Header Task_container::peek_header(const std::string &str)
+{
+	Header header;
+	if (!fast::peek_scalar(str, "task", header.task))
+		throw Task_container::no_task_exception("Cannot find key \"task\" to peek at Task_container.");
+	std::string id;
+	if (fast::peek_scalar(str, header.id.get_tag(), id))
+		header.id = std::move(id);
+	return header;
+}
+
 
 YAML::Node Task_container::emit() const
 {
@@ -105,38 +168,81 @@ YAML::Node Task_container::emit() const
 	auto type_str = type();
 	node["task"] = type_str;
 	if (type_str == "migrate vm") {
-		merge_node(node, tasks.front()->emit());
+		tasks.front()->emit_into(node);
 	} else if (type_str == "evacuate node") {
-		merge_node(node, tasks.front()->emit());
+		tasks.front()->emit_into(node);
 	} else if (type_str == "repin vm") {
-		merge_node(node, tasks.front()->emit());
+		tasks.front()->emit_into(node);
 	} else if (type_str == "start vm") {
-		node["vm-configurations"] = tasks;
+		node["vm-configurations"] = fast::parallel::emit(tasks, parallel);
 	} else {
-		node["list"] = tasks;
+		node["list"] = fast::parallel::emit(tasks, parallel);
 	}
-	merge_node(node, concurrent_execution.emit());
-	merge_node(node, id.emit());
+	concurrent_execution.emit_into(node);
+	id.emit_into(node);
 	return node;
 }
 
+void Task_container::emit_stream(YAML::Emitter &out) const
+{
+	auto type_str = type();
+	out << YAML::BeginMap;
+	out << YAML::Key << "task" << YAML::Value << type_str;
+	bool merged = type_str == "migrate vm" || type_str == "evacuate node" || type_str == "repin vm";
+	if (merged) {
+		tasks.front()->emit_entries(out);
+	} else {
+		out << YAML::Key << (type_str == "start vm" ? "vm-configurations" : "list") << YAML::Value;
+		// Streaming stays sequential, as an emitter can not be split into chunks.
+		fast::yaml::stream(out, tasks);
+	}
+	// Entries of the merged task take precedence as in emit().
+	if (!merged || !tasks.front()->concurrent_execution.is_valid())
+		concurrent_execution.emit_entry(out);
+	id.emit_entry(out);
+	out << YAML::EndMap;
+}
+
+void Task_container::emit_binary(std::string &buffer) const
+{
+	// Same entries as emit(), counted while appending them.
+	auto type_str = type();
+	auto pos = buffer.size();
+	std::size_t entries = 1;
+	fast::binary::append_value(buffer, "task");
+	fast::binary::append_value(buffer, type_str);
+	bool merged = type_str == "migrate vm" || type_str == "evacuate node" || type_str == "repin vm";
+	if (merged) {
+		entries += tasks.front()->append_entries(buffer);
+	} else {
+		fast::binary::append_value(buffer, type_str == "start vm" ? "vm-configurations" : "list");
+		fast::parallel::append_value(buffer, tasks, parallel);
+		++entries;
+	}
+	// Entries of the merged task take precedence as in emit().
+	if (!merged || !tasks.front()->concurrent_execution.is_valid())
+		entries += concurrent_execution.append_entry(buffer);
+	entries += id.append_entry(buffer);
+	fast::binary::insert_map_header(buffer, pos, entries);
+}
+
 // Implemented here to allow the compiler to place the vtable in
 // this compilation unit. Would be emitted in every compilation
 // unit otherwise.
 Task_container::no_task_exception::no_task_exception(const std::string &str)
 	: std::runtime_error(str) {}
 
-static std::vector<std::shared_ptr<Task>> load_start_task(const YAML::Node &node)
+static std::vector<std::shared_ptr<Task>> load_start_task(const YAML::Node &node, const fast::Parallel_options &parallel)
 {
 	std::vector<std::shared_ptr<Start>> tasks;
-	fast::load(tasks, node["vm-configurations"]);
+	fast::parallel::load(tasks, node["vm-configurations"], parallel);
 	return std::vector<std::shared_ptr<Task>>(tasks.begin(), tasks.end());
 }
 
-static std::vector<std::shared_ptr<Task>> load_stop_task(const YAML::Node &node)
+static std::vector<std::shared_ptr<Task>> load_stop_task(const YAML::Node &node, const fast::Parallel_options &parallel)
 {
 	std::vector<std::shared_ptr<Stop>> tasks;
-	fast::load(tasks, node["list"]);
+	fast::parallel::load(tasks, node["list"], parallel);
 	return std::vector<std::shared_ptr<Task>>(tasks.begin(), tasks.end());
 }
 
@@ -161,17 +267,17 @@ static std::vector<std::shared_ptr<Task>> load_repin_task(const YAML::Node &node
 	return std::vector<std::shared_ptr<Task>>(1, repin_task);
 }
 
-static std::vector<std::shared_ptr<Task>> load_suspend_task(const YAML::Node &node)
+static std::vector<std::shared_ptr<Task>> load_suspend_task(const YAML::Node &node, const fast::Parallel_options &parallel)
 {
 	std::vector<std::shared_ptr<Suspend>> tasks;
-	fast::load(tasks, node["list"]);
+	fast::parallel::load(tasks, node["list"], parallel);
 	return std::vector<std::shared_ptr<Task>>(tasks.begin(), tasks.end());
 }
 
-static std::vector<std::shared_ptr<Task>> load_resume_task(const YAML::Node &node)
+static std::vector<std::shared_ptr<Task>> load_resume_task(const YAML::Node &node, const fast::Parallel_options &parallel)
 {
 	std::vector<std::shared_ptr<Resume>> tasks;
-	fast::load(tasks, node["list"]);
+	fast::parallel::load(tasks, node["list"], parallel);
 	return std::vector<std::shared_ptr<Task>>(tasks.begin(), tasks.end());
 }
 
@@ -182,6 +288,21 @@ static std::vector<std::shared_ptr<Task>> load_quit_task(const YAML::Node &node)
 	return std::vector<std::shared_ptr<Task>>(1, quit_task);
 }
 
+template<class T> static std::vector<std::shared_ptr<Task>> load_tasks(fast::binary::Reader &in, const fast::Parallel_options &parallel)
+{
+	std::vector<std::shared_ptr<T>> tasks;
+	fast::parallel::load(tasks, in, parallel);
+	return std::vector<std::shared_ptr<Task>>(tasks.begin(), tasks.end());
+}
+
+// Load a task merged into the mapping of its container without moving in forward.
+template<class T> static std::vector<std::shared_ptr<Task>> load_merged_task(fast::binary::Reader in)
+{
+	auto task = std::make_shared<T>();
+	task->load_binary(in);
+	return std::vector<std::shared_ptr<Task>>(1, task);
+}
+
 void Task_container::load(const YAML::Node &node)
 {
 	std::string type;
@@ -191,9 +312,9 @@ void Task_container::load(const YAML::Node &node)
 		throw Task_container::no_task_exception("Cannot find key \"task\" to load Task from YAML.");
 	}
 	if (type == "start vm") {
-		tasks = load_start_task(node);
+		tasks = load_start_task(node, parallel);
 	} else if (type == "stop vm") {
-		tasks = load_stop_task(node);
+		tasks = load_stop_task(node, parallel);
 	} else if (type == "migrate vm") {
 		tasks = load_migrate_task(node);
 	} else if (type == "evacuate node") {
@@ -201,9 +322,9 @@ void Task_container::load(const YAML::Node &node)
 	} else if (type == "repin vm") {
 		tasks = load_repin_task(node);
 	} else if (type == "suspend vm") {
-		tasks = load_suspend_task(node);
+		tasks = load_suspend_task(node, parallel);
 	} else if (type == "resume vm") {
-		tasks = load_resume_task(node);
+		tasks = load_resume_task(node, parallel);
 	} else if (type == "quit") {
 		tasks = load_quit_task(node);
 	} else {
@@ -213,80 +334,96 @@ void Task_container::load(const YAML::Node &node)
 	id.load(node);
 }
 
+void Task_container::load_binary(fast::binary::Reader &in)
+{
+	// The type decides how the other entries are read, so look it up first.
+	std::string type;
+	if (!fast::binary::peek_scalar(in, "task", type))
+		throw Task_container::no_task_exception("Cannot find key \"task\" to load Task from binary format.");
+	const char *list_key = nullptr;
+	std::vector<std::shared_ptr<Task>> (*load_list)(fast::binary::Reader &, const fast::Parallel_options &) = nullptr;
+	if (type == "start vm") {
+		list_key = "vm-configurations";
+		load_list = load_tasks<Start>;
+	} else if (type == "stop vm") {
+		list_key = "list";
+		load_list = load_tasks<Stop>;
+	} else if (type == "migrate vm") {
+		tasks = load_merged_task<Migrate>(in);
+	} else if (type == "evacuate node") {
+		tasks = load_merged_task<Evacuate>(in);
+	} else if (type == "repin vm") {
+		tasks = load_merged_task<Repin>(in);
+	} else if (type == "suspend vm") {
+		list_key = "list";
+		load_list = load_tasks<Suspend>;
+	} else if (type == "resume vm") {
+		list_key = "list";
+		load_list = load_tasks<Resume>;
+	} else if (type == "quit") {
+		tasks = load_merged_task<Quit>(in);
+	} else {
+		throw std::runtime_error("Unknown type of Task while loading.");
+	}
+	bool has_list = false;
+	fast::binary::read_map(in, [&](const char *key, std::size_t size) {
+		if (list_key && fast::binary::key_equals(key, size, list_key)) {
+			tasks = load_list(in, parallel);
+			return has_list = true;
+		}
+		return concurrent_execution.load_entry(in, key, size) || id.load_entry(in, key, size);
+	});
+	if (list_key)
+		fast::binary::require_entry(has_list, list_key);
+}
+
 //
 // Start implementation
 //
 
-Start::Start() :
-	vm_name("vm-name"),
-	vcpus("vcpus"),
-	memory("memory"),
-	memnode_map("memnode-map"),
-	xml("xml"),
-	ivshmem("ivshmem"),
-	transient("transient"),
-	vcpu_map("vcpu-map"),
-	probe_with_ssh("probe-with-ssh"),
-	probe_hostname("probe-hostname")
+Start::Start()
 {
 }
 
 Start::Start(std::string vm_name, unsigned int vcpus, unsigned long memory, std::vector<PCI_id> pci_ids, std::vector<PCI_addr> pci_addrs, bool concurrent_execution) :
 	Task::Task(concurrent_execution),
-	vm_name("vm-name", std::move(vm_name)),
-	vcpus("vcpus", vcpus),
-	memory("memory", memory),
-	memnode_map("memnode-map"),
+	vm_name(std::move(vm_name)),
+	vcpus(vcpus),
+	memory(memory),
 	pci_ids(std::move(pci_ids)),
-	pci_addrs(std::move(pci_addrs)),
-	xml("xml"),
-	ivshmem("ivshmem"),
-	transient("transient"),
-	vcpu_map("vcpu-map"),
-	probe_with_ssh("probe-with-ssh"),
-	probe_hostname("probe-hostname")
+	pci_addrs(std::move(pci_addrs))
 {
 }
 
 Start::Start(std::string xml, std::vector<PCI_id> pci_ids, std::vector<PCI_addr> pci_addrs, bool concurrent_execution) :
 	Task::Task(concurrent_execution),
-	vm_name("vm-name"),
-	vcpus("vcpus"),
-	memory("memory"),
-	memnode_map("memnode-map"),
 	pci_ids(std::move(pci_ids)),
 	pci_addrs(std::move(pci_addrs)),
-	xml("xml", xml),
-	ivshmem("ivshmem"),
-	transient("transient"),
-	vcpu_map("vcpu-map"),
-	probe_with_ssh("probe-with-ssh"),
-	probe_hostname("probe-hostname")
+	xml(xml)
 {
 }
 
-YAML::Node Start::emit() const
+void Start::emit_into(YAML::Node &node) const
 {
-	YAML::Node node = Task::emit();
-	merge_node(node, vm_name.emit());
-	merge_node(node, vcpus.emit());
-	merge_node(node, memory.emit());
-	merge_node(node, memnode_map.emit());
+	Task::emit_into(node);
+	vm_name.emit_into(node);
+	vcpus.emit_into(node);
+	memory.emit_into(node);
+	memnode_map.emit_into(node);
 	if (memnode_map.is_valid())
 		node[memnode_map.get_tag()].SetStyle(YAML::EmitterStyle::Flow);
-	merge_node(node, xml.emit());
-	merge_node(node, ivshmem.emit());
-	merge_node(node, transient.emit());
+	xml.emit_into(node);
+	ivshmem.emit_into(node);
+	transient.emit_into(node);
 	if (!pci_ids.empty())
 		node["pci-ids"] = pci_ids;
 	if (!pci_addrs.empty())
 		node["dev"] = pci_addrs;
-	merge_node(node, vcpu_map.emit());
+	vcpu_map.emit_into(node);
 	if (vcpu_map.is_valid())
 		node[vcpu_map.get_tag()].SetStyle(YAML::EmitterStyle::Flow);
-	merge_node(node, probe_with_ssh.emit());
-	merge_node(node, probe_hostname.emit());
-	return node;
+	probe_with_ssh.emit_into(node);
+	probe_hostname.emit_into(node);
 }
 
 void Start::load(const YAML::Node &node)
@@ -306,35 +443,106 @@ void Start::load(const YAML::Node &node)
 	probe_hostname.load(node);
 }
 
+void Start::emit_entries(YAML::Emitter &out) const
+{
+	Task::emit_entries(out);
+	vm_name.emit_entry(out);
+	vcpus.emit_entry(out);
+	memory.emit_entry(out);
+	memnode_map.emit_entry(out, true);
+	xml.emit_entry(out);
+	ivshmem.emit_entry(out);
+	transient.emit_entry(out);
+	if (!pci_ids.empty()) {
+		out << YAML::Key << "pci-ids" << YAML::Value;
+		fast::yaml::stream(out, pci_ids);
+	}
+	if (!pci_addrs.empty()) {
+		out << YAML::Key << "dev" << YAML::Value;
+		fast::yaml::stream(out, pci_addrs);
+	}
+	vcpu_map.emit_entry(out, true);
+	probe_with_ssh.emit_entry(out);
+	probe_hostname.emit_entry(out);
+}
+
+bool Start::has_entries() const
+{
+	return Task::has_entries() || vm_name || vcpus || memory || memnode_map || xml || ivshmem || transient ||
+		!pci_ids.empty() || !pci_addrs.empty() || vcpu_map || probe_with_ssh || probe_hostname;
+}
+
+std::size_t Start::append_entries(std::string &buffer) const
+{
+	auto entries = Task::append_entries(buffer);
+	entries += vm_name.append_entry(buffer);
+	entries += vcpus.append_entry(buffer);
+	entries += memory.append_entry(buffer);
+	entries += memnode_map.append_entry(buffer);
+	entries += xml.append_entry(buffer);
+	entries += ivshmem.append_entry(buffer);
+	entries += transient.append_entry(buffer);
+	if (!pci_ids.empty()) {
+		fast::binary::append_value(buffer, "pci-ids");
+		fast::binary::append_value(buffer, pci_ids);
+		++entries;
+	}
+	if (!pci_addrs.empty()) {
+		fast::binary::append_value(buffer, "dev");
+		fast::binary::append_value(buffer, pci_addrs);
+		++entries;
+	}
+	entries += vcpu_map.append_entry(buffer);
+	entries += probe_with_ssh.append_entry(buffer);
+	entries += probe_hostname.append_entry(buffer);
+	return entries;
+}
+
+void Start::load_binary(fast::binary::Reader &in)
+{
+	pci_ids.clear();
+	pci_addrs.clear();
+	fast::binary::read_map(in, [&](const char *key, std::size_t size) {
+		// Like load(), PCI addresses are read from "devs".
+		return Task::load_entry(in, key, size) ||
+			vm_name.load_entry(in, key, size) ||
+			vcpus.load_entry(in, key, size) ||
+			memory.load_entry(in, key, size) ||
+			memnode_map.load_entry(in, key, size) ||
+			fast::binary::read_entry(in, key, size, "pci-ids", pci_ids) ||
+			fast::binary::read_entry(in, key, size, "devs", pci_addrs) ||
+			xml.load_entry(in, key, size) ||
+			ivshmem.load_entry(in, key, size) ||
+			transient.load_entry(in, key, size) ||
+			vcpu_map.load_entry(in, key, size) ||
+			probe_with_ssh.load_entry(in, key, size) ||
+			probe_hostname.load_entry(in, key, size);
+	});
+}
+
 //
 // Stop implementation
 //
 
-Stop::Stop() :
-	vm_name("vm-name"),
-	regex("regex"),
-	force("force"),
-	undefine("undefine")
+Stop::Stop()
 {
 }
 
 Stop::Stop(std::string vm_name, bool force, bool undefine, bool concurrent_execution) :
 	Task::Task(concurrent_execution),
-	vm_name("vm-name", std::move(vm_name)),
-	regex("regex"),
-	force("force", force),
-	undefine("undefine", undefine)
+	vm_name(std::move(vm_name)),
+	force(force),
+	undefine(undefine)
 {
 }
 
-YAML::Node Stop::emit() const
+void Stop::emit_into(YAML::Node &node) const
 {
-	YAML::Node node = Task::emit();
-	merge_node(node, vm_name.emit());
-	merge_node(node, regex.emit());
-	merge_node(node, force.emit());
-	merge_node(node, undefine.emit());
-	return node;
+	Task::emit_into(node);
+	vm_name.emit_into(node);
+	regex.emit_into(node);
+	force.emit_into(node);
+	undefine.emit_into(node);
 }
 
 void Stop::load(const YAML::Node &node)
@@ -346,13 +554,46 @@ void Stop::load(const YAML::Node &node)
 	undefine.load(node);
 }
 
+void Stop::emit_entries(YAML::Emitter &out) const
+{
+	Task::emit_entries(out);
+	vm_name.emit_entry(out);
+	regex.emit_entry(out);
+	force.emit_entry(out);
+	undefine.emit_entry(out);
+}
+
+bool Stop::has_entries() const
+{
+	return Task::has_entries() || vm_name || regex || force || undefine;
+}
+
+std::size_t Stop::append_entries(std::string &buffer) const
+{
+	auto entries = Task::append_entries(buffer);
+	entries += vm_name.append_entry(buffer);
+	entries += regex.append_entry(buffer);
+	entries += force.append_entry(buffer);
+	entries += undefine.append_entry(buffer);
+	return entries;
+}
+
+void Stop::load_binary(fast::binary::Reader &in)
+{
+	fast::binary::read_map(in, [&](const char *key, std::size_t size) {
+		return Task::load_entry(in, key, size) ||
+			vm_name.load_entry(in, key, size) ||
+			regex.load_entry(in, key, size) ||
+			force.load_entry(in, key, size) ||
+			undefine.load_entry(in, key, size);
+	});
+}
+
 //
 // Swap_with implementation
 //
 
-Swap_with::Swap_with() :
-	pscom_hook_procs("pscom-hook-procs"),
-	vcpu_map("vcpu-map")
+Swap_with::Swap_with()
 {
 }
 
@@ -360,8 +601,8 @@ YAML::Node Swap_with::emit() const
 {
 	YAML::Node node;
 	node["vm-name"] = vm_name;
-	merge_node(node, pscom_hook_procs.emit());
-	merge_node(node, vcpu_map.emit());
+	pscom_hook_procs.emit_into(node);
+	vcpu_map.emit_into(node);
 	if (vcpu_map.is_valid())
 		node[vcpu_map.get_tag()].SetStyle(YAML::EmitterStyle::Flow);
 	return node;
@@ -374,18 +615,40 @@ void Swap_with::load(const YAML::Node &node)
 	vcpu_map.load(node);
 }
 
+void Swap_with::emit_stream(YAML::Emitter &out) const
+{
+	out << YAML::BeginMap;
+	out << YAML::Key << "vm-name" << YAML::Value << vm_name;
+	pscom_hook_procs.emit_entry(out);
+	vcpu_map.emit_entry(out, true);
+	out << YAML::EndMap;
+}
+
+void Swap_with::emit_binary(std::string &buffer) const
+{
+	fast::binary::append_map_header(buffer, 1 + pscom_hook_procs.is_valid() + vcpu_map.is_valid());
+	fast::binary::append_value(buffer, "vm-name");
+	fast::binary::append_value(buffer, vm_name);
+	pscom_hook_procs.append_entry(buffer);
+	vcpu_map.append_entry(buffer);
+}
+
+void Swap_with::load_binary(fast::binary::Reader &in)
+{
+	bool has_vm_name = false;
+	fast::binary::read_map(in, [&](const char *key, std::size_t size) {
+		if (fast::binary::read_entry(in, key, size, "vm-name", vm_name))
+			return has_vm_name = true;
+		return pscom_hook_procs.load_entry(in, key, size) || vcpu_map.load_entry(in, key, size);
+	});
+	fast::binary::require_entry(has_vm_name, "vm-name");
+}
+
 //
 // Migrate implementation
 //
 
-Migrate::Migrate() :
-	retry_counter("retry_counter"),
-	migration_type("migration-type"),
-	rdma_migration("rdma-migration"),
-	pscom_hook_procs("pscom-hook-procs"),
-	transport("transport"),
-	swap_with("swap-with"),
-	vcpu_map("vcpu-map")
+Migrate::Migrate()
 {
 }
 
@@ -393,13 +656,9 @@ Migrate::Migrate(std::string vm_name, std::string dest_hostname, std::string mig
 	Task::Task(concurrent_execution, time_measurement),
 	vm_name(std::move(vm_name)),
 	dest_hostname(std::move(dest_hostname)),
-	retry_counter("retry_counter"),
-	migration_type("migration-type", std::move(migration_type)),
-	rdma_migration("rdma-migration", rdma_migration),
-	pscom_hook_procs("pscom-hook-procs", std::to_string(pscom_hook_procs)),
-	transport("transport"),
-	swap_with("swap-with"),
-	vcpu_map("vcpu-map")
+	migration_type(std::move(migration_type)),
+	rdma_migration(rdma_migration),
+	pscom_hook_procs(std::to_string(pscom_hook_procs))
 {
 }
 
@@ -407,32 +666,27 @@ Migrate::Migrate(std::string vm_name, std::string dest_hostname, std::string mig
 	Task::Task(concurrent_execution, time_measurement),
 	vm_name(std::move(vm_name)),
 	dest_hostname(std::move(dest_hostname)),
-	retry_counter("retry_counter"),
-	migration_type("migration-type", std::move(migration_type)),
-	rdma_migration("rdma-migration", rdma_migration),
-	pscom_hook_procs("pscom-hook-procs", std::move(pscom_hook_procs)),
-	transport("transport"),
-	swap_with("swap-with"),
-	vcpu_map("vcpu-map")
+	migration_type(std::move(migration_type)),
+	rdma_migration(rdma_migration),
+	pscom_hook_procs(std::move(pscom_hook_procs))
 {
 }
 
-YAML::Node Migrate::emit() const
+void Migrate::emit_into(YAML::Node &node) const
 {
-	YAML::Node node = Task::emit();
+	Task::emit_into(node);
 	node["vm-name"] = vm_name;
 	node["destination"] = dest_hostname;
 	YAML::Node params = node["parameter"];
-	merge_node(params, retry_counter.emit());
-	merge_node(params, migration_type.emit());
-	merge_node(params, rdma_migration.emit());
-	merge_node(params, pscom_hook_procs.emit());
-	merge_node(params, transport.emit());
-	merge_node(params, swap_with.emit());
-	merge_node(params, vcpu_map.emit());
+	retry_counter.emit_into(params);
+	migration_type.emit_into(params);
+	rdma_migration.emit_into(params);
+	pscom_hook_procs.emit_into(params);
+	transport.emit_into(params);
+	swap_with.emit_into(params);
+	vcpu_map.emit_into(params);
 	if (vcpu_map.is_valid())
 		params[vcpu_map.get_tag()].SetStyle(YAML::EmitterStyle::Flow);
-	return node;
 }
 
 void Migrate::load(const YAML::Node &node)
@@ -451,50 +705,117 @@ void Migrate::load(const YAML::Node &node)
 	}
 }
 
+void Migrate::emit_entries(YAML::Emitter &out) const
+{
+	Task::emit_entries(out);
+	out << YAML::Key << "vm-name" << YAML::Value << vm_name;
+	out << YAML::Key << "destination" << YAML::Value << dest_hostname;
+	// Like emit(), omit the parameter mapping if it has no entries.
+	if (retry_counter || migration_type || rdma_migration || pscom_hook_procs || transport || swap_with || vcpu_map) {
+		out << YAML::Key << "parameter" << YAML::Value << YAML::BeginMap;
+		retry_counter.emit_entry(out);
+		migration_type.emit_entry(out);
+		rdma_migration.emit_entry(out);
+		pscom_hook_procs.emit_entry(out);
+		transport.emit_entry(out);
+		swap_with.emit_entry(out);
+		vcpu_map.emit_entry(out, true);
+		out << YAML::EndMap;
+	}
+}
+
+bool Migrate::has_entries() const
+{
+	// Always has vm-name and destination.
+	return true;
+}
+
+std::size_t Migrate::append_entries(std::string &buffer) const
+{
+	auto entries = Task::append_entries(buffer);
+	fast::binary::append_value(buffer, "vm-name");
+	fast::binary::append_value(buffer, vm_name);
+	fast::binary::append_value(buffer, "destination");
+	fast::binary::append_value(buffer, dest_hostname);
+	entries += 2;
+	// Like emit(), omit the parameter mapping if it has no entries.
+	auto pos = buffer.size();
+	fast::binary::append_value(buffer, "parameter");
+	auto params_pos = buffer.size();
+	std::size_t params = retry_counter.append_entry(buffer);
+	params += migration_type.append_entry(buffer);
+	params += rdma_migration.append_entry(buffer);
+	params += pscom_hook_procs.append_entry(buffer);
+	params += transport.append_entry(buffer);
+	params += swap_with.append_entry(buffer);
+	params += vcpu_map.append_entry(buffer);
+	if (params == 0) {
+		buffer.resize(pos);
+	} else {
+		fast::binary::insert_map_header(buffer, params_pos, params);
+		++entries;
+	}
+	return entries;
+}
+
+void Migrate::load_binary(fast::binary::Reader &in)
+{
+	bool has_vm_name = false, has_destination = false;
+	fast::binary::read_map(in, [&](const char *key, std::size_t size) {
+		if (fast::binary::read_entry(in, key, size, "vm-name", vm_name))
+			return has_vm_name = true;
+		if (fast::binary::read_entry(in, key, size, "destination", dest_hostname))
+			return has_destination = true;
+		if (fast::binary::key_equals(key, size, "parameter")) {
+			fast::binary::read_map(in, [&](const char *param, std::size_t param_size) {
+				return retry_counter.load_entry(in, param, param_size) ||
+					migration_type.load_entry(in, param, param_size) ||
+					rdma_migration.load_entry(in, param, param_size) ||
+					pscom_hook_procs.load_entry(in, param, param_size) ||
+					transport.load_entry(in, param, param_size) ||
+					swap_with.load_entry(in, param, param_size) ||
+					vcpu_map.load_entry(in, param, param_size);
+			});
+			return true;
+		}
+		return Task::load_entry(in, key, size);
+	});
+	fast::binary::require_entry(has_vm_name, "vm-name");
+	fast::binary::require_entry(has_destination, "destination");
+}
+
 //
 // Evacuate implementation
 //
 
-Evacuate::Evacuate() :
-	mode("mode"),
-	overbooking("overbooking"),
-	retry_counter("retry_counter"),
-	migration_type("migration-type"),
-	rdma_migration("rdma-migration"),
-	pscom_hook_procs("pscom-hook-procs"),
-	transport("transport"),
-	vm_name("vm-name")
+Evacuate::Evacuate()
 {
 }
 
 Evacuate::Evacuate(std::vector<std::string> destinations, std::string mode, bool overbooking, std::string migration_type, bool rdma_migration, bool concurrent_execution, std::string pscom_hook_procs, bool time_measurement) :
 	Task::Task(concurrent_execution, time_measurement),
 	destinations(std::move(destinations)),
-	mode("mode", std::move(mode)),
-	overbooking("overbooking", overbooking),
-	retry_counter("retry_counter"),
-	migration_type("migration-type", std::move(migration_type)),
-	rdma_migration("rdma-migration", rdma_migration),
-	pscom_hook_procs("pscom-hook-procs", std::move(pscom_hook_procs)),
-	transport("transport"),
-	vm_name("vm-name")
+	mode(std::move(mode)),
+	overbooking(overbooking),
+	migration_type(std::move(migration_type)),
+	rdma_migration(rdma_migration),
+	pscom_hook_procs(std::move(pscom_hook_procs))
 {
 }
 
-YAML::Node Evacuate::emit() const
+void Evacuate::emit_into(YAML::Node &node) const
 {
-	YAML::Node node = Task::emit();
+	Task::emit_into(node);
 	node["destinations"] = destinations;
 	YAML::Node params = node["parameter"];
-	merge_node(params, mode.emit());
-	merge_node(params, overbooking.emit());
-	merge_node(params, retry_counter.emit());
-	merge_node(params, migration_type.emit());
-	merge_node(params, rdma_migration.emit());
-	merge_node(params, pscom_hook_procs.emit());
-	merge_node(params, transport.emit());
-	merge_node(node, vm_name.emit());
-	return node;
+	mode.emit_into(params);
+	overbooking.emit_into(params);
+	retry_counter.emit_into(params);
+	migration_type.emit_into(params);
+	rdma_migration.emit_into(params);
+	pscom_hook_procs.emit_into(params);
+	transport.emit_into(params);
+	vm_name.emit_into(node);
 }
 
 void Evacuate::load(const YAML::Node &node)
@@ -513,6 +834,82 @@ void Evacuate::load(const YAML::Node &node)
 	vm_name.load(node);
 }
 
+void Evacuate::emit_entries(YAML::Emitter &out) const
+{
+	Task::emit_entries(out);
+	out << YAML::Key << "destinations" << YAML::Value;
+	fast::yaml::stream(out, destinations);
+	// Like emit(), omit the parameter mapping if it has no entries.
+	if (mode || overbooking || retry_counter || migration_type || rdma_migration || pscom_hook_procs || transport) {
+		out << YAML::Key << "parameter" << YAML::Value << YAML::BeginMap;
+		mode.emit_entry(out);
+		overbooking.emit_entry(out);
+		retry_counter.emit_entry(out);
+		migration_type.emit_entry(out);
+		rdma_migration.emit_entry(out);
+		pscom_hook_procs.emit_entry(out);
+		transport.emit_entry(out);
+		out << YAML::EndMap;
+	}
+	vm_name.emit_entry(out);
+}
+
+bool Evacuate::has_entries() const
+{
+	// Always has destinations.
+	return true;
+}
+
+std::size_t Evacuate::append_entries(std::string &buffer) const
+{
+	auto entries = Task::append_entries(buffer);
+	fast::binary::append_value(buffer, "destinations");
+	fast::binary::append_value(buffer, destinations);
+	++entries;
+	// Like emit(), omit the parameter mapping if it has no entries.
+	auto pos = buffer.size();
+	fast::binary::append_value(buffer, "parameter");
+	auto params_pos = buffer.size();
+	std::size_t params = mode.append_entry(buffer);
+	params += overbooking.append_entry(buffer);
+	params += retry_counter.append_entry(buffer);
+	params += migration_type.append_entry(buffer);
+	params += rdma_migration.append_entry(buffer);
+	params += pscom_hook_procs.append_entry(buffer);
+	params += transport.append_entry(buffer);
+	if (params == 0) {
+		buffer.resize(pos);
+	} else {
+		fast::binary::insert_map_header(buffer, params_pos, params);
+		++entries;
+	}
+	entries += vm_name.append_entry(buffer);
+	return entries;
+}
+
+void Evacuate::load_binary(fast::binary::Reader &in)
+{
+	bool has_destinations = false;
+	fast::binary::read_map(in, [&](const char *key, std::size_t size) {
+		if (fast::binary::read_entry(in, key, size, "destinations", destinations))
+			return has_destinations = true;
+		if (fast::binary::key_equals(key, size, "parameter")) {
+			fast::binary::read_map(in, [&](const char *param, std::size_t param_size) {
+				return mode.load_entry(in, param, param_size) ||
+					overbooking.load_entry(in, param, param_size) ||
+					retry_counter.load_entry(in, param, param_size) ||
+					migration_type.load_entry(in, param, param_size) ||
+					rdma_migration.load_entry(in, param, param_size) ||
+					pscom_hook_procs.load_entry(in, param, param_size) ||
+					transport.load_entry(in, param, param_size);
+			});
+			return true;
+		}
+		return Task::load_entry(in, key, size) || vm_name.load_entry(in, key, size);
+	});
+	fast::binary::require_entry(has_destinations, "destinations");
+}
+
 
 //
 // Repin implementation
@@ -529,13 +926,12 @@ Repin::Repin(std::string vm_name, std::vector<std::vector<unsigned int>> vcpu_ma
 {
 }
 
-YAML::Node Repin::emit() const
+void Repin::emit_into(YAML::Node &node) const
 {
-	YAML::Node node = Task::emit();
+	Task::emit_into(node);
 	node["vm-name"] = vm_name;
 	node["vcpu-map"] = vcpu_map;
 	node["vcpu-map"].SetStyle(YAML::EmitterStyle::Flow);
-	return node;
 }
 
 void Repin::load(const YAML::Node &node)
@@ -545,6 +941,44 @@ void Repin::load(const YAML::Node &node)
 	fast::load(vcpu_map, node["vcpu-map"]);
 }
 
+void Repin::emit_entries(YAML::Emitter &out) const
+{
+	Task::emit_entries(out);
+	out << YAML::Key << "vm-name" << YAML::Value << vm_name;
+	out << YAML::Key << "vcpu-map" << YAML::Value << YAML::Flow;
+	fast::yaml::stream(out, vcpu_map);
+}
+
+bool Repin::has_entries() const
+{
+	// Always has vm-name and vcpu-map.
+	return true;
+}
+
+std::size_t Repin::append_entries(std::string &buffer) const
+{
+	auto entries = Task::append_entries(buffer);
+	fast::binary::append_value(buffer, "vm-name");
+	fast::binary::append_value(buffer, vm_name);
+	fast::binary::append_value(buffer, "vcpu-map");
+	fast::binary::append_value(buffer, vcpu_map);
+	return entries + 2;
+}
+
+void Repin::load_binary(fast::binary::Reader &in)
+{
+	bool has_vm_name = false, has_vcpu_map = false;
+	fast::binary::read_map(in, [&](const char *key, std::size_t size) {
+		if (fast::binary::read_entry(in, key, size, "vm-name", vm_name))
+			return has_vm_name = true;
+		if (fast::binary::read_entry(in, key, size, "vcpu-map", vcpu_map))
+			return has_vcpu_map = true;
+		return Task::load_entry(in, key, size);
+	});
+	fast::binary::require_entry(has_vm_name, "vm-name");
+	fast::binary::require_entry(has_vcpu_map, "vcpu-map");
+}
+
 //
 // Suspend implementation
 //
@@ -559,11 +993,10 @@ Suspend::Suspend(std::string vm_name, bool concurrent_execution) :
 {
 }
 
-YAML::Node Suspend::emit() const
+void Suspend::emit_into(YAML::Node &node) const
 {
-	YAML::Node node = Task::emit();
+	Task::emit_into(node);
 	node["vm-name"] = vm_name;
-	return node;
 }
 
 void Suspend::load(const YAML::Node &node)
@@ -572,6 +1005,37 @@ void Suspend::load(const YAML::Node &node)
 	fast::load(vm_name, node["vm-name"]);
 }
 
+void Suspend::emit_entries(YAML::Emitter &out) const
+{
+	Task::emit_entries(out);
+	out << YAML::Key << "vm-name" << YAML::Value << vm_name;
+}
+
+bool Suspend::has_entries() const
+{
+	// Always has vm-name.
+	return true;
+}
+
+std::size_t Suspend::append_entries(std::string &buffer) const
+{
+	auto entries = Task::append_entries(buffer);
+	fast::binary::append_value(buffer, "vm-name");
+	fast::binary::append_value(buffer, vm_name);
+	return entries + 1;
+}
+
+void Suspend::load_binary(fast::binary::Reader &in)
+{
+	bool has_vm_name = false;
+	fast::binary::read_map(in, [&](const char *key, std::size_t size) {
+		if (fast::binary::read_entry(in, key, size, "vm-name", vm_name))
+			return has_vm_name = true;
+		return Task::load_entry(in, key, size);
+	});
+	fast::binary::require_entry(has_vm_name, "vm-name");
+}
+
 //
 // Resume implementation
 //
@@ -586,11 +1050,10 @@ Resume::Resume(std::string vm_name, bool concurrent_execution) :
 {
 }
 
-YAML::Node Resume::emit() const
+void Resume::emit_into(YAML::Node &node) const
 {
-	YAML::Node node = Task::emit();
+	Task::emit_into(node);
 	node["vm-name"] = vm_name;
-	return node;
 }
 
 void Resume::load(const YAML::Node &node)
@@ -599,6 +1062,37 @@ void Resume::load(const YAML::Node &node)
 	fast::load(vm_name, node["vm-name"]);
 }
 
+void Resume::emit_entries(YAML::Emitter &out) const
+{
+	Task::emit_entries(out);
+	out << YAML::Key << "vm-name" << YAML::Value << vm_name;
+}
+
+bool Resume::has_entries() const
+{
+	// Always has vm-name.
+	return true;
+}
+
+std::size_t Resume::append_entries(std::string &buffer) const
+{
+	auto entries = Task::append_entries(buffer);
+	fast::binary::append_value(buffer, "vm-name");
+	fast::binary::append_value(buffer, vm_name);
+	return entries + 1;
+}
+
+void Resume::load_binary(fast::binary::Reader &in)
+{
+	bool has_vm_name = false;
+	fast::binary::read_map(in, [&](const char *key, std::size_t size) {
+		if (fast::binary::read_entry(in, key, size, "vm-name", vm_name))
+			return has_vm_name = true;
+		return Task::load_entry(in, key, size);
+	});
+	fast::binary::require_entry(has_vm_name, "vm-name");
+}
+
 }
 }
 }
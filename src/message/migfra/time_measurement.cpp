@@ -134,6 +134,20 @@ YAML::Node Time_measurement::emit() const
 	return node;
 }
 
+void Time_measurement::emit_binary(std::string &buffer) const
+{
+	// Like emit(), which returns a null node without timers.
+	if (timers.empty()) {
+		fast::binary::append_null(buffer);
+		return;
+	}
+	fast::binary::append_map_header(buffer, timers.size());
+	for (auto &timer : timers) {
+		fast::binary::append_value(buffer, timer.first);
+		fast::binary::append_value(buffer, timer.second.format(format));
+	}
+}
+
 void Time_measurement::load(const YAML::Node &node)
 {
 	(void) node;
@@ -0,0 +1,55 @@
+/*
+ * This file is part of fast-lib.
+ * Copyright (C) 2015 RWTH Aachen University - ACS
+ *
+ * This file is licensed under the GNU Lesser General Public License Version 3
+ * Version 3, 29 June 2007. For details see 'LICENSE.md' in the root directory.
+ */
+
+#include <fast-lib/message_router.hpp>
+#include <fast-lib/log.hpp>
+
+#include <stdexcept>
+
+FASTLIB_LOG_INIT(router_log, "Message_router")
+
+namespace fast {
+
+void Message_router::add_node_handler(const std::string &topic_filter, const std::string &task, node_handler_t handler)
+{
+	handlers[topic_filter][task] = std::move(handler);
+}
+
+bool Message_router::route(const std::string &topic_filter, const std::string &message) const
+{
+	auto filter_handlers = handlers.find(topic_filter);
+	if (filter_handlers == handlers.end())
+		return false;
+	// Accept YAML and binary messages like Serializable::from_string().
+	auto node = binary::is_binary(message) ? binary::load(message) : YAML::Load(message);
+	auto task_node = node.IsMap() ? node["task"] : YAML::Node();
+	static const std::string no_task;
+	auto &task = task_node && task_node.IsScalar() ? task_node.Scalar() : no_task;
+	auto handler = filter_handlers->second.find(task);
+	if (handler == filter_handlers->second.end())
+		return false;
+	handler->second(node);
+	return true;
+}
+
+void Message_router::subscribe(const MQTT_communicator &comm, int qos) const
+{
+	for (auto &filter_handlers : handlers) {
+		auto &topic_filter = filter_handlers.first;
+		comm.add_subscription(topic_filter, [this, topic_filter](std::string message) {
+			try {
+				if (!route(topic_filter, message))
+					FASTLIB_LOG(router_log, warn) << "No handler for message on " << topic_filter << ".";
+			} catch (const std::exception &e) {
+				FASTLIB_LOG(router_log, warn) << "Error routing message on " << topic_filter << ": " << e.what();
+			}
+		}, qos);
+	}
+}
+
+} // namespace fast
@@ -8,13 +8,46 @@
 
 #include <fast-lib/log.hpp>
 #include <fast-lib/mqtt_communicator.hpp>
+#include <fast-lib/serializable.hpp>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <map>
+#include <numeric>
 #include <queue>
+#include <random>
 #include <regex>
 #include <stdexcept>
 #include <thread>
 
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifdef FASTLIB_ENABLE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef FASTLIB_ENABLE_LZ4
+#include <lz4.h>
+#endif
+#ifdef FASTLIB_ENABLE_NUMA
+#include <numa.h>
+#include <numaif.h>
+#endif
+
 FASTLIB_LOG_INIT(comm_log, "MQTT_communicator")
 
 FASTLIB_LOG_SET_LEVEL_GLOBAL(comm_log, trace);
@@ -37,110 +70,1495 @@ static std::regex topic_to_regex(const std::string &topic)
 	return std::regex(regex_topic);
 }
 
+/// The timeout of a single iteration of the mosquitto loop in milliseconds.
+static const int loop_timeout = 100;
+
+/// The time to wait between two attempts to connect to a broker.
+static const std::chrono::seconds reconnect_delay(1);
+
+/// The interval to check if mosquitto is ready for held back messages.
+static const std::chrono::microseconds outbound_poll_interval(500);
+
+/// The number of held back messages handed to mosquitto at once.
+static const std::size_t outbound_batch_size = 16;
+
+/// The number of messages a thread can post before they are drained by the outbound thread.
+static const std::size_t producer_queue_size = 256;
+
+/// The default maximum size of the payload of a single publish.
+static const std::size_t default_chunk_size = 256 * 1024;
+
+/// The default maximum size of a message reassembled from chunks.
+static const std::size_t default_max_message_size = 64 * 1024 * 1024;
+
+/// The default memory all incomplete messages reassembled from chunks may take together.
+static const std::size_t default_max_reassembly_size = 256 * 1024 * 1024;
+
+/// The number of incomplete messages a topic may have. A new message on a topic at the limit evicts its oldest one.
+static const std::size_t max_partial_messages_per_topic = 16;
+
+/// The number of topics whose policy is cached, so distinct topics like per-job topics do not grow the cache without bound.
+static const std::size_t max_resolved_policies = 4096;
+
+/// The largest block taken from the slabs of the queue memory. Larger allocations are mapped on their own.
+static const std::size_t max_queue_block_size = 256 * 1024;
+
+/// The time a broker may take to accept a TCP connection before it is considered unreachable.
+static const std::chrono::milliseconds probe_timeout(500);
+
+/// Helper function to check that CPUs exist before pinning threads to them.
+static void check_cpus(const std::vector<int> &cpus)
+{
+	long cpu_count = sysconf(_SC_NPROCESSORS_CONF);
+	for (auto cpu : cpus) {
+		if (cpu < 0 || cpu >= CPU_SETSIZE || (cpu_count > 0 && cpu >= cpu_count))
+			throw std::runtime_error("Invalid CPU " + std::to_string(cpu) + ".");
+	}
+}
+
+/// Helper function to pin a thread to a CPU.
+static void pin_thread(std::thread &thread, const std::vector<int> &cpus)
+{
+	check_cpus(cpus);
+	cpu_set_t cpu_set;
+	CPU_ZERO(&cpu_set);
+	for (auto cpu : cpus)
+		CPU_SET(cpu, &cpu_set);
+	int ret = pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set), &cpu_set);
+	if (ret != 0)
+		throw std::runtime_error("Error pinning thread to CPUs: " + std::string(std::strerror(ret)));
+}
+
+/// Helper function to set an integer socket option and warn on failure.
+static void set_socket_option(int fd, int level, int option, int value, const std::string &name)
+{
+	if (::setsockopt(fd, level, option, &value, sizeof(value)) != 0)
+		FASTLIB_LOG(comm_log, warn) << "Error setting socket option " << name << ": " << std::strerror(errno);
+}
 
+/// Helper function to measure the time needed to open a TCP connection to a broker.
+static Broker_health probe_broker(const Broker_endpoint &broker)
+{
+	Broker_health health{false, std::chrono::microseconds::max()};
+	addrinfo hints{};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	addrinfo *addrs = nullptr;
+	if (getaddrinfo(broker.host.c_str(), std::to_string(broker.port).c_str(), &hints, &addrs) != 0)
+		return health;
+	for (auto addr = addrs; addr != nullptr && !health.reachable; addr = addr->ai_next) {
+		int fd = ::socket(addr->ai_family, addr->ai_socktype | SOCK_NONBLOCK, addr->ai_protocol);
+		if (fd == -1)
+			continue;
+		auto start = std::chrono::steady_clock::now();
+		int ret = ::connect(fd, addr->ai_addr, addr->ai_addrlen);
+		if (ret == -1 && errno == EINPROGRESS) {
+			pollfd pfd{fd, POLLOUT, 0};
+			if (::poll(&pfd, 1, static_cast<int>(probe_timeout.count())) == 1) {
+				int err = 0;
+				socklen_t len = sizeof(err);
+				if (::getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err == 0)
+					ret = 0;
+			}
+		}
+		if (ret == 0) {
+			health.reachable = true;
+			health.rtt = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+		}
+		::close(fd);
+	}
+	freeaddrinfo(addrs);
+	return health;
+}
+
+
+
+/// The first bytes of messages wrapped in an envelope.
+static const std::array<char, 2> envelope_magic{{'\xFA', '\x57'}};
+
+/// The version of the envelope format.
+static const char envelope_version = 1;
+
+/// Flags stating the optional fields of an envelope.
+enum Envelope_flags : unsigned char
+{
+	envelope_expiry = 0x01, // 8 byte expiry in milliseconds since epoch (big endian).
+	envelope_chunk = 0x02, // 8 byte message id, 4 byte chunk index, 4 byte chunk count, 8 byte offset, 8 byte message size.
+	envelope_batch = 0x04, // 4 byte message count. The payload is a sequence of 4 byte size and data of each message.
+	envelope_compressed = 0x08 // 1 byte compression algorithm, 8 byte uncompressed size. The payload is compressed.
+};
+
+/// The header of a message which allows discarding or unwrapping it without parsing the payload.
+struct MQTT_envelope
+{
+	unsigned char flags = 0;
+	std::chrono::system_clock::time_point expiry = std::chrono::system_clock::time_point::max();
+	std::uint64_t chunk_id = 0;
+	std::uint32_t chunk_index = 0;
+	std::uint32_t chunk_count = 0;
+	std::uint64_t chunk_offset = 0;
+	std::uint64_t message_size = 0;
+	std::uint32_t batch_count = 0;
+	Compression compression = Compression::none;
+	std::uint64_t uncompressed_size = 0;
+};
+
+/// The size of the chunk fields of an envelope.
+static const std::size_t envelope_chunk_size = 8 + 4 + 4 + 8 + 8;
+
+/// Helper function to append an integer in big endian byte order.
+template<class String> static void append_uint64(String &str, std::uint64_t value)
+{
+	for (int shift = 56; shift >= 0; shift -= 8)
+		str.push_back(static_cast<char>((value >> shift) & 0xFF));
+}
+
+/// Helper function to append an integer in big endian byte order.
+template<class String> static void append_uint32(String &str, std::uint32_t value)
+{
+	for (int shift = 24; shift >= 0; shift -= 8)
+		str.push_back(static_cast<char>((value >> shift) & 0xFF));
+}
+
+/// Helper function to read an integer in big endian byte order.
+static std::uint64_t read_uint64(const char *data)
+{
+	std::uint64_t value = 0;
+	for (int i = 0; i != 8; ++i)
+		value = (value << 8) | static_cast<unsigned char>(data[i]);
+	return value;
+}
+
+/// Helper function to read an integer in big endian byte order.
+static std::uint32_t read_uint32(const char *data)
+{
+	std::uint32_t value = 0;
+	for (int i = 0; i != 4; ++i)
+		value = (value << 8) | static_cast<unsigned char>(data[i]);
+	return value;
+}
+
+/// Helper function to append the header of an envelope to a string, e.g., a reused buffer.
+template<class String> static void append_envelope(String &str, const MQTT_envelope &envelope)
+{
+	str.append(envelope_magic.begin(), envelope_magic.end());
+	str.push_back(envelope_version);
+	str.push_back(static_cast<char>(envelope.flags));
+	if (envelope.flags & envelope_expiry) {
+		auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(envelope.expiry.time_since_epoch());
+		append_uint64(str, static_cast<std::uint64_t>(ms.count()));
+	}
+	if (envelope.flags & envelope_chunk) {
+		append_uint64(str, envelope.chunk_id);
+		append_uint32(str, envelope.chunk_index);
+		append_uint32(str, envelope.chunk_count);
+		append_uint64(str, envelope.chunk_offset);
+		append_uint64(str, envelope.message_size);
+	}
+	if (envelope.flags & envelope_batch)
+		append_uint32(str, envelope.batch_count);
+	if (envelope.flags & envelope_compressed) {
+		str.push_back(static_cast<char>(envelope.compression));
+		append_uint64(str, envelope.uncompressed_size);
+	}
+}
+
+/// Helper function to wrap a payload in an envelope.
+static std::string wrap_envelope(const MQTT_envelope &envelope, const char *data, std::size_t size)
+{
+	std::string str;
+	str.reserve(4 + 8 + envelope_chunk_size + size);
+	append_envelope(str, envelope);
+	str.append(data, size);
+	return str;
+}
+
+/// Helper function to read the envelope of a message.
+/// Returns the size of the envelope header, which is 0 for messages not wrapped in an envelope.
+static std::size_t unwrap_envelope(const char *data, std::size_t size, MQTT_envelope &envelope)
+{
+	if (size < 4 || !std::equal(envelope_magic.begin(), envelope_magic.end(), data) || data[2] != envelope_version)
+		return 0;
+	std::size_t pos = 4;
+	envelope.flags = static_cast<unsigned char>(data[3]);
+	if (envelope.flags & envelope_expiry) {
+		if (size < pos + 8)
+			throw std::runtime_error("Truncated envelope.");
+		auto ms = std::chrono::milliseconds(static_cast<std::chrono::milliseconds::rep>(read_uint64(data + pos)));
+		envelope.expiry = std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(ms));
+		pos += 8;
+	}
+	if (envelope.flags & envelope_chunk) {
+		if (size < pos + envelope_chunk_size)
+			throw std::runtime_error("Truncated envelope.");
+		envelope.chunk_id = read_uint64(data + pos);
+		envelope.chunk_index = read_uint32(data + pos + 8);
+		envelope.chunk_count = read_uint32(data + pos + 12);
+		envelope.chunk_offset = read_uint64(data + pos + 16);
+		envelope.message_size = read_uint64(data + pos + 24);
+		pos += envelope_chunk_size;
+	}
+	if (envelope.flags & envelope_batch) {
+		if (size < pos + 4)
+			throw std::runtime_error("Truncated envelope.");
+		envelope.batch_count = read_uint32(data + pos);
+		pos += 4;
+	}
+	if (envelope.flags & envelope_compressed) {
+		if (size < pos + 1 + 8)
+			throw std::runtime_error("Truncated envelope.");
+		envelope.compression = static_cast<Compression>(data[pos]);
+		envelope.uncompressed_size = read_uint64(data + pos + 1);
+		pos += 1 + 8;
+	}
+	return pos;
+}
+
+/// Helper function to wrap a message in an envelope with expiry if it has a time to live.
+/// Only wraps messages if needed to stay compatible to other MQTT clients.
+static const std::string & wrap_expiry(const std::string &message, const std::chrono::duration<double> &ttl, std::string &wrapped)
+{
+	if (ttl == std::chrono::duration<double>::max())
+		return message;
+	MQTT_envelope envelope;
+	envelope.flags |= envelope_expiry;
+	envelope.expiry = std::chrono::system_clock::now() + std::chrono::duration_cast<std::chrono::system_clock::duration>(ttl);
+	wrapped = wrap_envelope(envelope, message.data(), message.size());
+	return wrapped;
+}
+
+/// Helper function to compress a payload and wrap it in an envelope.
+/// Returns false if the compressed payload would not be smaller.
+static bool compress_payload(Compression compression, const std::string &payload, std::string &compressed)
+{
+	MQTT_envelope envelope;
+	envelope.flags = envelope_compressed;
+	envelope.compression = compression;
+	envelope.uncompressed_size = payload.size();
+	// Compress right behind the envelope, keeping the capacity of a reused buffer.
+	compressed.clear();
+	append_envelope(compressed, envelope);
+	auto header_size = compressed.size();
+	std::size_t compressed_size;
+	switch (compression) {
+#ifdef FASTLIB_ENABLE_LZ4
+	case Compression::lz4: {
+		if (payload.size() > static_cast<std::size_t>(LZ4_MAX_INPUT_SIZE))
+			return false;
+		compressed.resize(header_size + LZ4_compressBound(static_cast<int>(payload.size())));
+		int ret = LZ4_compress_default(payload.data(), &compressed[header_size], static_cast<int>(payload.size()),
+					       static_cast<int>(compressed.size() - header_size));
+		if (ret <= 0)
+			return false;
+		compressed_size = static_cast<std::size_t>(ret);
+		break;
+	}
+#endif
+#ifdef FASTLIB_ENABLE_ZLIB
+	case Compression::zlib: {
+		auto bound = compressBound(payload.size());
+		compressed.resize(header_size + bound);
+		if (compress2(reinterpret_cast<Bytef *>(&compressed[header_size]), &bound,
+			      reinterpret_cast<const Bytef *>(payload.data()), payload.size(), Z_BEST_SPEED) != Z_OK)
+			return false;
+		compressed_size = bound;
+		break;
+	}
+#endif
+	default:
+		throw std::runtime_error("Compression algorithm is not available.");
+	}
+	if (header_size + compressed_size >= payload.size())
+		return false;
+	compressed.resize(header_size + compressed_size);
+	return true;
+}
+
+/// Helper function to decompress the payload of an envelope.
+/// The uncompressed size is stated by the sender, so it is checked against max_size before allocating.
+static void decompress_payload(const MQTT_envelope &envelope, const char *data, std::size_t size, std::string &payload, std::uint64_t max_size)
+{
+	(void) data;
+	(void) size;
+	if (envelope.uncompressed_size > std::min<std::uint64_t>(max_size, std::numeric_limits<std::uint32_t>::max()))
+		throw std::runtime_error("Compressed message is too large.");
+	payload.resize(envelope.uncompressed_size);
+	switch (envelope.compression) {
+#ifdef FASTLIB_ENABLE_LZ4
+	case Compression::lz4:
+		if (size > static_cast<std::size_t>(std::numeric_limits<int>::max()) ||
+		    LZ4_decompress_safe(data, &payload[0], static_cast<int>(size), static_cast<int>(payload.size())) != static_cast<int>(payload.size()))
+			throw std::runtime_error("Error decompressing message.");
+		return;
+#endif
+#ifdef FASTLIB_ENABLE_ZLIB
+	case Compression::zlib: {
+		uLongf uncompressed_size = payload.size();
+		if (uncompress(reinterpret_cast<Bytef *>(&payload[0]), &uncompressed_size, reinterpret_cast<const Bytef *>(data), size) != Z_OK ||
+		    uncompressed_size != payload.size())
+			throw std::runtime_error("Error decompressing message.");
+		return;
+	}
+#endif
+	default:
+		throw std::runtime_error("Compression algorithm of message is not available.");
+	}
+}
+
+/// Get the buffer of the calling thread for decompressing received messages.
+static std::string & decompression_buffer()
+{
+	static thread_local std::string buffer;
+	return buffer;
+}
+
+/// Helper function to read the envelope of a message which is neither a chunk nor a batch, decompressing it if needed.
+/// Returns the envelope of the uncompressed message and sets payload to the message without envelope.
+/// Compressed messages larger than max_size are rejected.
+static MQTT_envelope open_message(const char *data, std::size_t size, std::string &payload, std::uint64_t max_size)
+{
+	MQTT_envelope envelope;
+	auto header_size = unwrap_envelope(data, size, envelope);
+	if (!(envelope.flags & envelope_compressed)) {
+		payload.assign(data + header_size, size - header_size);
+		return envelope;
+	}
+	// Decompress into a reused buffer, so only the payload is allocated with its final size.
+	auto &buffer = decompression_buffer();
+	decompress_payload(envelope, data + header_size, size - header_size, buffer, max_size);
+	// The compressed message may have an envelope with expiry itself.
+	envelope = MQTT_envelope();
+	header_size = unwrap_envelope(buffer.data(), buffer.size(), envelope);
+	payload.assign(buffer, header_size, std::string::npos);
+	// Do not keep the memory of exceptionally large messages.
+	if (buffer.capacity() > 4 * default_chunk_size)
+		std::string().swap(buffer);
+	return envelope;
+}
+
+/// Helper function to get the number of chunks a payload is sent in, 0 for sending it at once.
+static std::size_t count_chunks(std::size_t payload_size, std::size_t chunk_size)
+{
+	if (chunk_size == 0 || payload_size <= chunk_size)
+		return 0;
+	auto chunk_count = (payload_size + chunk_size - 1) / chunk_size;
+	if (chunk_count > std::numeric_limits<std::uint32_t>::max())
+		throw std::runtime_error("Message is too large to be sent in chunks.");
+	return chunk_count;
+}
+
+/// The number of priorities, i.e., the number of lanes in queues.
+static const std::size_t priority_count = 3;
+
+/// Helper function to get the lane of a priority in queues.
+static std::size_t lane(Priority priority)
+{
+	return static_cast<std::size_t>(priority);
+}
+
+/// Helper function to override a topic policy with explicitly passed arguments.
+static Topic_policy override_policy(Topic_policy policy, int qos, Priority priority)
+{
+	if (qos != -1)
+		policy.qos = qos;
+	if (priority != Priority::by_policy)
+		policy.priority = priority;
+	return policy;
+}
+
+/// Memory of the queues of a communicator, which is bound to the NUMA nodes of its threads on request.
+///
+/// Allocations are served by the global heap until the memory is bound for the first time. From then on,
+/// blocks are taken from slabs mapped for the queues, so they are placed on the bound nodes no matter
+/// which thread allocates them. Freed blocks are kept for reuse until the memory is destroyed.
+class MQTT_queue_memory
+{
+public:
+	MQTT_queue_memory();
+	~MQTT_queue_memory();
+	void * allocate(std::size_t size);
+	void deallocate(void *ptr, std::size_t size);
+	// Bind new memory to the NUMA nodes of the CPUs and move memory bound before. Unbinds the memory if cpus is empty.
+	void bind(const std::vector<int> &cpus);
+#ifdef FASTLIB_ENABLE_NUMA
+private:
+	static const std::size_t min_block_size = 64;
+	static const std::size_t block_class_count = 13; // Powers of two from min_block_size to max_queue_block_size.
+	// Get the size class of a block.
+	static std::size_t block_class(std::size_t size);
+	// Map a region, which is bound to the current nodes. Requires the mutex.
+	char * map_region(std::size_t size);
+	// Apply the current nodes to a region. Requires the mutex.
+	void bind_region(char *ptr, std::size_t size, unsigned int flags) const;
+	std::mutex mutex;
+	std::atomic<bool> pooled; // Blocks are taken from slabs, i.e., bind() was called.
+	std::vector<unsigned long> node_mask; // Empty if the memory is not bound.
+	std::map<char *, std::size_t> regions; // All mapped slabs and large blocks by address.
+	std::array<void *, block_class_count> free_blocks; // Singly linked lists of free blocks per size.
+	std::array<std::pair<char *, char *>, block_class_count> slabs; // The unused space of the current slab per size.
+#endif
+};
+
+MQTT_queue_memory::MQTT_queue_memory()
+#ifdef FASTLIB_ENABLE_NUMA
+	: pooled(false)
+#endif
+{
+#ifdef FASTLIB_ENABLE_NUMA
+	free_blocks.fill(nullptr);
+	slabs.fill(std::make_pair(nullptr, nullptr));
+#endif
+}
+
+MQTT_queue_memory::~MQTT_queue_memory()
+{
+#ifdef FASTLIB_ENABLE_NUMA
+	for (auto &region : regions)
+		numa_free(region.first, region.second);
+#endif
+}
+
+void * MQTT_queue_memory::allocate(std::size_t size)
+{
+#ifdef FASTLIB_ENABLE_NUMA
+	if (pooled) {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (size > max_queue_block_size)
+			return map_region(size);
+		auto size_class = block_class(size);
+		auto &block = free_blocks[size_class];
+		if (block) {
+			auto ptr = block;
+			block = *static_cast<void **>(block);
+			return ptr;
+		}
+		std::size_t block_size = min_block_size << size_class;
+		auto &slab = slabs[size_class];
+		if (slab.first == slab.second) {
+			std::size_t slab_size = std::max<std::size_t>(256 * 1024, 4 * block_size);
+			slab.first = map_region(slab_size);
+			slab.second = slab.first + slab_size;
+		}
+		auto ptr = slab.first;
+		slab.first += block_size;
+		return ptr;
+	}
+#endif
+	return ::operator new(size);
+}
+
+void MQTT_queue_memory::deallocate(void *ptr, std::size_t size)
+{
+#ifdef FASTLIB_ENABLE_NUMA
+	if (pooled) {
+		std::lock_guard<std::mutex> lock(mutex);
+		// Blocks allocated before the memory was bound for the first time are not in a region.
+		auto region = regions.upper_bound(static_cast<char *>(ptr));
+		if (region != regions.begin() && static_cast<char *>(ptr) < std::prev(region)->first + std::prev(region)->second) {
+			--region;
+			if (size > max_queue_block_size) {
+				numa_free(region->first, region->second);
+				regions.erase(region);
+			} else {
+				auto &block = free_blocks[block_class(size)];
+				*static_cast<void **>(ptr) = block;
+				block = ptr;
+			}
+			return;
+		}
+	}
+#else
+	(void) size;
+#endif
+	::operator delete(ptr);
+}
+
+void MQTT_queue_memory::bind(const std::vector<int> &cpus)
+{
+#ifdef FASTLIB_ENABLE_NUMA
+	const std::size_t bits = 8 * sizeof(unsigned long);
+	std::vector<unsigned long> mask;
+	if (!cpus.empty())
+		mask.resize((static_cast<std::size_t>(numa_num_possible_nodes()) + bits - 1) / bits);
+	for (auto cpu : cpus) {
+		int node = numa_node_of_cpu(cpu);
+		if (node < 0)
+			throw std::runtime_error("No NUMA node found for CPU " + std::to_string(cpu) + ".");
+		mask[static_cast<std::size_t>(node) / bits] |= 1ul << (static_cast<std::size_t>(node) % bits);
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	// Memory which was never bound stays on the global heap.
+	if (mask.empty() && !pooled)
+		return;
+	node_mask = std::move(mask);
+	for (auto &region : regions)
+		bind_region(region.first, region.second, MPOL_MF_MOVE);
+	pooled = true;
+#else
+	if (!cpus.empty())
+		throw std::runtime_error("Binding memory to NUMA nodes is not available.");
+#endif
+}
+
+#ifdef FASTLIB_ENABLE_NUMA
+std::size_t MQTT_queue_memory::block_class(std::size_t size)
+{
+	std::size_t size_class = 0;
+	for (std::size_t block_size = min_block_size; block_size < size; block_size *= 2)
+		++size_class;
+	return size_class;
+}
+
+char * MQTT_queue_memory::map_region(std::size_t size)
+{
+	auto ptr = static_cast<char *>(numa_alloc(size));
+	if (!ptr)
+		throw std::bad_alloc();
+	try {
+		bind_region(ptr, size, 0);
+		regions.emplace(ptr, size);
+	} catch (...) {
+		numa_free(ptr, size);
+		throw;
+	}
+	return ptr;
+}
+
+void MQTT_queue_memory::bind_region(char *ptr, std::size_t size, unsigned int flags) const
+{
+	long ret = node_mask.empty() ?
+		mbind(ptr, size, MPOL_DEFAULT, nullptr, 0, 0) :
+		mbind(ptr, size, MPOL_BIND, node_mask.data(), 8 * sizeof(unsigned long) * node_mask.size() + 1, flags);
+	// Pages in use elsewhere may fail to move, but new pages are placed on the nodes.
+	if (ret != 0 && !(errno == EIO && (flags & MPOL_MF_MOVE)))
+		throw std::runtime_error("Error binding queue memory to NUMA nodes: " + std::string(std::strerror(errno)));
+}
+#endif
+
+/// An allocator taking memory for the queues of a communicator. Default constructed, it uses the global heap.
+template<class T> struct MQTT_queue_allocator
+{
+	typedef T value_type;
+	typedef std::true_type propagate_on_container_copy_assignment;
+	typedef std::true_type propagate_on_container_move_assignment;
+	typedef std::true_type propagate_on_container_swap;
+	template<class U> struct rebind
+	{
+		typedef MQTT_queue_allocator<U> other;
+	};
+	MQTT_queue_allocator() = default;
+	// Copied instead of moved, as containers still use an allocator after moving it.
+	MQTT_queue_allocator(const MQTT_queue_allocator &other) = default;
+	MQTT_queue_allocator & operator=(const MQTT_queue_allocator &other) = default;
+	MQTT_queue_allocator(std::shared_ptr<MQTT_queue_memory> memory) :
+		memory(std::move(memory))
+	{
+	}
+	template<class U> MQTT_queue_allocator(const MQTT_queue_allocator<U> &other) :
+		memory(other.memory)
+	{
+	}
+	T * allocate(std::size_t n)
+	{
+		return static_cast<T *>(memory ? memory->allocate(n * sizeof(T)) : ::operator new(n * sizeof(T)));
+	}
+	void deallocate(T *ptr, std::size_t n)
+	{
+		if (memory)
+			memory->deallocate(ptr, n * sizeof(T));
+		else
+			::operator delete(ptr);
+	}
+	std::shared_ptr<MQTT_queue_memory> memory;
+};
+
+template<class T, class U> bool operator==(const MQTT_queue_allocator<T> &lhs, const MQTT_queue_allocator<U> &rhs)
+{
+	return lhs.memory == rhs.memory;
+}
+
+template<class T, class U> bool operator!=(const MQTT_queue_allocator<T> &lhs, const MQTT_queue_allocator<U> &rhs)
+{
+	return lhs.memory != rhs.memory;
+}
+
+/// A string in the memory of the queues.
+typedef std::basic_string<char, std::char_traits<char>, MQTT_queue_allocator<char>> MQTT_queue_string;
+
+/// Helper function to copy a payload into the memory of the queues.
+static std::shared_ptr<const MQTT_queue_string> queue_payload(const char *data, std::size_t size, const MQTT_queue_allocator<char> &allocator)
+{
+	return std::allocate_shared<MQTT_queue_string>(allocator, data, size, allocator);
+}
+
+/// A received message as queued in subscriptions.
+struct MQTT_message
+{
+	std::string topic;
+	std::string payload;
+	std::chrono::system_clock::time_point expiry;
+	std::chrono::steady_clock::time_point arrival;
+};
+
+/// A queue of received messages in the memory of the queues.
+typedef std::deque<MQTT_message, MQTT_queue_allocator<MQTT_message>> MQTT_message_queue;
+
+/// A bounded set of recently seen message keys.
+class MQTT_seen_set
+{
+public:
+	MQTT_seen_set(MQTT_communicator::message_key_function_t key_function, std::chrono::steady_clock::duration window, std::size_t capacity);
+	// Remember the key of a message. Returns false if it was already seen within the window.
+	bool insert(const MQTT_message &msg);
+private:
+	const MQTT_communicator::message_key_function_t key_function;
+	const std::chrono::steady_clock::duration window;
+	const std::size_t capacity;
+	std::unordered_map<std::string, std::chrono::steady_clock::time_point> seen;
+	std::deque<std::pair<std::chrono::steady_clock::time_point, std::string>> history; // Oldest key first.
+};
+
+MQTT_seen_set::MQTT_seen_set(MQTT_communicator::message_key_function_t key_function, std::chrono::steady_clock::duration window, std::size_t capacity) :
+	key_function(std::move(key_function)),
+	window(window),
+	capacity(capacity)
+{
+}
+
+bool MQTT_seen_set::insert(const MQTT_message &msg)
+{
+	auto key = key_function(msg.payload);
+	if (key.empty())
+		return true;
+	// Forget keys which left the window or exceed the capacity.
+	while (!history.empty() && (msg.arrival - history.front().first >= window || history.size() >= capacity)) {
+		auto entry = seen.find(history.front().second);
+		// Only forget the key if it was not seen again later.
+		if (entry != seen.end() && entry->second == history.front().first)
+			seen.erase(entry);
+		history.pop_front();
+	}
+	auto entry = seen.find(key);
+	if (entry != seen.end())
+		return false;
+	seen.emplace(key, msg.arrival);
+	history.emplace_back(msg.arrival, std::move(key));
+	return true;
+}
 
 class MQTT_subscription
 {
 public:
-	MQTT_subscription(int qos);
+	MQTT_subscription(const Topic_policy &policy);
 	virtual ~MQTT_subscription() = default;
-	virtual void add_message(const mosquitto_message *msg) = 0;
+	virtual void add_message(const MQTT_message &msg, Priority priority) = 0;
 	virtual std::string get_message(const std::chrono::duration<double> &duration, std::string *actual_topic = nullptr) = 0;
+	void set_ttl(const std::chrono::duration<double> &ttl);
+	void set_seen_set(std::unique_ptr<MQTT_seen_set> seen_set);
+	void set_filter(std::string key, MQTT_communicator::message_filter_t predicate);
+	Subscription_stats get_stats() const;
+	// Pin the threads of the subscription to a set of CPUs.
+	virtual void pin(const std::vector<int> &cpus);
 	const int qos;
+	const Priority priority;
+	const std::size_t queue_bound;
+protected:
+	// Count a received message. Returns false if it already expired, is filtered or is a duplicate.
+	bool accept(const MQTT_message &msg);
+	// Check if a message expired. If so, it is counted as expired.
+	bool discard_expired(const MQTT_message &msg);
+	std::atomic<std::uint64_t> dropped;
+private:
+	std::atomic<std::chrono::steady_clock::rep> ttl; // Time to live in ticks of steady_clock.
+	std::atomic<std::uint64_t> received;
+	std::atomic<std::uint64_t> expired;
+	std::atomic<std::uint64_t> duplicates;
+	std::atomic<std::uint64_t> filtered;
+	std::mutex filters_mutex;
+	std::unique_ptr<MQTT_seen_set> seen_set; // Only set if duplicates are dropped.
+	std::string filter_key;
+	MQTT_communicator::message_filter_t filter_predicate; // Only set if messages are filtered.
 };
 
-MQTT_subscription::MQTT_subscription(int qos) :
-	qos(qos)
+MQTT_subscription::MQTT_subscription(const Topic_policy &policy) :
+	qos(policy.qos),
+	priority(policy.priority),
+	queue_bound(policy.queue_bound),
+	dropped(0),
+	ttl(std::chrono::steady_clock::duration::max().count()),
+	received(0),
+	expired(0),
+	duplicates(0),
+	filtered(0)
+{
+}
+
+void MQTT_subscription::set_ttl(const std::chrono::duration<double> &ttl)
+{
+	if (ttl >= std::chrono::steady_clock::duration::max())
+		this->ttl = std::chrono::steady_clock::duration::max().count();
+	else
+		this->ttl = std::chrono::duration_cast<std::chrono::steady_clock::duration>(ttl).count();
+}
+
+void MQTT_subscription::set_seen_set(std::unique_ptr<MQTT_seen_set> seen_set)
+{
+	std::lock_guard<std::mutex> lock(filters_mutex);
+	this->seen_set = std::move(seen_set);
+}
+
+void MQTT_subscription::set_filter(std::string key, MQTT_communicator::message_filter_t predicate)
+{
+	std::lock_guard<std::mutex> lock(filters_mutex);
+	filter_key = std::move(key);
+	filter_predicate = std::move(predicate);
+}
+
+void MQTT_subscription::pin(const std::vector<int> &cpus)
+{
+	(void) cpus;
+}
+
+Subscription_stats MQTT_subscription::get_stats() const
+{
+	return Subscription_stats{received, expired, duplicates, dropped, filtered};
+}
+
+bool MQTT_subscription::accept(const MQTT_message &msg)
+{
+	++received;
+	if (discard_expired(msg))
+		return false;
+	std::lock_guard<std::mutex> lock(filters_mutex);
+	if (filter_predicate) {
+		// Scan the raw payload instead of parsing it. Malformed messages are filtered.
+		std::string value;
+		bool found = false;
+		try {
+			found = peek_scalar(msg.payload, filter_key, value);
+		} catch (const std::runtime_error &) {
+		}
+		if (!found || !filter_predicate(value)) {
+			++filtered;
+			return false;
+		}
+	}
+	if (seen_set && !seen_set->insert(msg)) {
+		++duplicates;
+		return false;
+	}
+	return true;
+}
+
+bool MQTT_subscription::discard_expired(const MQTT_message &msg)
+{
+	std::chrono::steady_clock::duration ttl(this->ttl);
+	bool is_expired = msg.expiry <= std::chrono::system_clock::now() ||
+		(ttl != std::chrono::steady_clock::duration::max() && std::chrono::steady_clock::now() - msg.arrival >= ttl);
+	if (is_expired)
+		++expired;
+	return is_expired;
+}
+
+class MQTT_subscription_get : public MQTT_subscription
+{
+public:
+	MQTT_subscription_get(const Topic_policy &policy, const MQTT_queue_allocator<MQTT_message> &allocator);
+	void add_message(const MQTT_message &msg, Priority priority) override;
+	std::string get_message(const std::chrono::duration<double> &duration, std::string *actual_topic = nullptr) override;
+private:
+	bool empty() const;
+	std::mutex msg_queue_mutex;
+	std::condition_variable msg_queue_empty_cv;
+	std::array<std::queue<MQTT_message, MQTT_message_queue>, priority_count> messages; // One queue per priority.
+	std::size_t size;
+};
+
+class MQTT_subscription_callback : public MQTT_subscription
+{
+public:
+	MQTT_subscription_callback(const Topic_policy &policy, std::function<void(std::string)> callback, const MQTT_queue_allocator<MQTT_message> &allocator);
+	~MQTT_subscription_callback();
+	void add_message(const MQTT_message &msg, Priority priority) override;
+	std::string get_message(const std::chrono::duration<double> &duration, std::string *actual_topic = nullptr) override;
+	void pin(const std::vector<int> &cpus) override;
+private:
+	// Call the callback for queued messages in deferred dispatch mode.
+	void run_dispatch_loop();
+	std::string message;
+	std::function<void(std::string)> callback;
+	std::mutex dispatch_mutex;
+	std::condition_variable dispatch_cv;
+	MQTT_message_queue dispatch_queue;
+	bool dispatch_running;
+	std::thread dispatch_thread; // Only started in deferred dispatch mode.
+};
+
+MQTT_subscription_get::MQTT_subscription_get(const Topic_policy &policy, const MQTT_queue_allocator<MQTT_message> &allocator) :
+	MQTT_subscription(policy),
+	size(0)
+{
+	for (auto &queue : messages)
+		queue = std::queue<MQTT_message, MQTT_message_queue>(MQTT_message_queue(allocator));
+}
+
+bool MQTT_subscription_get::empty() const
+{
+	return std::all_of(messages.begin(), messages.end(), [](const std::queue<MQTT_message, MQTT_message_queue> &queue) {
+		return queue.empty();
+	});
+}
+
+void MQTT_subscription_get::add_message(const MQTT_message &msg, Priority priority)
+{
+	if (!accept(msg))
+		return;
+	std::lock_guard<std::mutex> lock(msg_queue_mutex);
+	if (queue_bound != 0 && size == queue_bound) {
+		auto queue = std::find_if(messages.begin(), messages.end(), [](const std::queue<MQTT_message, MQTT_message_queue> &queue) {
+			return !queue.empty();
+		});
+		++dropped;
+		// Only a message with a higher priority makes room by dropping the oldest message with the lowest priority.
+		if (lane(priority) <= static_cast<std::size_t>(queue - messages.begin()))
+			return;
+		queue->pop();
+		--size;
+	}
+	bool was_empty = empty();
+	messages[lane(priority)].push(msg);
+	++size;
+	if (was_empty)
+		msg_queue_empty_cv.notify_one();
+}
+
+std::string MQTT_subscription_get::get_message(const std::chrono::duration<double> &duration, std::string *actual_topic)
+{
+	auto start = std::chrono::steady_clock::now();
+	std::unique_lock<std::mutex> lock(msg_queue_mutex);
+	MQTT_message msg;
+	do {
+		if (duration == std::chrono::duration<double>::max()) {
+			// Wait without timeout
+			msg_queue_empty_cv.wait(lock, [this]{return !empty();});
+		} else {
+			// Wait with timeout
+			auto time_left = duration - (std::chrono::steady_clock::now() - start);
+			if (!msg_queue_empty_cv.wait_for(lock, time_left, [this]{return !empty();}))
+				throw std::runtime_error("Timeout while waiting for message.");
+		}
+		// Take the oldest message with the highest priority.
+		auto queue = std::find_if(messages.rbegin(), messages.rend(), [](const std::queue<MQTT_message, MQTT_message_queue> &queue) {
+			return !queue.empty();
+		});
+		msg = std::move(queue->front());
+		queue->pop();
+		--size;
+		// Skip expired messages, e.g., the backlog of a stalled consumer.
+	} while (discard_expired(msg));
+	lock.unlock();
+	if (actual_topic)
+		*actual_topic = std::move(msg.topic);
+	return std::move(msg.payload);
+}
+
+MQTT_subscription_callback::MQTT_subscription_callback(const Topic_policy &policy, std::function<void(std::string)> callback, const MQTT_queue_allocator<MQTT_message> &allocator) :
+	MQTT_subscription(policy),
+	callback(std::move(callback)),
+	dispatch_queue(allocator),
+	dispatch_running(policy.dispatch == Dispatch_mode::deferred)
+{
+	if (dispatch_running)
+		dispatch_thread = std::thread(&MQTT_subscription_callback::run_dispatch_loop, this);
+}
+
+MQTT_subscription_callback::~MQTT_subscription_callback()
+{
+	if (!dispatch_thread.joinable())
+		return;
+	std::unique_lock<std::mutex> lock(dispatch_mutex);
+	dispatch_running = false;
+	lock.unlock();
+	dispatch_cv.notify_one();
+	// The callback may have removed its own subscription.
+	if (dispatch_thread.get_id() == std::this_thread::get_id())
+		dispatch_thread.detach();
+	else
+		dispatch_thread.join();
+}
+
+void MQTT_subscription_callback::pin(const std::vector<int> &cpus)
+{
+	if (dispatch_thread.joinable())
+		pin_thread(dispatch_thread, cpus);
+}
+
+void MQTT_subscription_callback::add_message(const MQTT_message &msg, Priority priority)
+{
+	(void) priority;
+	if (!accept(msg))
+		return;
+	if (!dispatch_thread.joinable()) {
+		callback(msg.payload);
+		return;
+	}
+	std::unique_lock<std::mutex> lock(dispatch_mutex);
+	// Callbacks are dispatched in order of arrival, so no arriving message outranks the queued ones.
+	if (queue_bound != 0 && dispatch_queue.size() == queue_bound) {
+		++dropped;
+		return;
+	}
+	dispatch_queue.push_back(msg);
+	lock.unlock();
+	dispatch_cv.notify_one();
+}
+
+void MQTT_subscription_callback::run_dispatch_loop()
+{
+	std::unique_lock<std::mutex> lock(dispatch_mutex);
+	while (true) {
+		dispatch_cv.wait(lock, [this]{return !dispatch_queue.empty() || !dispatch_running;});
+		if (!dispatch_running)
+			break;
+		auto msg = std::move(dispatch_queue.front());
+		dispatch_queue.pop_front();
+		lock.unlock();
+		if (!discard_expired(msg)) {
+			try {
+				callback(std::move(msg.payload));
+			} catch (const std::exception &e) {
+				FASTLIB_LOG(comm_log, trace) << "Exception in callback: " << e.what();
+			}
+		}
+		lock.lock();
+	}
+}
+
+std::string MQTT_subscription_callback::get_message(const std::chrono::duration<double> &duration, std::string *actual_topic)
+{
+	(void) duration, (void) actual_topic;
+	throw std::runtime_error("Error in get_message: This topic is subscribed with callback.");
+}
+
+/// A message held back by the outbound queue.
+struct MQTT_outbound_message
+{
+	std::string topic;
+	std::shared_ptr<const MQTT_queue_string> payload; // Shared by messages sent to several topics.
+	int qos;
+	bool retain;
+	// The payload is sent in chunks if chunk_count is not 0.
+	std::uint64_t chunk_id;
+	std::uint32_t chunk_count;
+	std::uint32_t next_chunk;
+	std::size_t chunk_size;
+	// The message is added to a batch of the topic if batch_size is greater than 1.
+	std::size_t batch_size;
+	std::chrono::microseconds batch_delay;
+};
+
+/// Messages of a topic collected to be sent in one payload.
+struct MQTT_outbound_batch
+{
+	MQTT_queue_string payload; // Envelope followed by the size and data of each message.
+	std::uint32_t count;
+	std::chrono::steady_clock::time_point deadline;
+	int qos;
+	bool retain;
+	Priority priority;
+};
+
+/// A lock-free queue of posted messages with a single producer thread and the outbound thread as consumer.
+class MQTT_producer_queue
+{
+public:
+	MQTT_producer_queue(std::shared_ptr<MQTT_queue_memory> memory);
+	// Called by the producer only. Returns false if the queue is full.
+	bool push(MQTT_outbound_message &msg, Priority priority);
+	// Called by the consumer only. Returns false if the queue is empty.
+	bool pop(MQTT_outbound_message &msg, Priority &priority);
+	bool empty() const;
+	std::atomic<bool> abandoned; // The producer thread exited.
+	std::atomic<bool> closed; // The communicator was destroyed.
+	// Topic policies cached by the producer thread.
+	std::unordered_map<std::string, Topic_policy> policies;
+	std::uint64_t policies_version;
+private:
+	struct Slot
+	{
+		MQTT_outbound_message msg;
+		Priority priority;
+	};
+	std::vector<Slot, MQTT_queue_allocator<Slot>> slots;
+	std::atomic<std::size_t> head; // Next slot to pop, only written by the consumer.
+	char padding[64]; // Keep head and tail in different cache lines.
+	std::atomic<std::size_t> tail; // Next slot to push, only written by the producer.
+};
+
+MQTT_producer_queue::MQTT_producer_queue(std::shared_ptr<MQTT_queue_memory> memory) :
+	abandoned(false),
+	closed(false),
+	policies_version(std::numeric_limits<std::uint64_t>::max()),
+	slots(producer_queue_size, Slot(), MQTT_queue_allocator<Slot>(std::move(memory))),
+	head(0),
+	tail(0)
+{
+}
+
+bool MQTT_producer_queue::push(MQTT_outbound_message &msg, Priority priority)
+{
+	auto tail = this->tail.load(std::memory_order_relaxed);
+	if (tail - head.load(std::memory_order_acquire) == slots.size())
+		return false;
+	auto &slot = slots[tail % slots.size()];
+	slot.msg = std::move(msg);
+	slot.priority = priority;
+	// Sequentially consistent, so the consumer either sees the message or is woken up.
+	this->tail.store(tail + 1);
+	return true;
+}
+
+bool MQTT_producer_queue::pop(MQTT_outbound_message &msg, Priority &priority)
+{
+	auto head = this->head.load(std::memory_order_relaxed);
+	if (head == tail.load(std::memory_order_acquire))
+		return false;
+	auto &slot = slots[head % slots.size()];
+	msg = std::move(slot.msg);
+	slot.msg.payload.reset();
+	priority = slot.priority;
+	this->head.store(head + 1, std::memory_order_release);
+	return true;
+}
+
+bool MQTT_producer_queue::empty() const
+{
+	return head.load(std::memory_order_relaxed) == tail.load();
+}
+
+/// The producer queues of a thread, one per communicator it posted messages to.
+struct MQTT_producer_registry
+{
+	~MQTT_producer_registry();
+	std::unordered_map<std::uint64_t, std::shared_ptr<MQTT_producer_queue>> queues;
+};
+
+MQTT_producer_registry::~MQTT_producer_registry()
+{
+	for (auto &queue : queues)
+		queue.second->abandoned = true;
+}
+
+static thread_local MQTT_producer_registry producer_registry;
+
+/// The source of unique ids of outbound queues.
+static std::atomic<std::uint64_t> next_outbound_queue_id(0);
+
+class MQTT_outbound_queue
+{
+public:
+	MQTT_outbound_queue();
+	~MQTT_outbound_queue();
+	// Check if messages with at least the given priority are held back.
+	bool holds(Priority priority = Priority::low) const;
+	void push(MQTT_outbound_message msg, Priority priority);
+	// Take the oldest message with the highest priority. Returns false if empty.
+	bool pop(MQTT_outbound_message &msg, Priority &priority);
+	// Get the producer queue of the calling thread.
+	MQTT_producer_queue & producer();
+	// Move posted messages from the producer queues to the queues per priority. Requires the mutex.
+	void drain_producers();
+	// Check if all producer queues are empty. Requires the mutex.
+	bool producers_empty() const;
+	// Check if no message is held back or posted. Requires the mutex.
+	bool drained() const;
+	// Send batches which are due or all batches if forced. Returns the time the next batch is due.
+	std::chrono::steady_clock::time_point flush_batches(bool force);
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::condition_variable drained_cv; // Notified while shutting down when messages were sent.
+	bool running;
+	std::atomic<bool> accepting; // New messages are accepted, i.e., shutdown() was not called.
+	std::atomic<std::size_t> in_flight; // Messages handed to mosquitto but not yet sent or acknowledged.
+	std::atomic<bool> writer_sleeping; // The outbound thread waits for messages.
+	std::atomic<std::size_t> chunk_size;
+	std::atomic<std::uint64_t> next_chunk_id;
+	const std::uint64_t id;
+	const std::shared_ptr<MQTT_queue_memory> memory; // Shared with the producer queues and subscriptions.
+private:
+	typedef std::deque<MQTT_outbound_message, MQTT_queue_allocator<MQTT_outbound_message>> Lane;
+	std::array<Lane, priority_count> messages; // One queue per priority.
+	std::vector<std::shared_ptr<MQTT_producer_queue>> producers;
+	std::unordered_map<std::string, MQTT_outbound_batch> batches; // One batch per topic.
+	void add_to_batch(MQTT_outbound_message msg, Priority priority);
+	void flush_batch(std::unordered_map<std::string, MQTT_outbound_batch>::iterator batch);
+};
+
+MQTT_outbound_queue::MQTT_outbound_queue() :
+	running(false),
+	accepting(true),
+	in_flight(0),
+	writer_sleeping(false),
+	chunk_size(default_chunk_size),
+	id(next_outbound_queue_id++),
+	memory(std::make_shared<MQTT_queue_memory>())
+{
+	for (auto &lane : messages)
+		lane = Lane(MQTT_queue_allocator<MQTT_outbound_message>(memory));
+	// Chunk ids must not collide with those of other senders on the same topic.
+	std::random_device random;
+	next_chunk_id = (static_cast<std::uint64_t>(random()) << 32) ^ random();
+}
+
+MQTT_outbound_queue::~MQTT_outbound_queue()
+{
+	// Allow producer threads to forget their queues.
+	for (auto &producer : producers)
+		producer->closed = true;
+}
+
+MQTT_producer_queue & MQTT_outbound_queue::producer()
+{
+	auto &queues = producer_registry.queues;
+	auto queue = queues.find(id);
+	if (queue != queues.end())
+		return *queue->second;
+	// Forget queues of destroyed communicators.
+	for (queue = queues.begin(); queue != queues.end();) {
+		if (queue->second->closed)
+			queue = queues.erase(queue);
+		else
+			++queue;
+	}
+	auto new_queue = std::make_shared<MQTT_producer_queue>(memory);
+	std::unique_lock<std::mutex> lock(mutex);
+	producers.push_back(new_queue);
+	lock.unlock();
+	return *queues.emplace(id, std::move(new_queue)).first->second;
+}
+
+void MQTT_outbound_queue::drain_producers()
+{
+	MQTT_outbound_message msg;
+	Priority priority;
+	for (auto producer = producers.begin(); producer != producers.end();) {
+		while ((*producer)->pop(msg, priority))
+			push(std::move(msg), priority);
+		// Forget queues of exited threads.
+		if ((*producer)->abandoned && (*producer)->empty())
+			producer = producers.erase(producer);
+		else
+			++producer;
+	}
+}
+
+bool MQTT_outbound_queue::producers_empty() const
+{
+	return std::all_of(producers.begin(), producers.end(), [](const std::shared_ptr<MQTT_producer_queue> &producer) {
+		return producer->empty();
+	});
+}
+
+bool MQTT_outbound_queue::drained() const
+{
+	return !holds() && producers_empty() && batches.empty();
+}
+
+bool MQTT_outbound_queue::holds(Priority priority) const
+{
+	return std::any_of(messages.begin() + lane(priority), messages.end(), [](const Lane &queue) {
+		return !queue.empty();
+	});
+}
+
+void MQTT_outbound_queue::push(MQTT_outbound_message msg, Priority priority)
+{
+	if (msg.batch_size > 1)
+		add_to_batch(std::move(msg), priority);
+	else
+		messages[lane(priority)].push_back(std::move(msg));
+}
+
+void MQTT_outbound_queue::add_to_batch(MQTT_outbound_message msg, Priority priority)
+{
+	auto batch = batches.find(msg.topic);
+	// Batches are sent with the same QoS, retain flag and priority and fit in a chunk.
+	if (batch != batches.end() &&
+	    (batch->second.qos != msg.qos || batch->second.retain != msg.retain || batch->second.priority != priority ||
+	     (chunk_size != 0 && batch->second.payload.size() + 4 + msg.payload->size() > chunk_size))) {
+		flush_batch(batch);
+		batch = batches.end();
+	}
+	if (batch == batches.end()) {
+		MQTT_envelope envelope;
+		envelope.flags = envelope_batch;
+		MQTT_queue_string payload{MQTT_queue_allocator<char>(memory)};
+		append_envelope(payload, envelope);
+		batch = batches.emplace(msg.topic, MQTT_outbound_batch{std::move(payload), 0,
+			std::chrono::steady_clock::now() + msg.batch_delay, msg.qos, msg.retain, priority}).first;
+		// Wake the outbound thread up to wait for the deadline of the new batch.
+		writer_sleeping = false;
+	}
+	append_uint32(batch->second.payload, static_cast<std::uint32_t>(msg.payload->size()));
+	batch->second.payload.append(*msg.payload);
+	if (++batch->second.count == msg.batch_size)
+		flush_batch(batch);
+}
+
+void MQTT_outbound_queue::flush_batch(std::unordered_map<std::string, MQTT_outbound_batch>::iterator batch)
+{
+	auto &payload = batch->second.payload;
+	// Patch the message count at the end of the envelope.
+	auto count = batch->second.count;
+	for (std::size_t i = 0; i != 4; ++i)
+		payload[4 + i] = static_cast<char>((count >> (24 - 8 * i)) & 0xFF);
+	std::size_t chunk_size = this->chunk_size;
+	auto chunk_count = count_chunks(payload.size(), chunk_size);
+	messages[lane(batch->second.priority)].push_back(MQTT_outbound_message{batch->first,
+		std::allocate_shared<MQTT_queue_string>(MQTT_queue_allocator<char>(memory), std::move(payload)), batch->second.qos, batch->second.retain,
+		chunk_count != 0 ? next_chunk_id++ : 0, static_cast<std::uint32_t>(chunk_count), 0, chunk_size,
+		0, std::chrono::microseconds(0)});
+	batches.erase(batch);
+}
+
+std::chrono::steady_clock::time_point MQTT_outbound_queue::flush_batches(bool force)
+{
+	auto now = std::chrono::steady_clock::now();
+	auto next = std::chrono::steady_clock::time_point::max();
+	for (auto batch = batches.begin(); batch != batches.end();) {
+		if (force || batch->second.deadline <= now) {
+			auto flushed = batch++;
+			flush_batch(flushed);
+		} else {
+			next = std::min(next, batch->second.deadline);
+			++batch;
+		}
+	}
+	return next;
+}
+
+bool MQTT_outbound_queue::pop(MQTT_outbound_message &msg, Priority &priority)
+{
+	for (auto queue = messages.rbegin(); queue != messages.rend(); ++queue) {
+		if (!queue->empty()) {
+			msg = std::move(queue->front());
+			queue->pop_front();
+			priority = static_cast<Priority>(messages.rend() - queue - 1);
+			return true;
+		}
+	}
+	return false;
+}
+
+/// The number of recent round trips kept by the latency probe.
+static const std::size_t latency_window = 128;
+
+class MQTT_latency_probe
+{
+public:
+	MQTT_latency_probe();
+	// Add a round trip time. Called by the network thread only.
+	void record(std::uint32_t rtt);
+	// Get the bucket of the histogram of a round trip time.
+	static std::size_t bucket(std::uint32_t rtt);
+	const std::string topic; // The private topic of the pings.
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable cv;
+	bool running;
+	std::chrono::steady_clock::duration interval;
+	std::atomic<std::int64_t> stale_after; // In nanoseconds.
+	std::atomic<std::int64_t> last_reply; // Time since epoch of the steady clock in nanoseconds.
+	// Written by the network thread only and read without locks.
+	std::array<std::atomic<std::uint32_t>, latency_window> samples; // Round trip times in microseconds.
+	std::atomic<std::uint64_t> count; // The number of round trips recorded.
+	std::array<std::atomic<std::uint32_t>, std::tuple_size<decltype(Broker_latency::histogram)>::value> histogram;
+};
+
+/// Helper function to get a random hexadecimal id.
+static std::string random_id()
+{
+	std::random_device random;
+	auto id = (static_cast<std::uint64_t>(random()) << 32) ^ random();
+	static const char digits[] = "0123456789abcdef";
+	std::string str;
+	for (int shift = 60; shift >= 0; shift -= 4)
+		str.push_back(digits[(id >> shift) & 0xF]);
+	return str;
+}
+
+MQTT_latency_probe::MQTT_latency_probe() :
+	topic("fast/latency-probe/" + random_id()),
+	running(false),
+	stale_after(0),
+	last_reply(0),
+	count(0)
+{
+	for (auto &sample : samples)
+		sample = 0;
+	for (auto &bucket : histogram)
+		bucket = 0;
+}
+
+void MQTT_latency_probe::record(std::uint32_t rtt)
 {
+	auto n = count.load(std::memory_order_relaxed);
+	auto &sample = samples[n % samples.size()];
+	// Evict the oldest round trip from the histogram.
+	if (n >= samples.size())
+		histogram[bucket(sample.load(std::memory_order_relaxed))].fetch_sub(1, std::memory_order_relaxed);
+	sample.store(rtt, std::memory_order_relaxed);
+	histogram[bucket(rtt)].fetch_add(1, std::memory_order_relaxed);
+	count.store(n + 1, std::memory_order_release);
 }
 
-class MQTT_subscription_get : public MQTT_subscription
+std::size_t MQTT_latency_probe::bucket(std::uint32_t rtt)
 {
-public:
-	MQTT_subscription_get(int qos);
-	void add_message(const mosquitto_message *msg) override;
-	std::string get_message(const std::chrono::duration<double> &duration, std::string *actual_topic = nullptr) override;
-private:
-	std::mutex msg_queue_mutex;
-	std::condition_variable msg_queue_empty_cv;
-	std::queue<mosquitto_message*> messages; /// \todo Consider using unique_ptr.
-};
+	std::size_t i = 0;
+	while (rtt >>= 1)
+		++i;
+	return i;
+}
 
-class MQTT_subscription_callback : public MQTT_subscription
+class MQTT_reassembly
 {
 public:
-	MQTT_subscription_callback(int qos, std::function<void(std::string)> callback);
-	void add_message(const mosquitto_message *msg) override;
-	std::string get_message(const std::chrono::duration<double> &duration, std::string *actual_topic = nullptr) override;
+	MQTT_reassembly();
+	// Add a chunk. Returns true and sets payload if this chunk completed its message.
+	bool add(const std::string &topic, const MQTT_envelope &envelope, const char *data, std::size_t size, std::string &payload);
+	// Discard messages which missed the timeout.
+	void reclaim();
+	std::mutex mutex;
+	std::chrono::steady_clock::duration timeout;
+	std::atomic<std::uint64_t> max_message_size; // Limits the memory allocated for chunked or compressed messages.
+	std::uint64_t max_reassembly_size; // Limits the memory allocated for all incomplete messages.
 private:
-	std::string message;
-	std::function<void(std::string)> callback;
+	struct Partial_message
+	{
+		std::string payload;
+		std::vector<bool> received_chunks;
+		std::uint32_t missing_chunks;
+		std::uint64_t sequence; // Orders messages by their first chunk to find the oldest.
+		std::chrono::steady_clock::time_point deadline;
+	};
+	typedef std::map<std::pair<std::string, std::uint64_t>, Partial_message> Partial_message_map;
+	void erase(Partial_message_map::iterator partial);
+	// Evict the oldest incomplete message of the topic if it is at the limit.
+	void make_room(const std::string &topic);
+	Partial_message_map partial_messages;
+	std::uint64_t reassembly_size;
+	std::uint64_t next_sequence;
 };
 
-MQTT_subscription_get::MQTT_subscription_get(int qos) :
-	MQTT_subscription(qos)
+MQTT_reassembly::MQTT_reassembly() :
+	timeout(std::chrono::seconds(30)),
+	max_message_size(default_max_message_size),
+	max_reassembly_size(default_max_reassembly_size),
+	reassembly_size(0),
+	next_sequence(0)
 {
 }
 
-void MQTT_subscription_get::add_message(const mosquitto_message *msg)
+void MQTT_reassembly::erase(Partial_message_map::iterator partial)
 {
-	mosquitto_message* buf = nullptr;
-	buf = static_cast<mosquitto_message*>(std::malloc(sizeof(mosquitto_message)));
-	if (!buf)
-		throw std::runtime_error("malloc failed allocating mosquitto_message.");
-	std::lock_guard<std::mutex> lock(msg_queue_mutex);
-	messages.push(buf);
-	mosquitto_message_copy(messages.back(), msg);
-	if (messages.size() == 1)
-		msg_queue_empty_cv.notify_one();
+	reassembly_size -= partial->second.payload.size();
+	partial_messages.erase(partial);
 }
 
-std::string MQTT_subscription_get::get_message(const std::chrono::duration<double> &duration, std::string *actual_topic)
+void MQTT_reassembly::make_room(const std::string &topic)
 {
-	std::unique_lock<std::mutex> lock(msg_queue_mutex);
-	if (duration == std::chrono::duration<double>::max()) {
-		// Wait without timeout
-		msg_queue_empty_cv.wait(lock, [this]{return !messages.empty();});
-	} else {
-		// Wait with timeout
-		if (!msg_queue_empty_cv.wait_for(lock, duration, [this]{return !messages.empty();}))
-			throw std::runtime_error("Timeout while waiting for message.");
+	// The messages of a topic are adjacent, as the map is ordered by topic first.
+	auto oldest = partial_messages.end();
+	std::size_t count = 0;
+	for (auto partial = partial_messages.lower_bound(std::make_pair(topic, std::uint64_t(0)));
+	     partial != partial_messages.end() && partial->first.first == topic; ++partial) {
+		if (oldest == partial_messages.end() || partial->second.sequence < oldest->second.sequence)
+			oldest = partial;
+		++count;
 	}
-	auto msg = messages.front();
-	messages.pop();
-	lock.unlock();
-	std::string buf(static_cast<char*>(msg->payload), msg->payloadlen);
-	if (actual_topic)
-		actual_topic->assign(msg->topic);
-	mosquitto_message_free(&msg);
-	return buf;
-}
-
-MQTT_subscription_callback::MQTT_subscription_callback(int qos, std::function<void(std::string)> callback) :
-	MQTT_subscription(qos),
-	callback(std::move(callback))
-{
+	if (count < max_partial_messages_per_topic)
+		return;
+	FASTLIB_LOG(comm_log, warn) << "Too many incomplete messages on topic " << topic << ", discarding the oldest.";
+	erase(oldest);
 }
 
-
-void MQTT_subscription_callback::add_message(const mosquitto_message *msg)
+bool MQTT_reassembly::add(const std::string &topic, const MQTT_envelope &envelope, const char *data, std::size_t size, std::string &payload)
 {
-	callback(std::string(static_cast<char*>(msg->payload), msg->payloadlen));
+	if (envelope.chunk_count == 0 || envelope.chunk_index >= envelope.chunk_count ||
+	    envelope.chunk_offset > envelope.message_size || size > envelope.message_size - envelope.chunk_offset ||
+	    envelope.chunk_count > envelope.message_size)
+		throw std::runtime_error("Invalid chunk.");
+	// Check the size before allocating, as it is taken from the envelope of the sender.
+	if (envelope.message_size > max_message_size)
+		throw std::runtime_error("Chunked message exceeds the maximum message size.");
+	auto key = std::make_pair(topic, envelope.chunk_id);
+	auto partial = partial_messages.find(key);
+	if (partial == partial_messages.end()) {
+		make_room(topic);
+		// Reject rather than evict, so messages of other topics cannot be pushed out by forged chunks.
+		if (envelope.message_size > max_reassembly_size - reassembly_size)
+			throw std::runtime_error("Chunked message exceeds the memory left for reassembly.");
+		Partial_message msg;
+		// Chunks are copied to their final place, so no further copy is needed when complete.
+		msg.payload.resize(envelope.message_size);
+		msg.received_chunks.resize(envelope.chunk_count, false);
+		msg.missing_chunks = envelope.chunk_count;
+		msg.sequence = next_sequence++;
+		partial = partial_messages.emplace(std::move(key), std::move(msg)).first;
+		reassembly_size += envelope.message_size;
+	} else if (partial->second.payload.size() != envelope.message_size ||
+		   partial->second.received_chunks.size() != envelope.chunk_count) {
+		throw std::runtime_error("Chunk does not match previous chunks.");
+	}
+	auto &msg = partial->second;
+	// Ignore chunks received twice. They do not extend the deadline, so repeating a chunk cannot keep a message alive.
+	if (msg.received_chunks[envelope.chunk_index])
+		return false;
+	msg.deadline = std::chrono::steady_clock::now() + timeout;
+	std::copy(data, data + size, &msg.payload[envelope.chunk_offset]);
+	msg.received_chunks[envelope.chunk_index] = true;
+	if (--msg.missing_chunks != 0)
+		return false;
+	payload = std::move(msg.payload);
+	reassembly_size -= envelope.message_size;
+	partial_messages.erase(partial);
+	return true;
 }
 
-std::string MQTT_subscription_callback::get_message(const std::chrono::duration<double> &duration, std::string *actual_topic)
+void MQTT_reassembly::reclaim()
 {
-	(void) duration, (void) actual_topic;
-	throw std::runtime_error("Error in get_message: This topic is subscribed with callback.");
+	auto now = std::chrono::steady_clock::now();
+	for (auto partial = partial_messages.begin(); partial != partial_messages.end();) {
+		if (partial->second.deadline <= now) {
+			FASTLIB_LOG(comm_log, warn) << "Discarding incomplete message on topic " << partial->first.first << ".";
+			reassembly_size -= partial->second.payload.size();
+			partial = partial_messages.erase(partial);
+		} else {
+			++partial;
+		}
+	}
 }
 
 MQTT_communicator::MQTT_communicator(const std::string &id, const std::string &publish_topic) :
 	mosqpp::mosquittopp(id == "" ? nullptr : id.c_str()),
 	default_publish_topic(publish_topic),
-	connected(false)
+	connected(false),
+	active_broker(0),
+	keepalive(60),
+	reconnect_enabled(false),
+	switch_requested(false),
+	network_loop_running(false),
+	probe_running(false),
+	probe_interval(std::chrono::seconds(1)),
+	outbound_queue(new MQTT_outbound_queue()),
+	busy_poll(false),
+	policies_version(0),
+	reassembly(new MQTT_reassembly()),
+	latency_probe(new MQTT_latency_probe())
 {
 	init_mosq_lib();
 	start_mosq_loop();
+	start_outbound_thread();
 }
 
 MQTT_communicator::MQTT_communicator(const std::string &id,
@@ -173,6 +1591,8 @@ MQTT_communicator::~MQTT_communicator()
 {
 	FASTLIB_LOG(comm_log, trace) << "Destructing MQTT_communicator.";
 	try {
+		stop_latency_probe();
+		stop_outbound_thread();
 		disconnect_from_broker();
 		stop_mosq_loop();
 		cleanup_mosq_lib();
@@ -184,34 +1604,125 @@ MQTT_communicator::~MQTT_communicator()
 	FASTLIB_LOG(comm_log, trace) << "MQTT_communicator destructed.";
 }
 
-void MQTT_communicator::add_subscription(const std::string &topic, int qos) const
+void MQTT_communicator::set_topic_policy(const std::string &topic_filter, const Topic_policy &policy) const
+{
+	if (policy.qos < 0 || policy.qos > 2)
+		throw std::runtime_error("Invalid QoS in topic policy.");
+	if (policy.priority == Priority::by_policy)
+		throw std::runtime_error("Invalid priority in topic policy.");
+	if (!compression_available(policy.compression))
+		throw std::runtime_error("Compression algorithm is not available.");
+	std::lock_guard<std::mutex> lock(policies_mutex);
+	++policies_version;
+	auto entry = std::find_if(policies.begin(), policies.end(), [&topic_filter](const std::pair<std::string, Topic_policy> &entry) {
+		return entry.first == topic_filter;
+	});
+	if (entry != policies.end())
+		entry->second = policy;
+	else
+		policies.emplace_back(topic_filter, policy);
+	resolved_policies.clear();
+}
+
+Topic_policy MQTT_communicator::get_topic_policy(const std::string &topic) const
+{
+	return resolve_policy(topic).second;
+}
+
+std::pair<bool, Topic_policy> MQTT_communicator::resolve_policy(const std::string &topic) const
+{
+	std::lock_guard<std::mutex> lock(policies_mutex);
+	auto resolved = resolved_policies.find(topic);
+	if (resolved != resolved_policies.end())
+		return resolved->second;
+	// Take the policy with the most specific, i.e., longest matching topic filter.
+	std::pair<bool, Topic_policy> policy{false, Topic_policy()};
+	std::size_t filter_size = 0;
+	for (auto &entry : policies) {
+		bool matches = entry.first == topic;
+		if (!matches && mosqpp::topic_matches_sub(entry.first.c_str(), topic.c_str(), &matches) != MOSQ_ERR_SUCCESS)
+			matches = false;
+		if (matches && (!policy.first || entry.first.size() > filter_size)) {
+			policy = std::make_pair(true, entry.second);
+			filter_size = entry.first.size();
+		}
+	}
+	// Start over instead of evicting single entries, as resolving a policy again is cheap.
+	if (resolved_policies.size() >= max_resolved_policies)
+		resolved_policies.clear();
+	resolved_policies.emplace(topic, policy);
+	return policy;
+}
+
+Subscription_handle::Subscription_handle(std::string topic, std::shared_ptr<MQTT_subscription> subscription) :
+	topic(std::move(topic)),
+	subscription(std::move(subscription))
+{
+}
+
+std::string Subscription_handle::get_message(const std::chrono::duration<double> &duration, std::string *actual_topic) const
+{
+	if (!subscription)
+		throw std::runtime_error("Empty subscription handle.");
+	return subscription->get_message(duration, actual_topic);
+}
+
+Subscription_stats Subscription_handle::get_stats() const
 {
+	if (!subscription)
+		throw std::runtime_error("Empty subscription handle.");
+	return subscription->get_stats();
+}
+
+const std::string & Subscription_handle::get_topic() const
+{
+	return topic;
+}
+
+Subscription_handle::operator bool() const
+{
+	return static_cast<bool>(subscription);
+}
+
+Subscription_handle MQTT_communicator::add_subscription(const std::string &topic, int qos, Priority priority) const
+{
+	auto policy = override_policy(resolve_policy(topic).second, qos, priority);
 	// Save subscription in unordered_map.
-	std::shared_ptr<MQTT_subscription> ptr = std::make_shared<MQTT_subscription_get>(qos);
+	std::shared_ptr<MQTT_subscription> ptr = std::make_shared<MQTT_subscription_get>(policy, MQTT_queue_allocator<MQTT_message>(outbound_queue->memory));
 	std::unique_lock<std::mutex> lock(subscriptions_mutex);
-	subscriptions.emplace(std::make_pair(topic, ptr));
+	// An existing subscription on topic is kept.
+	ptr = subscriptions.emplace(std::make_pair(topic, ptr)).first->second;
 	lock.unlock();
 	// Send subscribe to MQTT broker.
 	if (connected) {
-		auto ret = subscribe(nullptr, topic.c_str(), qos);
+		auto ret = subscribe(nullptr, topic.c_str(), policy.qos);
 		if (ret != MOSQ_ERR_SUCCESS)
 			throw std::runtime_error(mosq_err_string("Error subscribing to topic \"" + topic + "\": ", ret));
 	}
+	return Subscription_handle(topic, std::move(ptr));
 }
 
-void MQTT_communicator::add_subscription(const std::string &topic, std::function<void(std::string)> callback, int qos) const
+Subscription_handle MQTT_communicator::add_subscription(const std::string &topic, std::function<void(std::string)> callback, int qos, Priority priority) const
 {
+	auto policy = override_policy(resolve_policy(topic).second, qos, priority);
 	// Save subscription in unordered_map.
-	std::shared_ptr<MQTT_subscription> ptr = std::make_shared<MQTT_subscription_callback>(qos, std::move(callback));
+	std::shared_ptr<MQTT_subscription> ptr = std::make_shared<MQTT_subscription_callback>(policy, std::move(callback),
+		MQTT_queue_allocator<MQTT_message>(outbound_queue->memory));
+	std::unique_lock<std::mutex> transport_lock(transport_mutex);
+	if (!transport_options.thread_cpus.empty())
+		ptr->pin(transport_options.thread_cpus);
+	transport_lock.unlock();
 	std::unique_lock<std::mutex> lock(subscriptions_mutex);
-	subscriptions.emplace(std::make_pair(topic, ptr));
+	// An existing subscription on topic is kept.
+	ptr = subscriptions.emplace(std::make_pair(topic, ptr)).first->second;
 	lock.unlock();
 	// Send subscribe to MQTT broker.
 	if (connected) {
-		auto ret = subscribe(nullptr, topic.c_str(), qos);
+		auto ret = subscribe(nullptr, topic.c_str(), policy.qos);
 		if (ret != MOSQ_ERR_SUCCESS)
 			throw std::runtime_error(mosq_err_string("Error subscribing to topic \"" + topic + "\": ", ret));
 	}
+	return Subscription_handle(topic, std::move(ptr));
 }
 
 void MQTT_communicator::remove_subscription(const std::string &topic) const
@@ -229,15 +1740,98 @@ void MQTT_communicator::remove_subscription(const std::string &topic) const
 	}
 }
 
+void MQTT_communicator::remove_subscription(const Subscription_handle &handle) const
+{
+	if (!handle)
+		return;
+	// Only remove the subscription the handle refers to, not a later one on the same topic.
+	std::unique_lock<std::mutex> lock(subscriptions_mutex);
+	auto subscription = subscriptions.find(handle.topic);
+	if (subscription == subscriptions.end() || subscription->second != handle.subscription)
+		return;
+	subscriptions.erase(subscription);
+	lock.unlock();
+	// Send unsubscribe to MQTT broker.
+	if (connected) {
+		auto ret = unsubscribe(nullptr, handle.topic.c_str());
+		if (ret != MOSQ_ERR_SUCCESS)
+			throw std::runtime_error(mosq_err_string("Error unsubscribing from topic \"" + handle.topic + "\": ", ret));
+	}
+}
+
+void MQTT_communicator::set_subscription_ttl(const std::string &topic, const timeout_duration_t &ttl) const
+{
+	std::lock_guard<std::mutex> lock(subscriptions_mutex);
+	auto subscription = subscriptions.find(topic);
+	if (subscription == subscriptions.end())
+		throw std::out_of_range("Topic not found in subscriptions.");
+	subscription->second->set_ttl(ttl);
+}
+
+void MQTT_communicator::set_subscription_dedup(const std::string &topic,
+					       message_key_function_t key_function,
+					       const timeout_duration_t &window,
+					       std::size_t capacity) const
+{
+	std::unique_ptr<MQTT_seen_set> seen_set;
+	if (key_function) {
+		if (capacity == 0)
+			throw std::runtime_error("Capacity of duplicate filter must not be 0.");
+		auto steady_window = window >= std::chrono::steady_clock::duration::max() ?
+			std::chrono::steady_clock::duration::max() :
+			std::chrono::duration_cast<std::chrono::steady_clock::duration>(window);
+		seen_set.reset(new MQTT_seen_set(std::move(key_function), steady_window, capacity));
+	}
+	std::lock_guard<std::mutex> lock(subscriptions_mutex);
+	auto subscription = subscriptions.find(topic);
+	if (subscription == subscriptions.end())
+		throw std::out_of_range("Topic not found in subscriptions.");
+	subscription->second->set_seen_set(std::move(seen_set));
+}
+
+void MQTT_communicator::set_subscription_filter(const std::string &topic, const std::string &key, message_filter_t predicate) const
+{
+	std::lock_guard<std::mutex> lock(subscriptions_mutex);
+	auto subscription = subscriptions.find(topic);
+	if (subscription == subscriptions.end())
+		throw std::out_of_range("Topic not found in subscriptions.");
+	subscription->second->set_filter(key, std::move(predicate));
+}
+
+Subscription_stats MQTT_communicator::get_subscription_stats(const std::string &topic) const
+{
+	std::lock_guard<std::mutex> lock(subscriptions_mutex);
+	auto subscription = subscriptions.find(topic);
+	if (subscription == subscriptions.end())
+		throw std::out_of_range("Topic not found in subscriptions.");
+	return subscription->second->get_stats();
+}
+
 void MQTT_communicator::on_connect(int rc)
 {
 	FASTLIB_LOG(comm_log, trace) << "Callback: on_connect(" << std::to_string(rc) << ")";
 	if (rc == 0) {
+		std::unique_lock<std::mutex> brokers_lock(brokers_mutex);
+		if (!reconnect_enabled) {
+			// connect_to_broker() gave up or disconnect_from_broker() was called meanwhile.
+			brokers_lock.unlock();
+			FASTLIB_LOG(comm_log, trace) << "Connection is not wanted anymore.";
+			disconnect();
+			return;
+		}
+		brokers_lock.unlock();
 		FASTLIB_LOG(comm_log, trace) << "Setting connected flag and notify constructor.";
 		std::unique_lock<std::mutex> lock(connected_mutex);
 		connected = true;
 		lock.unlock();
-		connected_cv.notify_one();
+		outbound_queue->cv.notify_one();
+		// Restore subscriptions as the broker does not keep them for clean sessions.
+		try {
+			resubscribe();
+		} catch (const std::exception &e) {
+			FASTLIB_LOG(comm_log, warn) << "Exception in on_connect: " << e.what();
+		}
+		connected_cv.notify_all();
 		FASTLIB_LOG(comm_log, trace) << "Connected flag is set and constructor is notified.";
 	} else {
 		FASTLIB_LOG(comm_log, trace) << "Error on connect: " << mosqpp::connack_string(rc);
@@ -251,10 +1845,17 @@ void MQTT_communicator::on_disconnect(int rc)
 		FASTLIB_LOG(comm_log, trace) << "Disconnected.";
 	} else {
 		FASTLIB_LOG(comm_log, trace) << mosq_err_string("Unexpected disconnect: ", rc);
+		// Prefer the other brokers until the probe thread finds this one healthy again.
+		std::lock_guard<std::mutex> lock(brokers_mutex);
+		if (brokers.size() > 1)
+			brokers_health[active_broker].reachable = false;
 	}
 	FASTLIB_LOG(comm_log, trace) << "Unsetting connected flag.";
-	std::lock_guard<std::mutex> lock(connected_mutex);
+	std::unique_lock<std::mutex> lock(connected_mutex);
 	connected = false;
+	lock.unlock();
+	// Notify shutdown() waiting for the disconnect.
+	connected_cv.notify_all();
 	FASTLIB_LOG(comm_log, trace) << "Connected flag is unset.";
 }
 
@@ -262,7 +1863,43 @@ void MQTT_communicator::on_disconnect(int rc)
 void MQTT_communicator::on_message(const mosquitto_message *msg)
 {
 	FASTLIB_LOG(comm_log, trace) << "Callback: on_message with topic: " << msg->topic;
+	if (msg->topic == latency_probe->topic) {
+		if (msg->payloadlen == 8) {
+			auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+			auto sent = static_cast<std::int64_t>(read_uint64(static_cast<const char *>(msg->payload)));
+			auto rtt = std::min<std::int64_t>(std::max<std::int64_t>((now - sent) / 1000, 0), std::numeric_limits<std::uint32_t>::max());
+			latency_probe->record(static_cast<std::uint32_t>(rtt));
+			latency_probe->last_reply = now;
+		}
+		return;
+	}
 	try {
+		// Read the envelope without touching the payload.
+		auto data = static_cast<const char*>(msg->payload);
+		std::size_t size = msg->payloadlen;
+		MQTT_envelope envelope;
+		auto header_size = unwrap_envelope(data, size, envelope);
+		std::string payload;
+		if (envelope.flags & envelope_chunk) {
+			std::unique_lock<std::mutex> reassembly_lock(reassembly->mutex);
+			if (!reassembly->add(msg->topic, envelope, data + header_size, size - header_size, payload))
+				return;
+			reassembly_lock.unlock();
+			// The reassembled message may have an envelope itself.
+			data = payload.data();
+			size = payload.size();
+			envelope = MQTT_envelope();
+			header_size = unwrap_envelope(data, size, envelope);
+		}
+		if (!(envelope.flags & envelope_batch)) {
+			if (data == payload.data() && !(envelope.flags & envelope_compressed)) {
+				payload.erase(0, header_size);
+			} else {
+				std::string message_payload;
+				envelope = open_message(data, size, message_payload, reassembly->max_message_size);
+				payload = std::move(message_payload);
+			}
+		}
 		std::vector<decltype(subscriptions)::mapped_type> matched_subscriptions;
 		// Get all subscriptions matching the topic
 		std::unique_lock<std::mutex> lock(subscriptions_mutex);
@@ -273,9 +1910,45 @@ void MQTT_communicator::on_message(const mosquitto_message *msg)
 		lock.unlock();
 		if (matched_subscriptions.size() == 0)
 			throw std::runtime_error("No matching subscriptions.");
+		// Serve subscriptions with higher priority first.
+		std::stable_sort(matched_subscriptions.begin(), matched_subscriptions.end(),
+			[](const decltype(subscriptions)::mapped_type &lhs, const decltype(subscriptions)::mapped_type &rhs) {
+				return lhs->priority > rhs->priority;
+			});
+		// The message gets the highest priority of all matched subscriptions.
+		auto priority = matched_subscriptions.front()->priority;
+		auto arrival = std::chrono::steady_clock::now();
+		if (envelope.flags & envelope_batch) {
+			// Deliver the messages of a batch one by one.
+			std::size_t pos = header_size;
+			for (std::uint32_t i = 0; i != envelope.batch_count; ++i) {
+				if (size - pos < 4 || size - pos - 4 < read_uint32(data + pos))
+					throw std::runtime_error("Truncated batch.");
+				auto message_size = read_uint32(data + pos);
+				pos += 4;
+				// Messages of a batch may have an envelope with expiry or be compressed.
+				MQTT_message message{
+					msg->topic,
+					std::string(),
+					std::chrono::system_clock::time_point::max(),
+					arrival
+				};
+				message.expiry = open_message(data + pos, message_size, message.payload, reassembly->max_message_size).expiry;
+				pos += message_size;
+				for (auto &subscription : matched_subscriptions)
+					subscription->add_message(message, priority);
+			}
+			return;
+		}
+		MQTT_message message{
+			msg->topic,
+			std::move(payload),
+			envelope.expiry,
+			arrival
+		};
 		// Add message to all matched subscriptions
 		for (auto &subscription : matched_subscriptions)
-			subscription->add_message(msg);
+			subscription->add_message(message, priority);
 	} catch (const std::exception &e) { // Catch exceptions and do nothing to not break mosquitto loop.
 		FASTLIB_LOG(comm_log, trace) << "Exception in on_message: " << e.what();
 	}
@@ -284,23 +1957,266 @@ void MQTT_communicator::on_message(const mosquitto_message *msg)
 
 void MQTT_communicator::send_message(const std::string &message) const
 {
-	send_message(message, "", 1);
+	// Keep QoS 1 for the default publish topic unless a topic policy states otherwise.
+	send_message(message, "", resolve_policy(default_publish_topic).first ? -1 : 1);
+}
+
+void MQTT_communicator::on_publish(int mid)
+{
+	(void) mid;
+	// Mosquitto may have room for held back messages now.
+	outbound_queue->cv.notify_one();
+	if (--outbound_queue->in_flight == 0 && !outbound_queue->accepting)
+		outbound_queue->drained_cv.notify_all();
+}
+
+std::string & MQTT_communicator::thread_buffer()
+{
+	static thread_local std::string buffer;
+	return buffer;
+}
+
+std::string & MQTT_communicator::compression_buffer()
+{
+	static thread_local std::string buffer;
+	return buffer;
+}
+
+bool MQTT_communicator::compression_available(Compression compression)
+{
+	switch (compression) {
+	case Compression::none:
+		return true;
+	case Compression::lz4:
+#ifdef FASTLIB_ENABLE_LZ4
+		return true;
+#else
+		return false;
+#endif
+	case Compression::zlib:
+#ifdef FASTLIB_ENABLE_ZLIB
+		return true;
+#else
+		return false;
+#endif
+	}
+	return false;
+}
+
+bool MQTT_communicator::memory_binding_available()
+{
+#ifdef FASTLIB_ENABLE_NUMA
+	return numa_available() != -1;
+#else
+	return false;
+#endif
+}
+
+int MQTT_communicator::publish_tracked(const std::string &topic, const char *payload, std::size_t size, int qos, bool retain) const
+{
+	// Count before publishing, as on_publish may be called before publish returns.
+	++outbound_queue->in_flight;
+	int ret = publish(nullptr, topic.c_str(), static_cast<int>(size), payload, qos, retain);
+	if (ret != MOSQ_ERR_SUCCESS)
+		--outbound_queue->in_flight;
+	return ret;
+}
+
+bool MQTT_communicator::shutdown(const timeout_duration_t &deadline) const
+{
+	FASTLIB_LOG(comm_log, trace) << "Shutting down MQTT_communicator.";
+	auto end = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+		std::min(deadline, std::chrono::duration_cast<timeout_duration_t>(std::chrono::hours(24 * 365))));
+	stop_latency_probe();
+	auto &queue = *outbound_queue;
+	queue.accepting = false;
+	// Wait for the outbound thread to hand all messages to mosquitto and for their acknowledgements.
+	std::unique_lock<std::mutex> lock(queue.mutex);
+	queue.writer_sleeping = false;
+	queue.cv.notify_one();
+	bool delivered = true;
+	while (!queue.drained() || queue.in_flight != 0) {
+		auto now = std::chrono::steady_clock::now();
+		if (now >= end || !connected) {
+			delivered = false;
+			break;
+		}
+		// Wake up regularly, as the outbound thread does not notify when it empties the queues.
+		queue.drained_cv.wait_for(lock, std::min<std::chrono::steady_clock::duration>(end - now, std::chrono::milliseconds(10)));
+	}
+	if (!delivered) {
+		FASTLIB_LOG(comm_log, warn) << "Shutting down with " << queue.in_flight.load() << " unacknowledged messages"
+			<< (queue.drained() ? "." : " and messages not handed to mosquitto.");
+	}
+	lock.unlock();
+	stop_outbound_thread();
+	// Wait for mosquitto to send the disconnect packet.
+	disconnect_from_broker();
+	std::unique_lock<std::mutex> connected_lock(connected_mutex);
+	connected_cv.wait_until(connected_lock, std::max(end, std::chrono::steady_clock::now() + std::chrono::milliseconds(loop_timeout)), [this]{return !connected;});
+	connected_lock.unlock();
+	stop_mosq_loop();
+	FASTLIB_LOG(comm_log, trace) << "MQTT_communicator shut down.";
+	return delivered;
 }
 
-void MQTT_communicator::send_message(const std::string &message, const std::string &topic, int qos) const
+void MQTT_communicator::send_message(const std::string &message,
+				     const std::string &topic,
+				     int qos,
+				     Priority priority,
+				     const timeout_duration_t &ttl) const
 {
 	FASTLIB_LOG(comm_log, trace) << "Sending message.";
-	if (!connected)
-		throw std::runtime_error("No connection established.");
 	// Use default topic if empty string is passed.
 	auto &real_topic = topic == "" ? default_publish_topic : topic;
-	// Publish message to topic.
-	int ret = publish(nullptr, real_topic.c_str(), static_cast<int>(message.size()), message.c_str(), qos, false);
-	if (ret != MOSQ_ERR_SUCCESS)
-		throw std::runtime_error(mosq_err_string("Error sending message: ", ret));
+	publish_to_topics(message, &real_topic, 1, qos, priority, ttl);
 	FASTLIB_LOG(comm_log, trace) << "Message sent to topic " << real_topic << ".";
 }
 
+void MQTT_communicator::multicast_message(const std::string &message,
+					  const std::vector<std::string> &topics,
+					  int qos,
+					  Priority priority,
+					  const timeout_duration_t &ttl) const
+{
+	FASTLIB_LOG(comm_log, trace) << "Sending message to " << topics.size() << " topics.";
+	publish_to_topics(message, topics.data(), topics.size(), qos, priority, ttl);
+}
+
+void MQTT_communicator::post_message(const std::string &message,
+				     const std::string &topic,
+				     int qos,
+				     Priority priority,
+				     const timeout_duration_t &ttl) const
+{
+	auto &queue = *outbound_queue;
+	if (!queue.accepting)
+		throw std::runtime_error("Communicator is shut down.");
+	// Use default topic if empty string is passed.
+	auto &real_topic = topic == "" ? default_publish_topic : topic;
+	auto &producer = queue.producer();
+	// Resolve policies per thread to not contend on the policy table.
+	if (producer.policies_version != policies_version) {
+		producer.policies.clear();
+		producer.policies_version = policies_version;
+	}
+	auto policy = producer.policies.find(real_topic);
+	if (policy == producer.policies.end()) {
+		if (producer.policies.size() >= max_resolved_policies)
+			producer.policies.clear();
+		policy = producer.policies.emplace(real_topic, resolve_policy(real_topic).second).first;
+	}
+	auto resolved_policy = override_policy(policy->second, qos, priority);
+	std::string wrapped;
+	auto &uncompressed = wrap_expiry(message, ttl, wrapped);
+	auto &compressed = compression_buffer();
+	bool is_compressed = resolved_policy.compression != Compression::none &&
+		uncompressed.size() >= resolved_policy.compression_threshold &&
+		compress_payload(resolved_policy.compression, uncompressed, compressed);
+	auto &payload = is_compressed ? compressed : uncompressed;
+	std::size_t chunk_size = queue.chunk_size;
+	auto chunk_count = count_chunks(payload.size(), chunk_size);
+	MQTT_outbound_message msg{real_topic,
+		// Copy into the memory of the queues, so the queued payload only takes its compressed size.
+		queue_payload(payload.data(), payload.size(), MQTT_queue_allocator<char>(queue.memory)),
+		resolved_policy.qos, resolved_policy.retain, chunk_count != 0 ? queue.next_chunk_id++ : 0,
+		static_cast<std::uint32_t>(chunk_count), 0, chunk_size,
+		chunk_count == 0 ? resolved_policy.batch_size : 0, resolved_policy.batch_delay};
+	if (!producer.push(msg, resolved_policy.priority)) {
+		// Fall back to the locked queues if the outbound thread falls behind.
+		// Move the messages still in the producer queue first to keep their order.
+		std::unique_lock<std::mutex> lock(queue.mutex);
+		queue.drain_producers();
+		queue.push(std::move(msg), resolved_policy.priority);
+		lock.unlock();
+		queue.cv.notify_one();
+		return;
+	}
+	if (queue.writer_sleeping) {
+		std::unique_lock<std::mutex> lock(queue.mutex);
+		queue.writer_sleeping = false;
+		lock.unlock();
+		queue.cv.notify_one();
+	}
+}
+
+void MQTT_communicator::publish_to_topics(const std::string &message,
+					  const std::string *topics,
+					  std::size_t topic_count,
+					  int qos,
+					  Priority priority,
+					  const timeout_duration_t &ttl) const
+{
+	if (!outbound_queue->accepting)
+		throw std::runtime_error("Communicator is shut down.");
+	if (!connected)
+		throw std::runtime_error("No connection established.");
+	std::string wrapped;
+	auto &uncompressed = wrap_expiry(message, ttl, wrapped);
+	std::size_t chunk_size = outbound_queue->chunk_size;
+	// The payloads shared by all held back messages, indexed by compression.
+	std::array<std::shared_ptr<const MQTT_queue_string>, 3> shared_payloads;
+	bool held_back = false;
+	// The compressed payload is kept for topics with the same compression.
+	auto &compressed = compression_buffer();
+	auto compressed_as = Compression::none;
+	std::unique_lock<std::mutex> lock(outbound_queue->mutex, std::defer_lock);
+	try {
+		for (std::size_t i = 0; i != topic_count; ++i) {
+			auto policy = override_policy(resolve_policy(topics[i]).second, qos, priority);
+			auto compression = Compression::none;
+			if (policy.compression != Compression::none && uncompressed.size() >= policy.compression_threshold) {
+				if (compressed_as != policy.compression) {
+					compressed_as = compress_payload(policy.compression, uncompressed, compressed) ? policy.compression : Compression::none;
+					// Retry after a failed compression on the next topic with compression.
+					if (compressed_as == Compression::none)
+						compressed.clear();
+				}
+				compression = compressed_as;
+			}
+			auto &payload = compression != Compression::none ? compressed : uncompressed;
+			// Large messages are always sent in chunks by the outbound thread.
+			auto chunk_count = count_chunks(payload.size(), chunk_size);
+			bool chunked = chunk_count != 0;
+			// Batches are sent by the outbound thread as well.
+			bool batched = !chunked && policy.batch_size > 1;
+			if (chunked || batched || policy.priority != Priority::high) {
+				if (!lock.owns_lock())
+					lock.lock();
+				// Hold message back while mosquitto is busy or to keep the order within its priority.
+				if (chunked || batched || want_write() || outbound_queue->holds(policy.priority)) {
+					auto &shared_payload = shared_payloads[static_cast<std::size_t>(compression)];
+					// Held back messages own their payload, copied once with its final size.
+					if (!shared_payload)
+						shared_payload = queue_payload(payload.data(), payload.size(), MQTT_queue_allocator<char>(outbound_queue->memory));
+					held_back = true;
+					outbound_queue->push(MQTT_outbound_message{topics[i], shared_payload, policy.qos, policy.retain,
+						chunked ? outbound_queue->next_chunk_id++ : 0,
+						static_cast<std::uint32_t>(chunk_count), 0, chunk_size,
+						batched ? policy.batch_size : 0, policy.batch_delay}, policy.priority);
+					FASTLIB_LOG(comm_log, trace) << "Message to topic " << topics[i] << " held back" << (chunked ? " to be sent in chunks." : ".");
+					continue;
+				}
+			}
+			// Publish message to topic.
+			int ret = publish_tracked(topics[i], payload.data(), payload.size(), policy.qos, policy.retain);
+			if (ret != MOSQ_ERR_SUCCESS)
+				throw std::runtime_error(mosq_err_string("Error sending message: ", ret));
+		}
+	} catch (...) {
+		// Messages held back for earlier topics are sent nevertheless.
+		if (lock.owns_lock())
+			lock.unlock();
+		if (held_back)
+			outbound_queue->cv.notify_one();
+		throw;
+	}
+	if (lock.owns_lock())
+		lock.unlock();
+	if (held_back)
+		outbound_queue->cv.notify_one();
+}
+
 std::string MQTT_communicator::get_message(std::string *actual_topic) const
 {
 	return get_message(default_subscribe_topic, std::chrono::duration<double>::max(), actual_topic);
@@ -323,7 +2239,7 @@ std::string MQTT_communicator::get_message(const std::string &topic, const std::
 		throw std::runtime_error("No connection established.");
 	try {
 		std::unique_lock<std::mutex> lock(subscriptions_mutex);
-		auto &subscription = subscriptions.at(topic);
+		auto subscription = subscriptions.at(topic);
 		lock.unlock();
 		return subscription->get_message(duration, actual_topic);
 	} catch (const std::out_of_range &/*e*/) {
@@ -350,44 +2266,75 @@ void MQTT_communicator::cleanup_mosq_lib() const
 	}
 }
 
-// Connect to MQTT broker. Uses condition variable that is set in on_connect, because
-// (re-)connect returning MOSQ_ERR_SUCCESS does not guarantee an fully established connection.
 void MQTT_communicator::connect_to_broker(
 		const std::string &host,
 		int port,
 		int keepalive,
 		const timeout_duration_t &timeout) const
+{
+	connect_to_broker(std::vector<Broker_endpoint>{{host, port}}, keepalive, timeout);
+}
+
+// Connect to MQTT broker. The connection is established by the network thread. Uses condition
+// variable that is set in on_connect, because (re-)connect returning MOSQ_ERR_SUCCESS does not
+// guarantee an fully established connection.
+void MQTT_communicator::connect_to_broker(
+		const std::vector<Broker_endpoint> &brokers,
+		int keepalive,
+		const timeout_duration_t &timeout,
+		const timeout_duration_t &probe_interval) const
 {
 	FASTLIB_LOG(comm_log, trace) << "Connect to MQTT broker.";
+	if (!outbound_queue->accepting)
+		throw std::runtime_error("Communicator is shut down.");
 	if (connected)
 		throw std::runtime_error("Already connected.");
+	if (brokers.empty())
+		throw std::runtime_error("No broker to connect to.");
 	auto start = std::chrono::high_resolution_clock::now();
-	int ret = connect(host.c_str(), port, keepalive);
-	FASTLIB_LOG(comm_log, trace) << "Called connect api call.";
-	while (ret != MOSQ_ERR_SUCCESS) {
-		FASTLIB_LOG(comm_log, trace) << mosq_err_string("Failed connecting to MQTT broker: ", ret);
-		if (std::chrono::high_resolution_clock::now() - start > timeout)
-			throw std::runtime_error("Timeout while trying to connect to MQTT broker.");
-		std::this_thread::sleep_for(std::chrono::seconds(1));
-		FASTLIB_LOG(comm_log, trace) << "Retry connecting.";
-		ret = reconnect();
+	stop_probe_thread();
+	std::unique_lock<std::mutex> brokers_lock(brokers_mutex);
+	this->brokers = brokers;
+	// Brokers are assumed to be healthy until a probe or connect attempt fails.
+	brokers_health.assign(brokers.size(), Broker_health{true, std::chrono::microseconds::max()});
+	active_broker = 0;
+	this->keepalive = keepalive;
+	this->probe_interval = probe_interval;
+	brokers_lock.unlock();
+	if (brokers.size() > 1) {
+		probe_brokers();
+		brokers_lock.lock();
+		probe_running = true;
+		brokers_lock.unlock();
+		probe_thread = std::thread(&MQTT_communicator::run_probe_loop, this);
+		pin_to_thread_cpus(probe_thread);
 	}
+	brokers_lock.lock();
+	reconnect_enabled = true;
+	brokers_lock.unlock();
+	reconnect_cv.notify_all();
 	FASTLIB_LOG(comm_log, trace) << "Waiting for on_connect callback to signal success.";
 	std::unique_lock<std::mutex> lock(connected_mutex);
 	auto time_left = timeout - (std::chrono::high_resolution_clock::now() - start);
 	// Branch between wait and wait_for because if time_left is max wait_for does not work
 	// (waits until now + max -> overflow?).
 	if (time_left != std::chrono::duration<double>::max()) {
-		if (!connected_cv.wait_for(lock, time_left, [this]{return connected;}))
+		if (!connected_cv.wait_for(lock, time_left, [this]{return connected;})) {
+			lock.unlock();
+			disconnect_from_broker();
 			throw std::runtime_error("Timeout while trying to connect to MQTT broker.");
+		}
 	} else {
 		connected_cv.wait(lock, [this]{return connected;});
 	}
-	resubscribe();
 }
 
 void MQTT_communicator::disconnect_from_broker() const
 {
+	std::unique_lock<std::mutex> lock(brokers_mutex);
+	reconnect_enabled = false;
+	lock.unlock();
+	stop_probe_thread();
 	// Disconnect from MQTT broker.
 	if (connected) {
 		disconnect();
@@ -399,6 +2346,14 @@ bool MQTT_communicator::is_connected() const
 	return connected;
 }
 
+Broker_endpoint MQTT_communicator::get_active_broker() const
+{
+	std::lock_guard<std::mutex> lock(brokers_mutex);
+	if (brokers.empty())
+		throw std::runtime_error("No broker to connect to.");
+	return brokers[active_broker];
+}
+
 void MQTT_communicator::resubscribe() const
 {
 	if (!connected)
@@ -412,21 +2367,402 @@ void MQTT_communicator::resubscribe() const
 		if (ret != MOSQ_ERR_SUCCESS)
 			throw std::runtime_error(mosq_err_string("Error subscribing to topic \"" + topic + "\": ", ret));
 	}
+	std::lock_guard<std::mutex> probe_lock(latency_probe->mutex);
+	if (latency_probe->running) {
+		auto ret = subscribe(nullptr, latency_probe->topic.c_str(), 0);
+		if (ret != MOSQ_ERR_SUCCESS)
+			throw std::runtime_error(mosq_err_string("Error subscribing to latency probe topic: ", ret));
+	}
 }
 
 void MQTT_communicator::start_mosq_loop() const
 {
 	FASTLIB_LOG(comm_log, trace) << "Start mosquitto loop";
 	int ret;
-	if ((ret = loop_start()) != MOSQ_ERR_SUCCESS)
+	// Make mosquitto use its mutexes, as the loop is run in a dedicated thread.
+	if ((ret = threaded_set(true)) != MOSQ_ERR_SUCCESS)
 		throw std::runtime_error(mosq_err_string("Error starting mosquitto loop: ", ret));
-
+	network_loop_running = true;
+	network_thread = std::thread(&MQTT_communicator::run_network_loop, this);
 }
 
 void MQTT_communicator::stop_mosq_loop() const
 {
 	FASTLIB_LOG(comm_log, trace) << "Stop mosquitto loop.";
-	loop_stop();
+	network_loop_running = false;
+	{
+		std::lock_guard<std::mutex> lock(brokers_mutex);
+	}
+	reconnect_cv.notify_all();
+	if (network_thread.joinable())
+		network_thread.join();
+}
+
+void MQTT_communicator::set_chunking(std::size_t chunk_size, const timeout_duration_t &reassembly_timeout, std::size_t max_message_size, std::size_t max_reassembly_size) const
+{
+	outbound_queue->chunk_size = chunk_size;
+	std::lock_guard<std::mutex> lock(reassembly->mutex);
+	reassembly->max_message_size = max_message_size;
+	reassembly->max_reassembly_size = max_reassembly_size;
+	if (reassembly_timeout >= std::chrono::steady_clock::duration::max())
+		reassembly->timeout = std::chrono::hours(24 * 365); // Not max to avoid overflows of the deadlines.
+	else
+		reassembly->timeout = std::chrono::duration_cast<std::chrono::steady_clock::duration>(reassembly_timeout);
+}
+
+void MQTT_communicator::set_transport_options(const Transport_options &options) const
+{
+	std::vector<int> network_cpus;
+	if (options.network_cpu != -1)
+		network_cpus.push_back(options.network_cpu);
+	check_cpus(options.thread_cpus);
+	check_cpus(network_cpus);
+	auto &memory_cpus = options.thread_cpus.empty() ? network_cpus : options.thread_cpus;
+	if (options.bind_memory && !memory_binding_available())
+		throw std::runtime_error("Binding memory to NUMA nodes is not available.");
+	if (options.bind_memory && memory_cpus.empty())
+		throw std::runtime_error("No CPUs to bind memory to.");
+	// Pin the threads running for the whole lifetime and bind the memory first, so the options are only stored if this works.
+	if (!network_cpus.empty())
+		pin_thread(network_thread, network_cpus);
+	else if (!options.thread_cpus.empty())
+		pin_thread(network_thread, options.thread_cpus);
+	if (!options.thread_cpus.empty())
+		pin_thread(outbound_thread, options.thread_cpus);
+	outbound_queue->memory->bind(options.bind_memory ? memory_cpus : std::vector<int>());
+	std::unique_lock<std::mutex> lock(transport_mutex);
+	transport_options = options;
+	lock.unlock();
+	busy_poll = options.busy_poll;
+	if (!options.thread_cpus.empty()) {
+		std::unique_lock<std::mutex> brokers_lock(brokers_mutex);
+		if (probe_thread.joinable())
+			pin_thread(probe_thread, options.thread_cpus);
+		brokers_lock.unlock();
+		std::unique_lock<std::mutex> probe_lock(latency_probe->mutex);
+		if (latency_probe->thread.joinable())
+			pin_thread(latency_probe->thread, options.thread_cpus);
+		probe_lock.unlock();
+		std::lock_guard<std::mutex> subscriptions_lock(subscriptions_mutex);
+		for (auto &subscription : subscriptions)
+			subscription.second->pin(options.thread_cpus);
+	}
+	if (connected)
+		apply_socket_options();
+}
+
+void MQTT_communicator::pin_to_thread_cpus(std::thread &thread) const
+{
+	std::unique_lock<std::mutex> lock(transport_mutex);
+	auto cpus = transport_options.thread_cpus;
+	lock.unlock();
+	if (cpus.empty())
+		return;
+	try {
+		pin_thread(thread, cpus);
+	} catch (const std::exception &e) {
+		FASTLIB_LOG(comm_log, warn) << e.what();
+	}
+}
+
+void MQTT_communicator::apply_socket_options() const
+{
+	int fd = socket();
+	if (fd == -1)
+		return;
+	std::lock_guard<std::mutex> lock(transport_mutex);
+	if (transport_options.tcp_nodelay)
+		set_socket_option(fd, IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY");
+	if (transport_options.send_buffer_size != 0)
+		set_socket_option(fd, SOL_SOCKET, SO_SNDBUF, transport_options.send_buffer_size, "SO_SNDBUF");
+	if (transport_options.receive_buffer_size != 0)
+		set_socket_option(fd, SOL_SOCKET, SO_RCVBUF, transport_options.receive_buffer_size, "SO_RCVBUF");
+	if (transport_options.socket_busy_poll != 0)
+		set_socket_option(fd, SOL_SOCKET, SO_BUSY_POLL, transport_options.socket_busy_poll, "SO_BUSY_POLL");
+}
+
+void MQTT_communicator::run_network_loop() const
+{
+	while (network_loop_running) {
+		std::unique_lock<std::mutex> reassembly_lock(reassembly->mutex);
+		reassembly->reclaim();
+		reassembly_lock.unlock();
+		if (switch_requested.exchange(false) && connected) {
+			FASTLIB_LOG(comm_log, trace) << "Active broker is unhealthy, switching to another one.";
+			// Reconnecting closes the socket without calling on_disconnect.
+			std::unique_lock<std::mutex> lock(connected_mutex);
+			connected = false;
+			lock.unlock();
+			connect_to_healthiest_broker();
+		}
+		if (loop(busy_poll ? 0 : loop_timeout) == MOSQ_ERR_SUCCESS)
+			continue;
+		// There is no connection (anymore).
+		std::unique_lock<std::mutex> lock(brokers_mutex);
+		if (!reconnect_enabled) {
+			reconnect_cv.wait(lock, [this]{return reconnect_enabled || !network_loop_running;});
+			continue;
+		}
+		lock.unlock();
+		if (!connect_to_healthiest_broker()) {
+			lock.lock();
+			reconnect_cv.wait_for(lock, reconnect_delay, [this]{return !reconnect_enabled || !network_loop_running;});
+		}
+	}
+}
+
+bool MQTT_communicator::connect_to_healthiest_broker() const
+{
+	std::unique_lock<std::mutex> lock(brokers_mutex);
+	// Order reachable brokers by round trip time.
+	auto healthiest_brokers = [this]{
+		std::vector<std::size_t> order;
+		for (std::size_t i = 0; i != brokers.size(); ++i) {
+			if (brokers_health[i].reachable)
+				order.push_back(i);
+		}
+		std::stable_sort(order.begin(), order.end(), [this](std::size_t lhs, std::size_t rhs) {
+			return brokers_health[lhs].rtt < brokers_health[rhs].rtt;
+		});
+		return order;
+	};
+	auto order = healthiest_brokers();
+	if (order.empty()) {
+		// Probe instead of blocking in connect on brokers which are not reachable.
+		lock.unlock();
+		probe_brokers();
+		lock.lock();
+		order = healthiest_brokers();
+	}
+	for (auto i : order) {
+		if (!reconnect_enabled)
+			return false;
+		auto broker = brokers[i];
+		auto keepalive = this->keepalive;
+		lock.unlock();
+		FASTLIB_LOG(comm_log, trace) << "Connecting to MQTT broker " << broker.host << ":" << broker.port << ".";
+		int ret = connect(broker.host.c_str(), broker.port, keepalive);
+		lock.lock();
+		if (i >= brokers.size())
+			return false;
+		if (ret == MOSQ_ERR_SUCCESS) {
+			active_broker = i;
+			apply_socket_options();
+			return true;
+		}
+		FASTLIB_LOG(comm_log, trace) << mosq_err_string("Failed connecting to MQTT broker: ", ret);
+		brokers_health[i].reachable = false;
+	}
+	return false;
+}
+
+void MQTT_communicator::run_probe_loop() const
+{
+	std::unique_lock<std::mutex> lock(brokers_mutex);
+	while (probe_running) {
+		if (probe_cv.wait_for(lock, probe_interval, [this]{return !probe_running;}))
+			break;
+		lock.unlock();
+		probe_brokers();
+		lock.lock();
+		if (connected && !brokers_health[active_broker].reachable) {
+			switch_requested = true;
+		}
+	}
+}
+
+void MQTT_communicator::probe_brokers() const
+{
+	std::unique_lock<std::mutex> lock(brokers_mutex);
+	auto brokers = this->brokers;
+	lock.unlock();
+	std::vector<Broker_health> health;
+	for (auto &broker : brokers)
+		health.push_back(probe_broker(broker));
+	lock.lock();
+	// Brokers may have been replaced by connect_to_broker() meanwhile.
+	if (health.size() == brokers_health.size())
+		brokers_health = std::move(health);
+}
+
+void MQTT_communicator::stop_probe_thread() const
+{
+	std::unique_lock<std::mutex> lock(brokers_mutex);
+	probe_running = false;
+	lock.unlock();
+	probe_cv.notify_all();
+	if (probe_thread.joinable())
+		probe_thread.join();
+}
+
+void MQTT_communicator::set_latency_probe(const timeout_duration_t &interval, const timeout_duration_t &stale_after) const
+{
+	stop_latency_probe();
+	if (interval == timeout_duration_t::zero())
+		return;
+	auto &probe = *latency_probe;
+	probe.interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(interval);
+	probe.stale_after = std::chrono::duration_cast<std::chrono::nanoseconds>(stale_after).count();
+	// Not stale until the first ping had time to return.
+	probe.last_reply = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	std::unique_lock<std::mutex> lock(probe.mutex);
+	probe.running = true;
+	lock.unlock();
+	// Pings are delivered once subscribed, else after (re-)connecting by resubscribe().
+	if (connected)
+		subscribe(nullptr, probe.topic.c_str(), 0);
+	probe.thread = std::thread(&MQTT_communicator::run_latency_probe_loop, this);
+	pin_to_thread_cpus(probe.thread);
+}
+
+Broker_latency MQTT_communicator::get_broker_latency() const
+{
+	auto &probe = *latency_probe;
+	Broker_latency latency;
+	auto count = probe.count.load(std::memory_order_acquire);
+	latency.samples = static_cast<std::size_t>(std::min<std::uint64_t>(count, probe.samples.size()));
+	std::vector<std::uint32_t> rtts;
+	rtts.reserve(latency.samples);
+	for (std::size_t i = 0; i != latency.samples; ++i)
+		rtts.push_back(probe.samples[i].load(std::memory_order_relaxed));
+	latency.last = std::chrono::microseconds(count != 0 ? probe.samples[(count - 1) % probe.samples.size()].load(std::memory_order_relaxed) : 0);
+	std::sort(rtts.begin(), rtts.end());
+	latency.median = std::chrono::microseconds(rtts.empty() ? 0 : rtts[rtts.size() / 2]);
+	latency.p99 = std::chrono::microseconds(rtts.empty() ? 0 : rtts[rtts.size() * 99 / 100]);
+	latency.max = std::chrono::microseconds(rtts.empty() ? 0 : rtts.back());
+	for (std::size_t i = 0; i != latency.histogram.size(); ++i)
+		latency.histogram[i] = probe.histogram[i].load(std::memory_order_relaxed);
+	latency.stale = is_broker_latency_stale();
+	return latency;
+}
+
+bool MQTT_communicator::is_broker_latency_stale() const
+{
+	auto &probe = *latency_probe;
+	auto stale_after = probe.stale_after.load();
+	if (stale_after == 0)
+		return false;
+	auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	return now - probe.last_reply.load() > stale_after;
+}
+
+void MQTT_communicator::run_latency_probe_loop() const
+{
+	auto &probe = *latency_probe;
+	std::unique_lock<std::mutex> lock(probe.mutex);
+	while (probe.running) {
+		lock.unlock();
+		if (connected) {
+			std::string ping;
+			append_uint64(ping, static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count()));
+			// Tracked like other messages, as on_publish() is called for pings as well.
+			int ret = publish_tracked(probe.topic, ping.data(), ping.size(), 0, false);
+			if (ret != MOSQ_ERR_SUCCESS)
+				FASTLIB_LOG(comm_log, trace) << mosq_err_string("Error sending latency probe: ", ret);
+		}
+		lock.lock();
+		probe.cv.wait_for(lock, probe.interval, [&probe]{return !probe.running;});
+	}
+}
+
+void MQTT_communicator::stop_latency_probe() const
+{
+	auto &probe = *latency_probe;
+	std::unique_lock<std::mutex> lock(probe.mutex);
+	bool was_running = probe.running;
+	probe.running = false;
+	lock.unlock();
+	probe.cv.notify_all();
+	if (probe.thread.joinable())
+		probe.thread.join();
+	probe.stale_after = 0;
+	if (was_running && connected)
+		unsubscribe(nullptr, probe.topic.c_str());
+}
+
+void MQTT_communicator::start_outbound_thread() const
+{
+	outbound_queue->running = true;
+	outbound_thread = std::thread(&MQTT_communicator::run_outbound_loop, this);
+}
+
+void MQTT_communicator::stop_outbound_thread() const
+{
+	std::unique_lock<std::mutex> lock(outbound_queue->mutex);
+	outbound_queue->running = false;
+	lock.unlock();
+	outbound_queue->cv.notify_one();
+	if (outbound_thread.joinable())
+		outbound_thread.join();
+}
+
+void MQTT_communicator::run_outbound_loop() const
+{
+	auto &queue = *outbound_queue;
+	// Chunks are assembled in a reused buffer, as mosquitto copies the payload.
+	std::string chunk;
+	std::unique_lock<std::mutex> lock(queue.mutex);
+	while (queue.running) {
+		queue.drain_producers();
+		// Batches are sent at once when shutting down.
+		auto next_flush = queue.flush_batches(!queue.accepting);
+		if (!queue.holds()) {
+			// Producers only wake this thread up if it announced to sleep.
+			queue.writer_sleeping = true;
+			if (!queue.producers_empty()) {
+				queue.writer_sleeping = false;
+				continue;
+			}
+			auto wakeup = [&queue]{return queue.holds() || !queue.writer_sleeping || !queue.running;};
+			if (next_flush == std::chrono::steady_clock::time_point::max())
+				queue.cv.wait(lock, wakeup);
+			else
+				queue.cv.wait_until(lock, next_flush, wakeup);
+			queue.writer_sleeping = false;
+			continue;
+		}
+		if (!connected) {
+			queue.cv.wait_for(lock, std::chrono::milliseconds(loop_timeout));
+			continue;
+		}
+		if (want_write()) {
+			// Mosquitto has not written everything yet, which is signaled by on_publish for QoS 0 only.
+			queue.cv.wait_for(lock, outbound_poll_interval);
+			continue;
+		}
+		// Hand a small batch to mosquitto, so messages with higher priority only wait for this batch.
+		MQTT_outbound_message msg;
+		Priority priority;
+		std::size_t batch_bytes = 0;
+		std::size_t batch_limit = queue.chunk_size != 0 ? queue.chunk_size.load() : default_chunk_size;
+		for (std::size_t i = 0; i != outbound_batch_size && batch_bytes < batch_limit && queue.pop(msg, priority); ++i) {
+			int ret;
+			if (msg.chunk_count == 0) {
+				ret = publish_tracked(msg.topic, msg.payload->data(), msg.payload->size(), msg.qos, msg.retain);
+				batch_bytes += msg.payload->size();
+			} else {
+				MQTT_envelope envelope;
+				envelope.flags = envelope_chunk;
+				envelope.chunk_id = msg.chunk_id;
+				envelope.chunk_index = msg.next_chunk;
+				envelope.chunk_count = msg.chunk_count;
+				envelope.chunk_offset = static_cast<std::uint64_t>(msg.next_chunk) * msg.chunk_size;
+				envelope.message_size = msg.payload->size();
+				auto size = std::min(msg.chunk_size, msg.payload->size() - envelope.chunk_offset);
+				chunk.clear();
+				append_envelope(chunk, envelope);
+				chunk.append(msg.payload->data() + envelope.chunk_offset, size);
+				ret = publish_tracked(msg.topic, chunk.data(), chunk.size(), msg.qos, msg.retain);
+				batch_bytes += chunk.size();
+				// Requeue the remaining chunks behind the other messages of the same priority.
+				if (++msg.next_chunk != msg.chunk_count)
+					queue.push(std::move(msg), priority);
+			}
+			if (ret != MOSQ_ERR_SUCCESS)
+				FASTLIB_LOG(comm_log, warn) << mosq_err_string("Error sending held back message: ", ret);
+		}
+	}
 }
 
 std::mutex MQTT_communicator::ref_count_mutex;
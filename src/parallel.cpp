@@ -0,0 +1,58 @@
+/*
+ * This file is part of fast-lib.
+ * Copyright (C) 2015 RWTH Aachen University - ACS
+ *
+ * This file is licensed under the GNU Lesser General Public License Version 3
+ * Version 3, 29 June 2007. For details see 'LICENSE.md' in the root directory.
+ */
+
+#include <fast-lib/parallel.hpp>
+
+#include <algorithm>
+#include <exception>
+#include <system_error>
+#include <thread>
+
+namespace fast
+{
+	namespace parallel
+	{
+		void for_chunks(std::size_t size, const Parallel_options &options, const std::function<void(std::size_t, std::size_t)> &func)
+		{
+			std::size_t chunk_count = std::min<std::size_t>(std::max(options.threads, 1u), size / std::max<std::size_t>(options.min_chunk_size, 1));
+			if (chunk_count <= 1) {
+				func(0, size);
+				return;
+			}
+			// Spread the remainder over the first chunks, so chunk sizes differ by at most one.
+			auto chunk_begin = [size, chunk_count](std::size_t chunk) {
+				return chunk * (size / chunk_count) + std::min(chunk, size % chunk_count);
+			};
+			std::vector<std::exception_ptr> errors(chunk_count);
+			auto run = [&](std::size_t chunk) {
+				try {
+					func(chunk_begin(chunk), chunk_begin(chunk + 1));
+				} catch (...) {
+					errors[chunk] = std::current_exception();
+				}
+			};
+			std::vector<std::thread> threads;
+			threads.reserve(chunk_count - 1);
+			for (std::size_t chunk = 1; chunk != chunk_count; ++chunk) {
+				try {
+					threads.emplace_back(run, chunk);
+				} catch (const std::system_error &) {
+					// Process the chunk on the calling thread if no thread can be started.
+					run(chunk);
+				}
+			}
+			run(0);
+			for (auto &thread : threads)
+				thread.join();
+			for (const auto &error : errors) {
+				if (error)
+					std::rethrow_exception(error);
+			}
+		}
+	}
+}
@@ -8,27 +8,606 @@
 
 #include <fast-lib/serializable.hpp>
 
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+namespace
+{
+	// Append an unsigned integer in big endian byte order as used by MessagePack.
+	void append_big_endian(std::string &buffer, std::uint64_t value, unsigned int size)
+	{
+		for (unsigned int i = size; i-- != 0;)
+			buffer.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+	}
+
+	// Append the header of a MessagePack string, array or map with the smallest fitting encoding.
+	// Fix holds the prefix for up to fix_max elements, the 8 bit variant is only defined for strings.
+	void append_header(std::string &buffer, std::size_t size, unsigned char fix, std::size_t fix_max, unsigned char bits8, unsigned char bits16, unsigned char bits32)
+	{
+		if (size <= fix_max) {
+			buffer.push_back(static_cast<char>(fix | size));
+		} else if (bits8 != 0 && size <= 0xFF) {
+			buffer.push_back(static_cast<char>(bits8));
+			append_big_endian(buffer, size, 1);
+		} else if (size <= 0xFFFF) {
+			buffer.push_back(static_cast<char>(bits16));
+			append_big_endian(buffer, size, 2);
+		} else if (size <= 0xFFFFFFFF) {
+			buffer.push_back(static_cast<char>(bits32));
+			append_big_endian(buffer, size, 4);
+		} else {
+			throw std::runtime_error("Node is too large for the binary format.");
+		}
+	}
+
+	// Parse decimal integers as formatted by std::to_string().
+	template<class T> bool parse_integer(const char *str, std::size_t size, T &value)
+	{
+		bool negative = size != 0 && str[0] == '-';
+		if (negative && !std::is_signed<T>::value)
+			return false;
+		std::size_t i = negative;
+		// Leading zeros and more digits than always fit in 64 bits are left to yaml-cpp.
+		if (i == size || size - i > static_cast<std::size_t>(std::numeric_limits<std::uint64_t>::digits10) ||
+		    (str[i] == '0' && size - i > 1))
+			return false;
+		std::uint64_t magnitude = 0;
+		for (; i != size; ++i) {
+			if (str[i] < '0' || str[i] > '9')
+				return false;
+			magnitude = magnitude * 10 + static_cast<unsigned int>(str[i] - '0');
+		}
+		if (negative) {
+			if (magnitude == 0) {
+				value = 0;
+				return true;
+			}
+			if (magnitude - 1 > static_cast<std::uint64_t>(std::numeric_limits<T>::max()))
+				return false;
+			value = static_cast<T>(-static_cast<T>(magnitude - 1) - 1);
+			return true;
+		}
+		if (magnitude > static_cast<std::uint64_t>(std::numeric_limits<T>::max()))
+			return false;
+		value = static_cast<T>(magnitude);
+		return true;
+	}
+
+	// Parse floating point numbers in decimal notation.
+	template<class T> bool parse_float(const char *str, std::size_t size, T &value, T (*convert)(const char *, char **))
+	{
+		// Special values like .inf are left to yaml-cpp.
+		char copy[64];
+		if (size == 0 || size >= sizeof(copy) || std::strspn(str, "0123456789+-.eE") < size)
+			return false;
+		std::memcpy(copy, str, size);
+		copy[size] = '\0';
+		char *end;
+		value = convert(copy, &end);
+		return end == copy + size;
+	}
+
+	// Find a scalar in the mapping read next, skipping over other values without decoding them.
+	bool find_scalar(fast::binary::Reader &in, const std::string &key, std::string &value)
+	{
+		using Kind = fast::binary::Reader::Kind;
+		std::uint64_t entries;
+		if (in.header(entries) != Kind::map)
+			return false;
+		for (std::uint64_t i = 0; i != entries; ++i) {
+			std::uint64_t size;
+			auto kind = in.header(size);
+			if (kind == Kind::scalar && size == key.size()) {
+				if (key.compare(0, key.size(), in.content(size), size) == 0) {
+					if (in.header(size) != Kind::scalar)
+						return false;
+					value.assign(in.content(size), size);
+					return true;
+				}
+			} else {
+				in.skip(kind, size);
+			}
+			in.skip();
+		}
+		return false;
+	}
+
+	// Append a Unicode code point in UTF-8 as yaml-cpp does for escape sequences.
+	bool append_utf8(std::string &value, std::uint32_t code_point)
+	{
+		if ((code_point >= 0xD800 && code_point <= 0xDFFF) || code_point > 0x10FFFF)
+			return false;
+		if (code_point < 0x80) {
+			value.push_back(static_cast<char>(code_point));
+		} else if (code_point < 0x800) {
+			value.push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+			value.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+		} else if (code_point < 0x10000) {
+			value.push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+			value.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+			value.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+		} else {
+			value.push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+			value.push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+			value.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+			value.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+		}
+		return true;
+	}
+
+	// Decode the escape sequence of a YAML double quoted scalar at str[pos], which follows the backslash.
+	// Moves pos to the last character of the sequence. Returns false for sequences which are invalid or span lines.
+	bool append_escape(const std::string &str, std::string::size_type &pos, std::string::size_type end, std::string &value)
+	{
+		static const char simple_escapes[][2] = {
+			{'0', '\0'}, {'a', '\a'}, {'b', '\b'}, {'t', '\t'}, {'\t', '\t'}, {'n', '\n'}, {'v', '\v'},
+			{'f', '\f'}, {'r', '\r'}, {'e', '\x1B'}, {' ', ' '}, {'"', '"'}, {'/', '/'}, {'\\', '\\'}
+		};
+		if (pos >= end)
+			return false;
+		for (const auto &escape : simple_escapes) {
+			if (escape[0] == str[pos]) {
+				value.push_back(escape[1]);
+				return true;
+			}
+		}
+		unsigned int digits;
+		switch (str[pos]) {
+		// yaml-cpp appends these two as single bytes rather than in UTF-8.
+		case 'N': value.push_back('\x85'); return true;
+		case '_': value.push_back('\xA0'); return true;
+		case 'L': return append_utf8(value, 0x2028);
+		case 'P': return append_utf8(value, 0x2029);
+		case 'x': digits = 2; break;
+		case 'u': digits = 4; break;
+		case 'U': digits = 8; break;
+		default: return false;
+		}
+		if (end - pos <= digits)
+			return false;
+		std::uint32_t code_point = 0;
+		for (unsigned int i = 0; i != digits; ++i) {
+			char digit = str[++pos];
+			code_point <<= 4;
+			if (digit >= '0' && digit <= '9')
+				code_point |= static_cast<std::uint32_t>(digit - '0');
+			else if (digit >= 'a' && digit <= 'f')
+				code_point |= static_cast<std::uint32_t>(digit - 'a' + 10);
+			else if (digit >= 'A' && digit <= 'F')
+				code_point |= static_cast<std::uint32_t>(digit - 'A' + 10);
+			else
+				return false;
+		}
+		return append_utf8(value, code_point);
+	}
+}
+
 namespace fast
 {
 	std::string Serializable::to_string() const
 	{
-		return "---\n" + YAML::Dump(emit()) + "\n---";
+		std::string str;
+		yaml::to_string(*this, str);
+		return str;
 	}
 	void Serializable::from_string(const std::string &str)
 	{
-		load(YAML::Load(str));
+		if (binary::is_binary(str))
+			binary::from_string(*this, str);
+		else
+			load(YAML::Load(str));
+	}
+	bool peek_scalar(const std::string &str, const std::string &key, std::string &value)
+	{
+		return binary::is_binary(str) ? binary::peek_scalar(str, key, value) : yaml::peek_scalar(str, key, value);
+	}
+	void Serializable::emit_into(YAML::Node &parent) const
+	{
+		yaml::merge_node(parent, emit());
+	}
+	void Serializable::emit_stream(YAML::Emitter &out) const
+	{
+		out << emit();
+	}
+	void Serializable::emit_binary(std::string &buffer) const
+	{
+		binary::append_node(buffer, emit());
+	}
+	void Serializable::load_binary(binary::Reader &in)
+	{
+		load(in.node());
+	}
+
+	namespace binary {
+
+		void to_string(const Serializable &obj, std::string &buffer)
+		{
+			buffer.assign(1, content_type);
+			obj.emit_binary(buffer);
+		}
+
+		std::string to_string(const Serializable &obj)
+		{
+			std::string str;
+			to_string(obj, str);
+			return str;
+		}
+
+		bool is_binary(const std::string &str)
+		{
+			return !str.empty() && str[0] == content_type;
+		}
+
+		void from_string(Serializable &obj, const std::string &str)
+		{
+			if (!is_binary(str))
+				throw std::runtime_error("String is not in the binary format.");
+			Reader in(str);
+			obj.load_binary(in);
+			if (!in.at_end())
+				throw std::runtime_error("Trailing bytes after message in binary format.");
+		}
+
+		YAML::Node load(const std::string &str)
+		{
+			if (!is_binary(str))
+				throw std::runtime_error("String is not in the binary format.");
+			Reader in(str);
+			auto node = in.node();
+			if (!in.at_end())
+				throw std::runtime_error("Trailing bytes after message in binary format.");
+			return node;
+		}
+
+		bool peek_scalar(const std::string &str, const std::string &key, std::string &value)
+		{
+			if (!is_binary(str))
+				throw std::runtime_error("String is not in the binary format.");
+			Reader in(str);
+			return find_scalar(in, key, value);
+		}
+
+		bool peek_scalar(Reader in, const std::string &key, std::string &value)
+		{
+			return find_scalar(in, key, value);
+		}
+
+		void require_entry(bool found, const char *key)
+		{
+			if (!found)
+				throw std::runtime_error(std::string("Missing entry \"") + key + "\" in binary format.");
+		}
+
+		void append_string(std::string &buffer, const char *str, std::size_t size)
+		{
+			append_header(buffer, size, 0xA0, 31, 0xD9, 0xDA, 0xDB);
+			buffer.append(str, size);
+		}
+
+		void append_sequence_header(std::string &buffer, std::size_t size)
+		{
+			append_header(buffer, size, 0x90, 15, 0, 0xDC, 0xDD);
+		}
+
+		void append_map_header(std::string &buffer, std::size_t size)
+		{
+			append_header(buffer, size, 0x80, 15, 0, 0xDE, 0xDF);
+		}
+
+		void insert_map_header(std::string &buffer, std::string::size_type pos, std::size_t size)
+		{
+			std::string header;
+			append_map_header(header, size);
+			buffer.insert(pos, header);
+		}
+
+		void append_null(std::string &buffer)
+		{
+			buffer.push_back(static_cast<char>(0xC0));
+		}
+
+		void append_node(std::string &buffer, const YAML::Node &node)
+		{
+			switch (node.Type()) {
+			case YAML::NodeType::Scalar: {
+				const auto &scalar = node.Scalar();
+				append_string(buffer, scalar.data(), scalar.size());
+				break;
+			}
+			case YAML::NodeType::Sequence:
+				append_sequence_header(buffer, node.size());
+				for (const auto &element : node)
+					append_node(buffer, element);
+				break;
+			case YAML::NodeType::Map:
+				append_map_header(buffer, node.size());
+				for (const auto &element : node) {
+					append_node(buffer, element.first);
+					append_node(buffer, element.second);
+				}
+				break;
+			default:
+				append_null(buffer);
+			}
+		}
+
+		Reader::Reader(const std::string &str, std::string::size_type pos) :
+			str(&str),
+			pos(pos)
+		{
+		}
+
+		Reader::Kind Reader::header(std::uint64_t &size)
+		{
+			auto type = read(1);
+			size = 0;
+			if ((type & 0xE0) == 0xA0) {
+				size = type & 0x1F;
+				return Kind::scalar;
+			}
+			if ((type & 0xF0) == 0x90) {
+				size = type & 0x0F;
+				return Kind::sequence;
+			}
+			if ((type & 0xF0) == 0x80) {
+				size = type & 0x0F;
+				return Kind::map;
+			}
+			switch (type) {
+			case 0xC0: return Kind::null;
+			case 0xD9: size = read(1); return Kind::scalar;
+			case 0xDA: size = read(2); return Kind::scalar;
+			case 0xDB: size = read(4); return Kind::scalar;
+			case 0xDC: size = read(2); return Kind::sequence;
+			case 0xDD: size = read(4); return Kind::sequence;
+			case 0xDE: size = read(2); return Kind::map;
+			case 0xDF: size = read(4); return Kind::map;
+			default: throw std::runtime_error("Unsupported type in binary format.");
+			}
+		}
+
+		const char * Reader::scalar(std::size_t &size)
+		{
+			std::uint64_t content_size;
+			if (header(content_size) != Kind::scalar)
+				throw std::runtime_error("Expected a scalar in binary format.");
+			size = content_size;
+			return content(content_size);
+		}
+
+		const char * Reader::content(std::uint64_t size)
+		{
+			check(size);
+			auto data = str->data() + pos;
+			pos += size;
+			return data;
+		}
+
+		std::size_t Reader::sequence_header()
+		{
+			std::uint64_t size;
+			if (header(size) != Kind::sequence)
+				throw std::runtime_error("Expected a sequence in binary format.");
+			// Every element takes at least one byte, which bounds the memory reserved for a malformed size.
+			check(size);
+			return size;
+		}
+
+		void Reader::skip()
+		{
+			std::uint64_t size;
+			auto kind = header(size);
+			skip(kind, size);
+		}
+
+		void Reader::skip(Kind kind, std::uint64_t size)
+		{
+			switch (kind) {
+			case Kind::scalar:
+				check(size);
+				pos += size;
+				break;
+			case Kind::sequence:
+				for (std::uint64_t i = 0; i != size; ++i)
+					skip();
+				break;
+			case Kind::map:
+				for (std::uint64_t i = 0; i != 2 * size; ++i)
+					skip();
+				break;
+			default:
+				break;
+			}
+		}
+
+		YAML::Node Reader::node()
+		{
+			std::uint64_t size;
+			switch (header(size)) {
+			case Kind::scalar:
+				return YAML::Node(std::string(content(size), size));
+			case Kind::sequence: {
+				YAML::Node node(YAML::NodeType::Sequence);
+				for (std::uint64_t i = 0; i != size; ++i)
+					node.push_back(this->node());
+				return node;
+			}
+			case Kind::map: {
+				YAML::Node node(YAML::NodeType::Map);
+				for (std::uint64_t i = 0; i != size; ++i) {
+					auto key = this->node();
+					node.force_insert(key, this->node());
+				}
+				return node;
+			}
+			default:
+				return YAML::Node(YAML::NodeType::Null);
+			}
+		}
+
+		bool Reader::at_end() const
+		{
+			return pos == str->size();
+		}
+
+		std::uint64_t Reader::read(unsigned int size)
+		{
+			check(size);
+			std::uint64_t value = 0;
+			for (unsigned int i = 0; i != size; ++i)
+				value = (value << 8) | static_cast<unsigned char>((*str)[pos++]);
+			return value;
+		}
+
+		void Reader::check(std::uint64_t size) const
+		{
+			if (size > str->size() - pos)
+				throw std::runtime_error("Truncated message in binary format.");
+		}
+
+		namespace detail
+		{
+			bool parse_scalar(const char *str, std::size_t size, bool &value)
+			{
+				// The spellings of append_value(), yaml-cpp accepts others like "yes" as well.
+				if (size == 4 && std::memcmp(str, "true", 4) == 0)
+					value = true;
+				else if (size == 5 && std::memcmp(str, "false", 5) == 0)
+					value = false;
+				else
+					return false;
+				return true;
+			}
+			bool parse_scalar(const char *str, std::size_t size, short &value)
+			{
+				return parse_integer(str, size, value);
+			}
+			bool parse_scalar(const char *str, std::size_t size, unsigned short &value)
+			{
+				return parse_integer(str, size, value);
+			}
+			bool parse_scalar(const char *str, std::size_t size, int &value)
+			{
+				return parse_integer(str, size, value);
+			}
+			bool parse_scalar(const char *str, std::size_t size, unsigned int &value)
+			{
+				return parse_integer(str, size, value);
+			}
+			bool parse_scalar(const char *str, std::size_t size, long &value)
+			{
+				return parse_integer(str, size, value);
+			}
+			bool parse_scalar(const char *str, std::size_t size, unsigned long &value)
+			{
+				return parse_integer(str, size, value);
+			}
+			bool parse_scalar(const char *str, std::size_t size, long long &value)
+			{
+				return parse_integer(str, size, value);
+			}
+			bool parse_scalar(const char *str, std::size_t size, unsigned long long &value)
+			{
+				return parse_integer(str, size, value);
+			}
+			bool parse_scalar(const char *str, std::size_t size, float &value)
+			{
+				return parse_float(str, size, value, std::strtof);
+			}
+			bool parse_scalar(const char *str, std::size_t size, double &value)
+			{
+				return parse_float(str, size, value, std::strtod);
+			}
+		}
+
 	}
 
 	namespace yaml {
 	
+		void to_string(const Serializable &obj, std::string &buffer)
+		{
+			YAML::Emitter out;
+			obj.emit_stream(out);
+			buffer.assign("---\n");
+			buffer.append(out.c_str(), out.size());
+			buffer.append("\n---");
+		}
+
 		void merge_node(YAML::Node &lhs, const YAML::Node &rhs)
 		{
 			for (const auto &node : rhs) {
-				std::string tag = YAML::Dump(node.first);
-				if (!lhs[tag]) {
-					lhs[tag] = rhs[tag];
+				// Scalar keys are used directly rather than dumped to a string.
+				std::string tag = node.first.IsScalar() ? node.first.Scalar() : YAML::Dump(node.first);
+				if (!static_cast<const YAML::Node &>(lhs)[tag])
+					lhs[tag] = node.second;
+			}
+		}
+
+		bool peek_scalar(const std::string &str, const std::string &key, std::string &value)
+		{
+			bool document_started = false;
+			for (std::string::size_type pos = 0; pos < str.size();) {
+				auto end = str.find('\n', pos);
+				if (end == std::string::npos)
+					end = str.size();
+				auto line_size = end - pos;
+				if (str.compare(pos, 3, "---") == 0 || str.compare(pos, 3, "...") == 0) {
+					// Stop at the end of the first document.
+					if (document_started)
+						return false;
+					document_started = true;
+				} else if (line_size > key.size() &&
+					   str.compare(pos, key.size(), key) == 0 &&
+					   str[pos + key.size()] == ':' &&
+					   (line_size == key.size() + 1 || str[pos + key.size() + 1] == ' ' ||
+					    str[pos + key.size() + 1] == '\t' || str[pos + key.size() + 1] == '\r')) {
+					auto begin = str.find_first_not_of(" \t", pos + key.size() + 1);
+					if (begin >= end || str[begin] == '\r' || str[begin] == '#')
+						return false; // Value is not a scalar on the same line.
+					auto last = begin;
+					value.clear();
+					if (str[begin] == '"') {
+						// Double quoted scalar: Decode escape sequences up to the closing quote.
+						for (last = begin + 1; last < end && str[last] != '"'; ++last) {
+							if (str[last] != '\\')
+								value.push_back(str[last]);
+							else if (!append_escape(str, ++last, end, value))
+								return false;
+						}
+					} else if (str[begin] == '\'') {
+						// Single quoted scalar: Unescape quotes up to the closing quote.
+						for (last = begin + 1; last < end && (str[last] != '\'' || str[last + 1] == '\''); ++last) {
+							if (str[last] == '\'')
+								++last;
+							value.push_back(str[last]);
+						}
+					} else {
+						if (str[begin] == '|' || str[begin] == '>' || str[begin] == '{' || str[begin] == '[' ||
+						    str[begin] == '&' || str[begin] == '*' || str[begin] == '!')
+							return false; // Not a plain scalar.
+						// Plain scalar: A comment starts with '#' after white space.
+						auto comment = begin;
+						do
+							comment = str.find('#', comment + 1);
+						while (comment < end && str[comment - 1] != ' ' && str[comment - 1] != '\t');
+						last = str.find_last_not_of(" \t\r", std::min(comment, end) - 1);
+						value.assign(str, begin, last - begin + 1);
+						return true;
+					}
+					// A quoted scalar must be closed on the same line, and only be followed by a comment.
+					if (last >= end)
+						return false;
+					auto rest = str.find_first_not_of(" \t\r", last + 1);
+					return rest >= end || (str[rest] == '#' && (str[rest - 1] == ' ' || str[rest - 1] == '\t'));
+				} else if (line_size != 0 && str[pos] != ' ' && str[pos] != '#') {
+					document_started = true;
 				}
+				pos = end + 1;
 			}
+			return false;
 		}
 	
 	}
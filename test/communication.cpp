@@ -1,11 +1,56 @@
 #include <fructose/fructose.h>
 
 #include <fast-lib/mqtt_communicator.hpp>
+#include <fast-lib/serializable.hpp>
+#include <fast-lib/message/agent/stop_monitor.hpp>
+#include <fast-lib/message/agent/mmbwmon/request.hpp>
+#include <fast-lib/message_router.hpp>
 
+#include <algorithm>
 #include <memory>
 #include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <set>
 #include <thread>
 
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+// Count the mappings of the process bound to NUMA nodes.
+static unsigned int count_bound_mappings()
+{
+	std::ifstream numa_maps("/proc/self/numa_maps");
+	unsigned int count = 0;
+	for (std::string line; std::getline(numa_maps, line);) {
+		if (line.find(" bind:") != std::string::npos)
+			++count;
+	}
+	return count;
+}
+
+// A message type which is not Serializable, but sent with its own codec.
+struct Counter
+{
+	unsigned long value;
+};
+
+namespace fast {
+	template<> struct Message_codec<Counter>
+	{
+		static void encode(const Counter &msg, std::string &buffer)
+		{
+			buffer = std::to_string(msg.value);
+		}
+		static void decode(const std::string &buffer, Counter &msg)
+		{
+			msg.value = std::stoul(buffer);
+		}
+	};
+}
+
 struct Communication_tester :
 	public fructose::test_base<Communication_tester>
 {
@@ -56,6 +101,824 @@ struct Communication_tester :
 		std::this_thread::sleep_for(std::chrono::seconds(1));
 	}
 
+	void multiple_brokers(const std::string &test_name)
+	{
+		(void) test_name;
+		fast::MQTT_communicator comm2("", topic1);
+		// The first broker is not reachable, so the second one has to be used.
+		std::vector<fast::Broker_endpoint> brokers{{host, 1}, {host, port}};
+		fructose_assert_no_exception(
+			comm2.connect_to_broker(brokers, keepalive, std::chrono::seconds(5))
+		);
+		fructose_assert(comm2.is_connected());
+		fructose_assert_eq(comm2.get_active_broker().port, port);
+		const std::string original_msg("Hallo Welt");
+		std::string msg;
+		comm2.add_subscription(topic2);
+		comm2.send_message(original_msg, topic2);
+		fructose_assert_no_exception(
+			msg = comm2.get_message(topic2, std::chrono::seconds(5))
+		);
+		fructose_assert_eq(msg, original_msg);
+	}
+
+	void priorities(const std::string &test_name)
+	{
+		(void) test_name;
+		fast::MQTT_communicator comm2("", topic1);
+		fructose_assert_no_exception(
+			comm2.connect_to_broker(host, port, keepalive, std::chrono::seconds(5))
+		);
+		const std::string bulk_topic("test/priority/bulk");
+		const std::string control_topic("test/priority/control");
+		const std::string all_topics("test/priority/#");
+		comm2.add_subscription(all_topics, 2, fast::Priority::low);
+		comm2.add_subscription(control_topic, 2, fast::Priority::high);
+		for (unsigned int i = 0; i != 3; ++i)
+			comm2.send_message("bulk", bulk_topic, 2, fast::Priority::low);
+		comm2.send_message("control", control_topic, 2, fast::Priority::high);
+		// Wait until all messages have arrived.
+		std::this_thread::sleep_for(std::chrono::seconds(1));
+		std::string actual_topic;
+		fructose_assert_eq(comm2.get_message(all_topics, std::chrono::seconds(5), &actual_topic), "control");
+		fructose_assert_eq(actual_topic, control_topic);
+		for (unsigned int i = 0; i != 3; ++i)
+			fructose_assert_eq(comm2.get_message(all_topics, std::chrono::seconds(5)), "bulk");
+		fructose_assert_eq(comm2.get_message(control_topic, std::chrono::seconds(5)), "control");
+		// A full queue of high priority messages drops arriving messages with a lower priority.
+		const std::string bounded_bulk_topic("test/priority/bounded/bulk");
+		const std::string bounded_control_topic("test/priority/bounded/control");
+		const std::string bounded_topics("test/priority/bounded/#");
+		fast::Topic_policy bounded_policy;
+		bounded_policy.queue_bound = 2;
+		comm2.set_topic_policy(bounded_topics, bounded_policy);
+		comm2.add_subscription(bounded_topics, 2, fast::Priority::low);
+		comm2.add_subscription(bounded_control_topic, 2, fast::Priority::high);
+		comm2.send_message("control 1", bounded_control_topic, 2, fast::Priority::high);
+		comm2.send_message("control 2", bounded_control_topic, 2, fast::Priority::high);
+		std::this_thread::sleep_for(std::chrono::milliseconds(500));
+		comm2.send_message("bulk", bounded_bulk_topic, 2, fast::Priority::low);
+		std::this_thread::sleep_for(std::chrono::milliseconds(500));
+		fructose_assert_eq(comm2.get_message(bounded_topics, std::chrono::seconds(5)), "control 1");
+		fructose_assert_eq(comm2.get_message(bounded_topics, std::chrono::seconds(5)), "control 2");
+		fructose_assert_exception(comm2.get_message(bounded_topics, std::chrono::milliseconds(200)), std::runtime_error);
+		fructose_assert_eq(comm2.get_subscription_stats(bounded_topics).dropped, 1u);
+	}
+
+	void expiry(const std::string &test_name)
+	{
+		(void) test_name;
+		fast::MQTT_communicator comm2("", topic1);
+		fructose_assert_no_exception(
+			comm2.connect_to_broker(host, port, keepalive, std::chrono::seconds(5))
+		);
+		const std::string ttl_topic("test/expiry/subscription");
+		const std::string envelope_topic("test/expiry/message");
+		comm2.add_subscription(ttl_topic);
+		comm2.add_subscription(envelope_topic);
+		fructose_assert_no_exception(
+			comm2.set_subscription_ttl(ttl_topic, std::chrono::milliseconds(200))
+		);
+		fructose_assert_exception(
+			comm2.set_subscription_ttl("test/expiry/unknown", std::chrono::seconds(1)),
+			std::out_of_range
+		);
+		// Stale backlog on both subscriptions.
+		for (unsigned int i = 0; i != 3; ++i) {
+			comm2.send_message("stale", ttl_topic);
+			comm2.send_message("stale", envelope_topic, 2, fast::Priority::normal, std::chrono::milliseconds(200));
+		}
+		std::this_thread::sleep_for(std::chrono::seconds(1));
+		comm2.send_message("fresh", ttl_topic);
+		comm2.send_message("fresh", envelope_topic, 2, fast::Priority::normal, std::chrono::seconds(10));
+		fructose_assert_eq(comm2.get_message(ttl_topic, std::chrono::seconds(5)), "fresh");
+		fructose_assert_eq(comm2.get_message(envelope_topic, std::chrono::seconds(5)), "fresh");
+		auto stats = comm2.get_subscription_stats(ttl_topic);
+		fructose_assert_eq(stats.received, 4u);
+		fructose_assert_eq(stats.expired, 3u);
+		stats = comm2.get_subscription_stats(envelope_topic);
+		fructose_assert_eq(stats.received, 4u);
+		fructose_assert_eq(stats.expired, 3u);
+	}
+
+	void duplicates(const std::string &test_name)
+	{
+		(void) test_name;
+		fast::MQTT_communicator comm2("", topic1);
+		fructose_assert_no_exception(
+			comm2.connect_to_broker(host, port, keepalive, std::chrono::seconds(5))
+		);
+		const std::string dedup_topic("test/duplicates");
+		comm2.add_subscription(dedup_topic);
+		comm2.set_subscription_dedup(dedup_topic, [](const std::string &msg) {
+			std::string id;
+			fast::yaml::peek_scalar(msg, "id", id);
+			return id;
+		});
+		comm2.send_message("---\nid: 1\ntask: start vm\n---", dedup_topic, 1);
+		comm2.send_message("---\nid: 1\ntask: start vm\n---", dedup_topic, 1);
+		comm2.send_message("---\nid: 2\ntask: start vm\n---", dedup_topic, 1);
+		std::string id;
+		fructose_assert(fast::yaml::peek_scalar(comm2.get_message(dedup_topic, std::chrono::seconds(5)), "id", id));
+		fructose_assert_eq(id, "1");
+		fructose_assert(fast::yaml::peek_scalar(comm2.get_message(dedup_topic, std::chrono::seconds(5)), "id", id));
+		fructose_assert_eq(id, "2");
+		auto stats = comm2.get_subscription_stats(dedup_topic);
+		fructose_assert_eq(stats.received, 3u);
+		fructose_assert_eq(stats.duplicates, 1u);
+	}
+
+	void chunking(const std::string &test_name)
+	{
+		(void) test_name;
+		fast::MQTT_communicator comm2("", topic1);
+		fructose_assert_no_exception(
+			comm2.connect_to_broker(host, port, keepalive, std::chrono::seconds(5))
+		);
+		const std::string chunk_topic("test/chunking");
+		comm2.add_subscription(chunk_topic);
+		comm2.set_chunking(1000);
+		std::string large_msg;
+		for (unsigned int i = 0; large_msg.size() < 10500; ++i)
+			large_msg += std::to_string(i) + ",";
+		comm2.send_message(large_msg, chunk_topic);
+		comm2.send_message(large_msg, chunk_topic, 1, fast::Priority::normal, std::chrono::seconds(10));
+		comm2.send_message("small", chunk_topic);
+		std::vector<std::string> msgs;
+		for (unsigned int i = 0; i != 3; ++i)
+			msgs.push_back(comm2.get_message(chunk_topic, std::chrono::seconds(5)));
+		fructose_assert_eq(std::count(msgs.begin(), msgs.end(), large_msg), 2);
+		fructose_assert_eq(std::count(msgs.begin(), msgs.end(), "small"), 1);
+		auto stats = comm2.get_subscription_stats(chunk_topic);
+		fructose_assert_eq(stats.received, 3u);
+	}
+
+	// Build a chunk as sent by MQTT_communicator, with fields chosen by the caller.
+	static std::string forge_chunk(std::uint32_t chunk_count, std::uint64_t chunk_offset, std::uint64_t message_size, const std::string &data,
+				       std::uint64_t chunk_id = 42, std::uint32_t chunk_index = 0)
+	{
+		std::string chunk{'\xFA', '\x57', 1, 0x02};
+		auto append = [&chunk](std::uint64_t value, int size) {
+			for (int shift = 8 * (size - 1); shift >= 0; shift -= 8)
+				chunk.push_back(static_cast<char>((value >> shift) & 0xFF));
+		};
+		append(chunk_id, 8);
+		append(chunk_index, 4);
+		append(chunk_count, 4);
+		append(chunk_offset, 8);
+		append(message_size, 8);
+		return chunk + data;
+	}
+
+	void chunk_limit(const std::string &test_name)
+	{
+		(void) test_name;
+		fast::MQTT_communicator comm2("", topic1);
+		fructose_assert_no_exception(
+			comm2.connect_to_broker(host, port, keepalive, std::chrono::seconds(5))
+		);
+		const std::string chunk_topic("test/chunk-limit");
+		comm2.add_subscription(chunk_topic);
+		comm2.set_chunking(1000, std::chrono::seconds(30), 5000);
+		// Forged chunks are discarded without allocating the stated message size.
+		comm2.send_message(forge_chunk(2, 0, std::uint64_t(1) << 40, "x"), chunk_topic);
+		comm2.send_message(forge_chunk(2, 8, 10, "xyz"), chunk_topic);
+		comm2.send_message(forge_chunk(100, 0, 10, "x"), chunk_topic);
+		// Chunked messages are accepted up to the maximum size.
+		comm2.send_message(std::string(10500, 'l'), chunk_topic);
+		comm2.send_message(std::string(4000, 's'), chunk_topic);
+		comm2.send_message("small", chunk_topic);
+		std::vector<std::string> msgs;
+		for (unsigned int i = 0; i != 2; ++i)
+			msgs.push_back(comm2.get_message(chunk_topic, std::chrono::seconds(5)));
+		fructose_assert_eq(std::count(msgs.begin(), msgs.end(), std::string(4000, 's')), 1);
+		fructose_assert_eq(std::count(msgs.begin(), msgs.end(), "small"), 1);
+		fructose_assert_exception(comm2.get_message(chunk_topic, std::chrono::milliseconds(200)), std::runtime_error);
+	}
+
+	void reassembly_limit(const std::string &test_name)
+	{
+		(void) test_name;
+		fast::MQTT_communicator comm2("", topic1);
+		fructose_assert_no_exception(
+			comm2.connect_to_broker(host, port, keepalive, std::chrono::seconds(5))
+		);
+		const std::string chunk_topic("test/reassembly-limit");
+		comm2.add_subscription(chunk_topic);
+		comm2.set_chunking(1000, std::chrono::seconds(1), 5000, 10000);
+		// Incomplete messages take the whole memory left for reassembly, so further messages are discarded.
+		// Messages sent in chunks may be interleaved with others, so all chunks are forged to keep their order.
+		comm2.send_message(forge_chunk(2, 0, 5000, "a", 1), chunk_topic);
+		comm2.send_message(forge_chunk(2, 0, 5000, "b", 2), chunk_topic);
+		comm2.send_message(forge_chunk(2, 0, 10, "r", 3), chunk_topic);
+		comm2.send_message(forge_chunk(2, 5, 10, "r", 3, 1), chunk_topic);
+		// Completing a message frees its memory.
+		comm2.send_message(forge_chunk(2, 2500, 5000, "c", 1, 1), chunk_topic);
+		comm2.send_message(forge_chunk(2, 0, 10, "s", 4), chunk_topic);
+		comm2.send_message(forge_chunk(2, 5, 10, "s", 4, 1), chunk_topic);
+		std::vector<std::string> msgs;
+		for (unsigned int i = 0; i != 2; ++i)
+			msgs.push_back(comm2.get_message(chunk_topic, std::chrono::seconds(5)));
+		fructose_assert_eq(msgs[0].size(), 5000u);
+		fructose_assert_eq(msgs[1].size(), 10u);
+		fructose_assert_eq(msgs[1][5], 's');
+		fructose_assert_exception(comm2.get_message(chunk_topic, std::chrono::milliseconds(200)), std::runtime_error);
+		// A topic holds 16 incomplete messages, a further one evicts the oldest.
+		for (std::uint64_t id = 100; id != 117; ++id)
+			comm2.send_message(forge_chunk(2, 0, 10, "x", id), chunk_topic);
+		comm2.send_message(forge_chunk(2, 5, 10, "y", 100, 1), chunk_topic);
+		comm2.send_message(forge_chunk(2, 5, 10, "z", 116, 1), chunk_topic);
+		auto msg = comm2.get_message(chunk_topic, std::chrono::seconds(5));
+		fructose_assert_eq(msg.size(), 10u);
+		fructose_assert_eq(msg[5], 'z');
+		fructose_assert_exception(comm2.get_message(chunk_topic, std::chrono::milliseconds(200)), std::runtime_error);
+		// Chunks received twice do not keep a message from missing the timeout.
+		for (unsigned int i = 0; i != 4; ++i) {
+			comm2.send_message(forge_chunk(2, 0, 10, "x", 200), chunk_topic);
+			std::this_thread::sleep_for(std::chrono::milliseconds(300));
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(400));
+		comm2.send_message(forge_chunk(2, 5, 10, "y", 200, 1), chunk_topic);
+		fructose_assert_exception(comm2.get_message(chunk_topic, std::chrono::milliseconds(500)), std::runtime_error);
+	}
+
+	void multicast(const std::string &test_name)
+	{
+		(void) test_name;
+		fast::MQTT_communicator comm2("", topic1);
+		fructose_assert_no_exception(
+			comm2.connect_to_broker(host, port, keepalive, std::chrono::seconds(5))
+		);
+		std::vector<std::string> topics;
+		for (unsigned int i = 0; i != 10; ++i)
+			topics.push_back("test/multicast/host" + std::to_string(i) + "/task");
+		comm2.add_subscription("test/multicast/+/task");
+		fructose_assert_no_exception(
+			comm2.multicast_message("broadcast", topics)
+		);
+		std::vector<std::string> actual_topics;
+		for (unsigned int i = 0; i != topics.size(); ++i) {
+			std::string actual_topic;
+			fructose_assert_eq(comm2.get_message("test/multicast/+/task", std::chrono::seconds(5), &actual_topic), "broadcast");
+			actual_topics.push_back(actual_topic);
+		}
+		std::sort(actual_topics.begin(), actual_topics.end());
+		std::sort(topics.begin(), topics.end());
+		fructose_assert(actual_topics == topics);
+		// A message held back before a failed publish is still sent.
+		const std::string batch_topic("test/multicast/partial");
+		fast::Topic_policy batch_policy;
+		batch_policy.batch_size = 10;
+		batch_policy.batch_delay = std::chrono::milliseconds(100);
+		comm2.set_topic_policy(batch_topic, batch_policy);
+		comm2.add_subscription(batch_topic);
+		// A topic with wildcards is invalid to publish to, and fails directly with high priority.
+		const std::string invalid_topic("test/multicast/+");
+		fast::Topic_policy invalid_policy;
+		invalid_policy.priority = fast::Priority::high;
+		comm2.set_topic_policy(invalid_topic, invalid_policy);
+		const std::vector<std::string> partial_topics{batch_topic, invalid_topic};
+		fructose_assert_exception(
+			comm2.multicast_message("partial", partial_topics),
+			std::runtime_error
+		);
+		fructose_assert_eq(comm2.get_message(batch_topic, std::chrono::seconds(5)), "partial");
+	}
+
+	void post(const std::string &test_name)
+	{
+		(void) test_name;
+		fast::MQTT_communicator comm2("", topic1);
+		fructose_assert_no_exception(
+			comm2.connect_to_broker(host, port, keepalive, std::chrono::seconds(5))
+		);
+		const std::string post_topic("test/post/+");
+		comm2.add_subscription(post_topic);
+		const unsigned int thread_count = 4;
+		const unsigned int message_count = 100;
+		std::vector<std::thread> threads;
+		for (unsigned int t = 0; t != thread_count; ++t) {
+			threads.emplace_back([&comm2, t, message_count] {
+				for (unsigned int i = 0; i != message_count; ++i)
+					comm2.post_message(std::to_string(i), "test/post/" + std::to_string(t), 1);
+			});
+		}
+		for (auto &thread : threads)
+			thread.join();
+		// Messages of each thread keep their order.
+		std::vector<unsigned int> next(thread_count, 0);
+		for (unsigned int i = 0; i != thread_count * message_count; ++i) {
+			std::string actual_topic;
+			auto msg = comm2.get_message(post_topic, std::chrono::seconds(5), &actual_topic);
+			auto t = std::stoul(actual_topic.substr(actual_topic.rfind('/') + 1));
+			fructose_assert_eq(msg, std::to_string(next[t]++));
+		}
+	}
+
+	void post_overflow(const std::string &test_name)
+	{
+		(void) test_name;
+		fast::MQTT_communicator comm2("", topic1);
+		fructose_assert_no_exception(
+			comm2.connect_to_broker(host, port, keepalive, std::chrono::seconds(5))
+		);
+		const std::string post_topic("test/post-overflow/+");
+		comm2.add_subscription(post_topic);
+		// More messages than fit in the producer queue of a thread, so posting falls back to the locked queues.
+		const unsigned int thread_count = 2;
+		const unsigned int message_count = 5000;
+		std::vector<std::thread> threads;
+		for (unsigned int t = 0; t != thread_count; ++t) {
+			threads.emplace_back([&comm2, t, message_count] {
+				for (unsigned int i = 0; i != message_count; ++i)
+					comm2.post_message(std::to_string(i), "test/post-overflow/" + std::to_string(t), 1);
+			});
+		}
+		for (auto &thread : threads)
+			thread.join();
+		std::vector<unsigned int> next(thread_count, 0);
+		unsigned int reordered = 0;
+		for (unsigned int i = 0; i != thread_count * message_count; ++i) {
+			std::string actual_topic;
+			auto msg = comm2.get_message(post_topic, std::chrono::seconds(5), &actual_topic);
+			auto t = std::stoul(actual_topic.substr(actual_topic.rfind('/') + 1));
+			if (msg != std::to_string(next[t]++))
+				++reordered;
+		}
+		fructose_assert_eq(reordered, 0u);
+	}
+
+	void handle(const std::string &test_name)
+	{
+		(void) test_name;
+		fast::MQTT_communicator comm2("", topic1);
+		fructose_assert_no_exception(
+			comm2.connect_to_broker(host, port, keepalive, std::chrono::seconds(5))
+		);
+		const std::string handle_topic("test/handle");
+		auto handle = comm2.add_subscription(handle_topic);
+		fructose_assert(static_cast<bool>(handle));
+		fructose_assert_eq(handle.get_topic(), handle_topic);
+		// Adding the topic again refers to the same subscription.
+		auto again = comm2.add_subscription(handle_topic);
+		comm2.send_message("first", handle_topic, 1);
+		comm2.send_message("second", handle_topic, 1);
+		std::string actual_topic;
+		fructose_assert_eq(handle.get_message(std::chrono::seconds(5), &actual_topic), "first");
+		fructose_assert_eq(actual_topic, handle_topic);
+		fructose_assert_eq(again.get_message(std::chrono::seconds(5)), "second");
+		fructose_assert_eq(handle.get_stats().received, 2u);
+		comm2.remove_subscription(handle);
+		fructose_assert_exception(comm2.get_message(handle_topic, std::chrono::milliseconds(1)), std::out_of_range);
+		// Removing twice and empty handles are ignored.
+		fructose_assert_no_exception(comm2.remove_subscription(again));
+		fructose_assert_no_exception(comm2.remove_subscription(fast::Subscription_handle()));
+		fructose_assert_exception(fast::Subscription_handle().get_message(), std::runtime_error);
+	}
+
+	void shutdown(const std::string &test_name)
+	{
+		(void) test_name;
+		const std::string shutdown_topic("test/shutdown");
+		fast::MQTT_communicator receiver("", topic1);
+		fructose_assert_no_exception(
+			receiver.connect_to_broker(host, port, keepalive, std::chrono::seconds(5))
+		);
+		receiver.add_subscription(shutdown_topic);
+		fast::MQTT_communicator comm2("", topic1);
+		fructose_assert_no_exception(
+			comm2.connect_to_broker(host, port, keepalive, std::chrono::seconds(5))
+		);
+		const unsigned int message_count = 50;
+		for (unsigned int i = 0; i != message_count; ++i)
+			comm2.post_message(std::to_string(i), shutdown_topic, 2);
+		// All messages are acknowledged before disconnecting.
+		fructose_assert(comm2.shutdown(std::chrono::seconds(5)));
+		fructose_assert(!comm2.is_connected());
+		fructose_assert_exception(
+			comm2.send_message("late", shutdown_topic),
+			std::runtime_error
+		);
+		for (unsigned int i = 0; i != message_count; ++i)
+			fructose_assert_eq(receiver.get_message(shutdown_topic, std::chrono::seconds(5)), std::to_string(i));
+	}
+
+	void typed(const std::string &test_name)
+	{
+		(void) test_name;
+		fast::MQTT_communicator comm2("", topic1);
+		fructose_assert_no_exception(
+			comm2.connect_to_broker(host, port, keepalive, std::chrono::seconds(5))
+		);
+		const std::string typed_topic("test/typed");
+		comm2.add_subscription(typed_topic);
+		// Serializable messages are sent as YAML.
+		fast::msg::agent::stop_monitoring sent("job", 42);
+		comm2.send(sent, typed_topic);
+		fructose_assert_eq(comm2.get_message(typed_topic, std::chrono::seconds(5)), sent.to_string());
+		comm2.send(sent, typed_topic);
+		fast::msg::agent::stop_monitoring received;
+		comm2.receive(typed_topic, received, std::chrono::seconds(5));
+		fructose_assert_eq(received.job_desc.job_id, "job");
+		fructose_assert_eq(received.job_desc.process_id, 42u);
+		// Other message types use their codec.
+		comm2.send(Counter{7}, typed_topic);
+		fructose_assert_eq(comm2.get_message(typed_topic, std::chrono::seconds(5)), "7");
+		comm2.send(Counter{8}, typed_topic);
+		Counter counter{0};
+		comm2.receive(typed_topic, counter, std::chrono::seconds(5));
+		fructose_assert_eq(counter.value, 8ul);
+	}
+
+	void router(const std::string &test_name)
+	{
+		(void) test_name;
+		fast::MQTT_communicator comm2("", topic1);
+		fructose_assert_no_exception(
+			comm2.connect_to_broker(host, port, keepalive, std::chrono::seconds(5))
+		);
+		const std::string task_topic("test/router/+/task");
+		std::mutex mutex;
+		std::condition_variable cv;
+		std::vector<std::string> routed;
+		fast::Message_router router;
+		router.add_handler<fast::msg::agent::stop_monitoring>(task_topic, "stop monitoring", [&](fast::msg::agent::stop_monitoring &msg) {
+			std::lock_guard<std::mutex> lock(mutex);
+			routed.push_back("stop " + msg.job_desc.job_id);
+			cv.notify_one();
+		});
+		// Requests are emitted without task.
+		router.add_handler<fast::msg::agent::mmbwmon::request>(task_topic, "", [&](fast::msg::agent::mmbwmon::request &msg) {
+			std::lock_guard<std::mutex> lock(mutex);
+			routed.push_back("mmbwmon " + std::to_string(msg.cores.size()));
+			cv.notify_one();
+		});
+		// Messages of unknown tasks or topics are not routed.
+		fructose_assert(!router.route(task_topic, "task: unknown"));
+		fructose_assert(!router.route("test/router/other", fast::msg::agent::stop_monitoring("job", 1).to_string()));
+		router.subscribe(comm2);
+		comm2.send_message("task: unknown", "test/router/host/task");
+		comm2.send(fast::msg::agent::mmbwmon::request({0, 1}), "test/router/host/task");
+		comm2.send(fast::msg::agent::stop_monitoring("job", 1), "test/router/host/task");
+		// Binary messages are routed as well.
+		comm2.send_message(fast::binary::to_string(fast::msg::agent::stop_monitoring("binary job", 1)), "test/router/host/task");
+		std::unique_lock<std::mutex> lock(mutex);
+		fructose_assert(cv.wait_for(lock, std::chrono::seconds(5), [&routed]{return routed.size() == 3;}));
+		fructose_assert(routed == std::vector<std::string>({"mmbwmon 2", "stop job", "stop binary job"}));
+		lock.unlock();
+		comm2.remove_subscription(task_topic);
+	}
+
+	void batching(const std::string &test_name)
+	{
+		(void) test_name;
+		fast::MQTT_communicator comm2("", topic1);
+		fructose_assert_no_exception(
+			comm2.connect_to_broker(host, port, keepalive, std::chrono::seconds(5))
+		);
+		const std::string batch_topic("test/batch");
+		fast::Topic_policy batch_policy;
+		batch_policy.qos = 1;
+		batch_policy.batch_size = 10;
+		batch_policy.batch_delay = std::chrono::milliseconds(100);
+		comm2.set_topic_policy(batch_topic, batch_policy);
+		comm2.add_subscription(batch_topic);
+		// Two full batches are sent at once, the remaining messages after the delay.
+		const unsigned int message_count = 25;
+		for (unsigned int i = 0; i != 20; ++i)
+			comm2.send_message(std::to_string(i), batch_topic);
+		// Messages in batches may expire.
+		for (unsigned int i = 20; i != message_count; ++i)
+			comm2.post_message(std::to_string(i), batch_topic, -1, fast::Priority::by_policy, std::chrono::seconds(60));
+		for (unsigned int i = 0; i != message_count; ++i)
+			fructose_assert_eq(comm2.get_message(batch_topic, std::chrono::seconds(5)), std::to_string(i));
+		fructose_assert_eq(comm2.get_subscription_stats(batch_topic).received, message_count);
+		// A single message is sent after the delay, even if the outbound thread sleeps.
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+		comm2.send_message("single", batch_topic);
+		fructose_assert_eq(comm2.get_message(batch_topic, std::chrono::seconds(5)), "single");
+	}
+
+	void compression(const std::string &test_name)
+	{
+		(void) test_name;
+		fast::MQTT_communicator comm2("", topic1);
+		fructose_assert_no_exception(
+			comm2.connect_to_broker(host, port, keepalive, std::chrono::seconds(5))
+		);
+		const std::string compress_topic("test/compress");
+		fast::Topic_policy compress_policy;
+		for (auto compression : {fast::Compression::lz4, fast::Compression::zlib}) {
+			compress_policy.compression = compression;
+			if (!fast::MQTT_communicator::compression_available(compression)) {
+				fructose_assert_exception(
+					comm2.set_topic_policy(compress_topic, compress_policy),
+					std::runtime_error
+				);
+				continue;
+			}
+			comm2.set_topic_policy(compress_topic, compress_policy);
+			comm2.add_subscription(compress_topic);
+			std::string large;
+			for (unsigned int i = 0; large.size() < 300 * 1024; ++i)
+				large += "- vm-name: vm" + std::to_string(i) + "\n  memory: 1048576\n";
+			// Small and incompressible messages are sent as they are.
+			comm2.send_message("small", compress_topic);
+			comm2.send_message(large, compress_topic, -1, fast::Priority::by_policy, std::chrono::seconds(60));
+			comm2.post_message(large, compress_topic);
+			fructose_assert_eq(comm2.get_message(compress_topic, std::chrono::seconds(5)), "small");
+			fructose_assert(comm2.get_message(compress_topic, std::chrono::seconds(5)) == large);
+			fructose_assert(comm2.get_message(compress_topic, std::chrono::seconds(5)) == large);
+			// Compressed messages are sent in chunks if they are still large.
+			comm2.set_chunking(1024);
+			comm2.send_message(large, compress_topic);
+			fructose_assert(comm2.get_message(compress_topic, std::chrono::seconds(5)) == large);
+			comm2.set_chunking(256 * 1024);
+			// Compression buffers are reused by following messages.
+			std::string shorter = large.substr(0, large.size() / 2) + "end";
+			comm2.post_message(large, compress_topic);
+			comm2.post_message(shorter, compress_topic);
+			comm2.post_message(large, compress_topic);
+			fructose_assert(comm2.get_message(compress_topic, std::chrono::seconds(5)) == large);
+			fructose_assert(comm2.get_message(compress_topic, std::chrono::seconds(5)) == shorter);
+			fructose_assert(comm2.get_message(compress_topic, std::chrono::seconds(5)) == large);
+			// Messages stating an uncompressed size above the maximum message size are discarded.
+			comm2.set_chunking(256 * 1024, std::chrono::seconds(30), 1024 * 1024);
+			std::string forged{'\xFA', '\x57', 1, 0x08, static_cast<char>(compression)};
+			for (int shift = 56; shift >= 0; shift -= 8)
+				forged.push_back(static_cast<char>(((std::uint64_t(1) << 31) >> shift) & 0xFF));
+			fast::Topic_policy plain_policy;
+			comm2.set_topic_policy(compress_topic, plain_policy);
+			comm2.send_message(forged + "data", compress_topic);
+			comm2.send_message("after", compress_topic);
+			fructose_assert_eq(comm2.get_message(compress_topic, std::chrono::seconds(5)), "after");
+			comm2.set_chunking(256 * 1024);
+			comm2.remove_subscription(compress_topic);
+		}
+	}
+
+	void latency_probe(const std::string &test_name)
+	{
+		(void) test_name;
+		fast::MQTT_communicator comm2("", topic1);
+		fructose_assert(!comm2.is_broker_latency_stale());
+		fructose_assert_eq(comm2.get_broker_latency().samples, 0u);
+		fructose_assert_no_exception(
+			comm2.connect_to_broker(host, port, keepalive, std::chrono::seconds(5))
+		);
+		comm2.set_latency_probe(std::chrono::milliseconds(20), std::chrono::milliseconds(300));
+		std::this_thread::sleep_for(std::chrono::milliseconds(500));
+		auto latency = comm2.get_broker_latency();
+		fructose_assert(latency.samples > 5);
+		fructose_assert(!latency.stale);
+		fructose_assert(latency.median <= latency.p99 && latency.p99 <= latency.max);
+		unsigned int histogram_samples = 0;
+		for (auto bucket : latency.histogram)
+			histogram_samples += bucket;
+		fructose_assert_eq(histogram_samples, latency.samples);
+		// Without connection no ping returns.
+		comm2.disconnect_from_broker();
+		std::this_thread::sleep_for(std::chrono::milliseconds(500));
+		fructose_assert(comm2.is_broker_latency_stale());
+		comm2.set_latency_probe(std::chrono::seconds(0));
+		fructose_assert(!comm2.is_broker_latency_stale());
+		// Pings do not count as unacknowledged messages when shutting down.
+		fast::MQTT_communicator comm3("", topic1, host, port, keepalive, std::chrono::seconds(5));
+		comm3.set_latency_probe(std::chrono::milliseconds(10));
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+		auto start = std::chrono::steady_clock::now();
+		fructose_assert(comm3.shutdown(std::chrono::seconds(2)));
+		fructose_assert(std::chrono::steady_clock::now() - start < std::chrono::seconds(1));
+	}
+
+	void policies(const std::string &test_name)
+	{
+		(void) test_name;
+		fast::MQTT_communicator comm2("", topic1);
+		fructose_assert_no_exception(
+			comm2.connect_to_broker(host, port, keepalive, std::chrono::seconds(5))
+		);
+		fast::Topic_policy telemetry_policy;
+		telemetry_policy.qos = 0;
+		telemetry_policy.queue_bound = 2;
+		telemetry_policy.priority = fast::Priority::low;
+		fast::Topic_policy control_policy;
+		control_policy.dispatch = fast::Dispatch_mode::deferred;
+		comm2.set_topic_policy("test/policy/#", telemetry_policy);
+		comm2.set_topic_policy("test/policy/control", control_policy);
+		// The longest matching topic filter wins.
+		fructose_assert_eq(comm2.get_topic_policy("test/policy/kpi").qos, 0);
+		fructose_assert_eq(comm2.get_topic_policy("test/policy/control").qos, 2);
+		fructose_assert(comm2.get_topic_policy("test/policy/control").dispatch == fast::Dispatch_mode::deferred);
+		fructose_assert_eq(comm2.get_topic_policy("test/other").qos, 2);
+		// Policies stay correct when the cache of resolved topics is cleared for many distinct topics.
+		for (unsigned int i = 0; i != 10000; ++i)
+			fructose_assert_eq(comm2.get_topic_policy("test/policy/job" + std::to_string(i)).qos, 0);
+		fructose_assert(comm2.get_topic_policy("test/policy/control").dispatch == fast::Dispatch_mode::deferred);
+		fast::Topic_policy invalid_policy;
+		invalid_policy.qos = 3;
+		fructose_assert_exception(
+			comm2.set_topic_policy("test/invalid", invalid_policy),
+			std::runtime_error
+		);
+		// Bounded subscriptions drop messages arriving at a full queue if they have no higher priority.
+		const std::string kpi_topic("test/policy/kpi");
+		comm2.add_subscription(kpi_topic);
+		for (unsigned int i = 0; i != 5; ++i)
+			comm2.send_message(std::to_string(i), kpi_topic);
+		std::this_thread::sleep_for(std::chrono::seconds(1));
+		fructose_assert_eq(comm2.get_message(kpi_topic, std::chrono::seconds(5)), "0");
+		fructose_assert_eq(comm2.get_message(kpi_topic, std::chrono::seconds(5)), "1");
+		fructose_assert_eq(comm2.get_subscription_stats(kpi_topic).dropped, 3u);
+		// A message with a higher priority by policy replaces the oldest message of a full queue.
+		const std::string bulk_topics("test/policy/bulk/#");
+		const std::string alert_topic("test/policy/bulk/alert");
+		fast::Topic_policy alert_policy;
+		alert_policy.priority = fast::Priority::high;
+		comm2.set_topic_policy(alert_topic, alert_policy);
+		fructose_assert_eq(comm2.get_topic_policy(bulk_topics).queue_bound, 2u);
+		comm2.add_subscription(bulk_topics);
+		comm2.add_subscription(alert_topic);
+		comm2.send_message("kpi 1", "test/policy/bulk/kpi");
+		comm2.send_message("kpi 2", "test/policy/bulk/kpi");
+		comm2.send_message("kpi 3", "test/policy/bulk/kpi");
+		std::this_thread::sleep_for(std::chrono::milliseconds(500));
+		comm2.send_message("alert", alert_topic);
+		std::this_thread::sleep_for(std::chrono::milliseconds(500));
+		fructose_assert_eq(comm2.get_message(bulk_topics, std::chrono::seconds(5)), "alert");
+		fructose_assert_eq(comm2.get_message(bulk_topics, std::chrono::seconds(5)), "kpi 2");
+		fructose_assert_exception(comm2.get_message(bulk_topics, std::chrono::milliseconds(200)), std::runtime_error);
+		fructose_assert_eq(comm2.get_subscription_stats(bulk_topics).dropped, 2u);
+		// Deferred callbacks do not block receiving.
+		const std::string control_topic("test/policy/control");
+		std::mutex mutex;
+		std::condition_variable cv;
+		std::vector<std::string> msgs;
+		comm2.add_subscription(control_topic, [&](std::string msg) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			std::lock_guard<std::mutex> lock(mutex);
+			msgs.push_back(std::move(msg));
+			cv.notify_one();
+		});
+		for (unsigned int i = 0; i != 3; ++i)
+			comm2.send_message(std::to_string(i), control_topic);
+		std::unique_lock<std::mutex> lock(mutex);
+		fructose_assert(cv.wait_for(lock, std::chrono::seconds(5), [&msgs]{return msgs.size() == 3;}));
+		fructose_assert(msgs == std::vector<std::string>({"0", "1", "2"}));
+		lock.unlock();
+		comm2.remove_subscription(control_topic);
+	}
+
+	void filter(const std::string &test_name)
+	{
+		(void) test_name;
+		fast::MQTT_communicator comm2("", topic1);
+		fructose_assert_no_exception(
+			comm2.connect_to_broker(host, port, keepalive, std::chrono::seconds(5))
+		);
+		const std::string task_topic("test/filter/task");
+		comm2.add_subscription(task_topic);
+		comm2.set_subscription_filter(task_topic, "task", [](const std::string &task) {
+			return task == "migrate vm";
+		});
+		comm2.send_message("---\ntask: start vm\nid: 1\n---", task_topic);
+		comm2.send_message("---\nid: 2\n---", task_topic);
+		comm2.send_message("---\ntask: migrate vm\nid: 3\n---", task_topic);
+		std::string id;
+		fructose_assert(fast::yaml::peek_scalar(comm2.get_message(task_topic, std::chrono::seconds(5)), "id", id));
+		fructose_assert_eq(id, "3");
+		auto stats = comm2.get_subscription_stats(task_topic);
+		fructose_assert_eq(stats.received, 3u);
+		fructose_assert_eq(stats.filtered, 2u);
+	}
+
+	void transport_options(const std::string &test_name)
+	{
+		(void) test_name;
+		fast::MQTT_communicator comm2("", topic1);
+		fructose_assert_no_exception(
+			comm2.connect_to_broker(host, port, keepalive, std::chrono::seconds(5))
+		);
+		fast::Transport_options options;
+		options.tcp_nodelay = true;
+		options.send_buffer_size = 256 * 1024;
+		options.receive_buffer_size = 256 * 1024;
+		options.network_cpu = 0;
+		fructose_assert_no_exception(
+			comm2.set_transport_options(options)
+		);
+		const std::string msg_topic("test/transport");
+		comm2.add_subscription(msg_topic);
+		comm2.send_message("Hallo Welt", msg_topic);
+		fructose_assert_eq(comm2.get_message(msg_topic, std::chrono::seconds(5)), "Hallo Welt");
+		// Dispatch threads are pinned to the CPUs of the communicator as well.
+		options.thread_cpus = {0};
+		fructose_assert_no_exception(
+			comm2.set_transport_options(options)
+		);
+		fast::Topic_policy deferred_policy;
+		deferred_policy.dispatch = fast::Dispatch_mode::deferred;
+		const std::string pinned_topic("test/transport/pinned");
+		comm2.set_topic_policy(pinned_topic, deferred_policy);
+		std::mutex mutex;
+		std::condition_variable cv;
+		int cpu_count = -1;
+		comm2.add_subscription(pinned_topic, [&](std::string) {
+			cpu_set_t cpu_set;
+			pthread_getaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+			std::lock_guard<std::mutex> lock(mutex);
+			cpu_count = CPU_ISSET(0, &cpu_set) ? CPU_COUNT(&cpu_set) : 0;
+			cv.notify_one();
+		});
+		comm2.send_message("pinned", pinned_topic);
+		std::unique_lock<std::mutex> lock(mutex);
+		fructose_assert(cv.wait_for(lock, std::chrono::seconds(5), [&cpu_count]{return cpu_count != -1;}));
+		fructose_assert_eq(cpu_count, 1);
+		lock.unlock();
+		options.thread_cpus = {-1};
+		fructose_assert_exception(
+			comm2.set_transport_options(options),
+			std::runtime_error
+		);
+		// Rejected options do not replace the CPUs used for new threads.
+		const int missing_cpu = static_cast<int>(sysconf(_SC_NPROCESSORS_CONF));
+		options.thread_cpus = {0, missing_cpu};
+		fructose_assert_exception(
+			comm2.set_transport_options(options),
+			std::runtime_error
+		);
+		options.thread_cpus = {0};
+		options.network_cpu = missing_cpu;
+		fructose_assert_exception(
+			comm2.set_transport_options(options),
+			std::runtime_error
+		);
+		const std::string repinned_topic("test/transport/repinned");
+		comm2.set_topic_policy(repinned_topic, deferred_policy);
+		cpu_count = -1;
+		comm2.add_subscription(repinned_topic, [&](std::string) {
+			cpu_set_t cpu_set;
+			pthread_getaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+			std::lock_guard<std::mutex> lock(mutex);
+			cpu_count = CPU_ISSET(0, &cpu_set) ? CPU_COUNT(&cpu_set) : 0;
+			cv.notify_one();
+		});
+		comm2.send_message("repinned", repinned_topic);
+		lock.lock();
+		fructose_assert(cv.wait_for(lock, std::chrono::seconds(5), [&cpu_count]{return cpu_count != -1;}));
+		fructose_assert_eq(cpu_count, 1);
+		lock.unlock();
+		// Queue memory is bound to the NUMA node of the CPUs.
+		fast::MQTT_communicator comm3("", topic1);
+		fructose_assert_no_exception(
+			comm3.connect_to_broker(host, port, keepalive, std::chrono::seconds(5))
+		);
+		fast::Transport_options numa_options;
+		numa_options.bind_memory = true;
+		fructose_assert_exception(
+			comm3.set_transport_options(numa_options),
+			std::runtime_error
+		);
+		numa_options.thread_cpus = {0};
+		if (!fast::MQTT_communicator::memory_binding_available()) {
+			fructose_assert_exception(
+				comm3.set_transport_options(numa_options),
+				std::runtime_error
+			);
+			return;
+		}
+		fructose_assert_no_exception(
+			comm3.set_transport_options(numa_options)
+		);
+		fructose_assert_eq(count_bound_mappings(), 0u);
+		const std::string numa_topic("test/transport/numa");
+		fast::Topic_policy batch_policy;
+		batch_policy.batch_size = 4;
+		comm3.set_topic_policy(numa_topic + "/batch", batch_policy);
+		comm3.set_chunking(1000);
+		comm3.add_subscription(numa_topic + "/#");
+		std::string large_msg(5000, 'x');
+		for (unsigned int round = 0; round != 2; ++round) {
+			comm3.send_message(large_msg, numa_topic + "/large");
+			for (unsigned int i = 0; i != 100; ++i)
+				comm3.post_message(std::to_string(i), numa_topic + "/post");
+			for (unsigned int i = 0; i != 4; ++i)
+				comm3.send_message(std::to_string(i), numa_topic + "/batch");
+			std::multiset<std::string> received;
+			for (unsigned int i = 0; i != 105; ++i)
+				received.insert(comm3.get_message(numa_topic + "/#", std::chrono::seconds(5)));
+			fructose_assert_eq(received.count(large_msg), 1u);
+			fructose_assert_eq(received.count("3"), 2u);
+			fructose_assert_eq(received.count("99"), 1u);
+			fructose_assert_eq(count_bound_mappings() != 0, round == 0);
+			// Unbinding keeps queues working with the memory taken from the nodes before.
+			numa_options.bind_memory = false;
+			fructose_assert_no_exception(
+				comm3.set_transport_options(numa_options)
+			);
+		}
+	}
+
 	void subscribe(const std::string &test_name)
 	{
 		(void) test_name;
@@ -154,6 +1017,26 @@ int main(int argc, char **argv)
 	Communication_tester tests;
 	tests.add_test("connect", &Communication_tester::connect);
 	tests.add_test("second communicator", &Communication_tester::second_communicator);
+	tests.add_test("multiple brokers", &Communication_tester::multiple_brokers);
+	tests.add_test("priorities", &Communication_tester::priorities);
+	tests.add_test("expiry", &Communication_tester::expiry);
+	tests.add_test("duplicates", &Communication_tester::duplicates);
+	tests.add_test("chunking", &Communication_tester::chunking);
+	tests.add_test("chunk limit", &Communication_tester::chunk_limit);
+	tests.add_test("reassembly limit", &Communication_tester::reassembly_limit);
+	tests.add_test("multicast", &Communication_tester::multicast);
+	tests.add_test("post", &Communication_tester::post);
+	tests.add_test("post overflow", &Communication_tester::post_overflow);
+	tests.add_test("handle", &Communication_tester::handle);
+	tests.add_test("shutdown", &Communication_tester::shutdown);
+	tests.add_test("typed", &Communication_tester::typed);
+	tests.add_test("router", &Communication_tester::router);
+	tests.add_test("batching", &Communication_tester::batching);
+	tests.add_test("compression", &Communication_tester::compression);
+	tests.add_test("latency probe", &Communication_tester::latency_probe);
+	tests.add_test("policies", &Communication_tester::policies);
+	tests.add_test("filter", &Communication_tester::filter);
+	tests.add_test("transport options", &Communication_tester::transport_options);
 	tests.add_test("subscribe", &Communication_tester::subscribe);
 	tests.add_test("send and receive", &Communication_tester::send_receive);
 	tests.add_test("wildcard #", &Communication_tester::wildcard1);
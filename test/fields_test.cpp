@@ -0,0 +1,87 @@
+#include <fructose/fructose.h>
+
+#include <fast-lib/message/agent/init.hpp>
+#include <fast-lib/message/agent/init_agent.hpp>
+#include <fast-lib/message/agent/stop_monitor.hpp>
+#include <fast-lib/message/agent/mmbwmon/reply.hpp>
+#include <fast-lib/message/agent/mmbwmon/system_info.hpp>
+
+#include <limits>
+
+using namespace fast::msg::agent;
+
+// Encode the node returned by emit() in the binary format.
+static std::string node_binary(const fast::Serializable &obj)
+{
+	std::string buffer(1, fast::binary::content_type);
+	fast::binary::append_node(buffer, obj.emit());
+	return buffer;
+}
+
+struct Fields_tester :
+	public fructose::test_base<Fields_tester>
+{
+	void yaml(const std::string &test_name)
+	{
+		(void) test_name;
+		stop_monitoring stop("job", 42);
+		fructose_assert_eq(stop.to_string(), "---\ntask: stop monitoring\njob-description:\n  job-id: job\n  process-id: 42\n---");
+		init_agent init({{"compute intensity", "high"}, {"IO intensity", "low"}}, 5);
+		fructose_assert_eq(init.to_string(), "---\ntask: init agent\nKPI:\n  categories:\n    IO intensity: low\n    compute intensity: high\n  repeat: 5\n---");
+		init_agent loaded;
+		loaded.from_string(init.to_string());
+		fructose_assert(loaded == init);
+		fructose_assert(!(loaded == init_agent({{"compute intensity", "low"}}, 5)));
+		// Missing fields are reported.
+		fructose_assert_exception(loaded.from_string("---\ntask: init agent\nKPI:\n  repeat: 5\n---"), std::exception);
+		fructose_assert_exception(loaded.from_string("---\ntask: init agent\n---"), std::runtime_error);
+	}
+
+	void binary(const std::string &test_name)
+	{
+		(void) test_name;
+		init_agent init({{"compute intensity", "high"}}, 5);
+		mmbwmon::reply reply({0, 1, 2}, 0.1);
+		mmbwmon::system_info info(16, 2, 2, {1.5, 2.25});
+		fructose_assert_eq(fast::binary::to_string(init), node_binary(init));
+		fructose_assert_eq(fast::binary::to_string(reply), node_binary(reply));
+		fructose_assert_eq(fast::binary::to_string(info), node_binary(info));
+		fructose_assert_eq(fast::binary::to_string(init_agent({}, 1)), node_binary(init_agent({}, 1)));
+		mmbwmon::reply loaded;
+		loaded.from_string(fast::binary::to_string(reply));
+		fructose_assert(loaded == reply);
+		init_agent loaded_init;
+		loaded_init.from_string(fast::binary::to_string(init));
+		fructose_assert(loaded_init == init);
+		mmbwmon::system_info loaded_info;
+		loaded_info.from_string(fast::binary::to_string(info));
+		fructose_assert(loaded_info == info);
+		// Decoding without nodes skips unknown entries and reports missing fields like load().
+		auto encode = [](const std::string &yaml) {
+			std::string buffer(1, fast::binary::content_type);
+			fast::binary::append_node(buffer, YAML::Load(yaml));
+			return buffer;
+		};
+		loaded_init.from_string(encode("{task: init agent, extra: [1, 2], KPI: {repeat: 7, categories: {a: b}, more: {c: d}}}"));
+		fructose_assert(loaded_init == init_agent({{"a", "b"}}, 7));
+		fructose_assert_exception(loaded_init.from_string(encode("{task: init agent, KPI: {repeat: 5}}")), std::runtime_error);
+		fructose_assert_exception(loaded_init.from_string(encode("{task: init agent}")), std::runtime_error);
+		// Scalars in other formats than written by emit_binary() are converted like by yaml-cpp.
+		loaded_info.from_string(encode("{threads: 0x10, smt: 2, numa: 1, bandwidth: [.inf, 1e3, -0.5]}"));
+		fructose_assert_eq(loaded_info.threads, 16u);
+		fructose_assert(loaded_info.membw == std::vector<double>({std::numeric_limits<double>::infinity(), 1000, -0.5}));
+		mmbwmon::system_info yaml_info;
+		yaml_info.from_string("{threads: -1, smt: +2, numa: 010, bandwidth: [1.5e-3]}");
+		loaded_info.from_string(encode("{threads: -1, smt: +2, numa: 010, bandwidth: [1.5e-3]}"));
+		fructose_assert(loaded_info == yaml_info);
+		fructose_assert_exception(loaded_info.from_string(encode("{threads: many, smt: 2, numa: 1, bandwidth: []}")), std::exception);
+	}
+};
+
+int main(int argc, char **argv)
+{
+	Fields_tester tests;
+	tests.add_test("yaml", &Fields_tester::yaml);
+	tests.add_test("binary", &Fields_tester::binary);
+	return tests.run(argc, argv);
+}
@@ -104,6 +104,55 @@ struct Task_tester :
 		fructose_assert(move_assign.is_valid());
 		fructose_assert_eq(move_assign.get(), name2_str);
 	}
+
+	void optional_emit_into(const std::string &test_name)
+	{
+		(void) test_name;
+		YAML::Node node;
+		Optional<std::string>("empty").emit_into(node);
+		fructose_assert(node.IsNull());
+		Optional<Person>("person", Person(1)).emit_into(node);
+		fructose_assert_eq(node["person"]["id"].as<int>(), 1);
+		// Existing entries are kept like in merge_node().
+		Optional<Person>("person", Person(2)).emit_into(node);
+		fructose_assert_eq(node["person"]["id"].as<int>(), 1);
+		Optional<bool>("b", true).emit_into(node);
+		fructose_assert_eq(YAML::Dump(node), "person:\n  id: 1\nb: true");
+	}
+
+	FASTLIB_OPTIONAL_TAG(name_tag, "name")
+
+	void inline_optional(const std::string &test_name)
+	{
+		(void) test_name;
+		Inline_optional<std::string, name_tag> name;
+		fructose_assert(!name.is_valid());
+		fructose_assert_eq(std::string(name.get_tag()), "name");
+		fructose_assert_exception(name.get(), std::runtime_error);
+		fructose_assert_eq(name.get_or("default"), "default");
+		fructose_assert(YAML::Node(name.emit()).IsNull());
+		name.emplace(3, 'a');
+		fructose_assert(name == std::string("aaa"));
+		// Copy keeps the source, move leaves it empty.
+		Inline_optional<std::string, name_tag> copy(name);
+		fructose_assert(name.is_valid());
+		fructose_assert(copy == name);
+		Inline_optional<std::string, name_tag> moved(std::move(name));
+		fructose_assert(!name.is_valid());
+		fructose_assert_eq(*moved, "aaa");
+		moved.reset();
+		fructose_assert(!moved);
+		// Round trip through YAML.
+		YAML::Node node;
+		copy.emit_into(node);
+		fructose_assert_eq(YAML::Dump(node), "name: aaa");
+		Inline_optional<std::string, name_tag> loaded;
+		loaded.load(node);
+		fructose_assert(loaded == copy);
+		// Like Optional, a missing entry keeps the current value.
+		loaded.load(YAML::Node());
+		fructose_assert(loaded == copy);
+	}
 };
 
 int main(int argc, char **argv)
@@ -112,5 +161,7 @@ int main(int argc, char **argv)
 	tests.add_test("optional-bool", &Task_tester::optional_bool);
 	tests.add_test("optional-struct", &Task_tester::optional_struct);
 	tests.add_test("optional-copy", &Task_tester::optional_copy);
+	tests.add_test("optional-emit-into", &Task_tester::optional_emit_into);
+	tests.add_test("inline-optional", &Task_tester::inline_optional);
 	return tests.run(argc, argv);
 }
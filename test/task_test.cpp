@@ -1,5 +1,6 @@
 #include <fructose/fructose.h>
 
+#include <fast-lib/message/migfra/result.hpp>
 #include <fast-lib/message/migfra/task.hpp>
 
 using namespace fast::msg::migfra;
@@ -248,6 +249,277 @@ struct Task_tester :
 		tc2.from_string(buf);
 		fructose_assert(tc2.type() == "repin vm");
 	}
+
+	void task_cont_binary(const std::string &test_name)
+	{
+		(void) test_name;
+		Task_container tc1;
+		tc1.id = "42";
+		auto start = std::make_shared<Start>();
+		start->vm_name = "vm1";
+		start->memory = 2*1024*1024;
+		start->vcpus = 2;
+		start->xml = "<xml>\n</xml>";
+		start->pci_ids.push_back(PCI_id(0x15b3, 0x1004));
+		tc1.tasks.push_back(start);
+		auto repin = std::make_shared<Repin>();
+		repin->vm_name = "vm2";
+		repin->vcpu_map = {{0},{1, 2},{}};
+		tc1.tasks.push_back(repin);
+
+		auto buf = fast::binary::to_string(tc1);
+		fructose_assert(fast::binary::is_binary(buf));
+		fructose_assert(buf.size() < tc1.to_string().size());
+		// from_string detects the binary format.
+		Task_container tc2;
+		tc2.from_string(buf);
+		fructose_assert_eq(tc2.to_string(), tc1.to_string());
+		// Malformed messages are rejected.
+		fructose_assert_exception(tc2.from_string(buf.substr(0, buf.size() - 1)), std::runtime_error);
+		fructose_assert_exception(tc2.from_string(buf + "x"), std::runtime_error);
+	}
+
+	void task_cont_parallel(const std::string &test_name)
+	{
+		(void) test_name;
+		fast::Parallel_options parallel;
+		parallel.threads = 4;
+		parallel.min_chunk_size = 8;
+		Task_container seq;
+		seq.id = "42";
+		seq.concurrent_execution = true;
+		for (int i = 0; i != 101; ++i) {
+			auto start = std::make_shared<Start>("vm" + std::to_string(i), 2, 1024, std::vector<PCI_id>{PCI_id(0x15b3, i)}, std::vector<PCI_addr>(), false);
+			start->xml = "<xml>\n</xml>";
+			seq.tasks.push_back(start);
+		}
+		auto par = seq;
+		par.parallel = parallel;
+		// Encoding keeps the order and matches the sequential encoding.
+		fructose_assert_eq(par.to_string(), seq.to_string());
+		auto buf = fast::binary::to_string(seq);
+		fructose_assert(fast::binary::to_string(par) == buf);
+		std::string node_buf(1, fast::binary::content_type);
+		fast::binary::append_node(node_buf, seq.emit());
+		fructose_assert(node_buf == buf);
+		// Decoding builds the same tasks in the same order.
+		for (const auto &str : {buf, seq.to_string()}) {
+			Task_container loaded;
+			loaded.parallel = parallel;
+			loaded.from_string(str);
+			fructose_assert_eq(loaded.tasks.size(), seq.tasks.size());
+			fructose_assert_eq(loaded.to_string(), seq.to_string());
+		}
+		// Errors of any chunk are rethrown.
+		auto node = seq.emit();
+		node["vm-configurations"][90]["vcpus"] = "many";
+		Task_container loaded;
+		loaded.parallel = parallel;
+		fructose_assert_exception(loaded.load(node), std::runtime_error);
+
+		Result_container results_seq("vm started", {}, "43");
+		for (int i = 0; i != 50; ++i)
+			results_seq.results.emplace_back("vm" + std::to_string(i), "success");
+		auto results_par = results_seq;
+		results_par.parallel = parallel;
+		fructose_assert_eq(results_par.to_string(), results_seq.to_string());
+		fructose_assert(fast::binary::to_string(results_par) == fast::binary::to_string(Result_container(results_seq.to_string())));
+		Result_container results_loaded;
+		results_loaded.parallel = parallel;
+		results_loaded.from_string(fast::binary::to_string(results_seq));
+		fructose_assert_eq(results_loaded.to_string(), results_seq.to_string());
+	}
+
+	// Emit through a YAML node as Serializable::to_string() did before streaming.
+	static std::string node_yaml(const fast::Serializable &obj)
+	{
+		YAML::Emitter out;
+		out << obj.emit();
+		return "---\n" + std::string(out.c_str()) + "\n---";
+	}
+
+	// Containers with every type of task and most optional entries set.
+	static std::vector<Task_container> all_task_types()
+	{
+		auto start = std::make_shared<Start>("vm1", 2, 2*1024*1024, std::vector<PCI_id>{PCI_id(0x15b3, 0x1004)}, std::vector<PCI_addr>{PCI_addr(0, 3, 0, 1)}, true);
+		start->memnode_map = std::vector<std::vector<unsigned int>>{{0, 1}, {}};
+		start->vcpu_map = std::vector<std::vector<unsigned int>>{{0}, {1}};
+		start->xml = "<xml>\n</xml>";
+		start->ivshmem = Device_ivshmem();
+		start->ivshmem->id = "ivshmem0";
+		start->ivshmem->path = "/dev/shm/ivshmem0";
+		start->probe_hostname = "it's";
+		auto mig = std::make_shared<Migrate>("vm1", "desthost", "live", true, false, "auto", true);
+		mig->swap_with = Swap_with();
+		mig->swap_with->vm_name = "vm2";
+		mig->swap_with->vcpu_map = std::vector<std::vector<unsigned int>>{{2, 3}};
+		auto evacuate = std::make_shared<Evacuate>(std::vector<std::string>{"host1", "host2"}, "auto", false, "warm", false, true, "0", false);
+		evacuate->vm_name = "vm3";
+		return {
+			Task_container({start, std::make_shared<Start>()}, true, "1"),
+			Task_container({std::make_shared<Stop>("vm1", true, false, false)}, false),
+			Task_container({mig}, true, "2"),
+			Task_container({std::make_shared<Migrate>()}, false),
+			Task_container({evacuate}, false, "3"),
+			Task_container({std::make_shared<Repin>("vm1", std::vector<std::vector<unsigned int>>{{0}, {1, 2}, {}})}, false),
+			Task_container({std::make_shared<Suspend>("vm1", false)}, false),
+			Task_container({std::make_shared<Resume>("vm1", true)}, false),
+			Task_container({std::make_shared<Quit>()}, false)
+		};
+	}
+
+	void task_cont_stream(const std::string &test_name)
+	{
+		(void) test_name;
+		auto containers = all_task_types();
+		auto start = std::static_pointer_cast<Start>(containers[0].tasks[0]);
+		std::string buf;
+		for (const auto &container : containers) {
+			fast::yaml::to_string(container, buf);
+			fructose_assert_eq(buf, node_yaml(container));
+			fructose_assert_eq(container.to_string(), node_yaml(container));
+		}
+		fast::yaml::to_string(*start, buf);
+		fructose_assert_eq(buf, node_yaml(*start));
+		fast::yaml::to_string(start->ivshmem, buf);
+		fructose_assert_eq(buf, node_yaml(start->ivshmem));
+	}
+
+	// Encode the node returned by emit() in the binary format.
+	static std::string node_binary(const fast::Serializable &obj)
+	{
+		std::string buffer(1, fast::binary::content_type);
+		fast::binary::append_node(buffer, obj.emit());
+		return buffer;
+	}
+
+	void task_cont_binary_direct(const std::string &test_name)
+	{
+		(void) test_name;
+		for (const auto &container : all_task_types()) {
+			// Tasks are encoded without building nodes into the same bytes as their nodes.
+			auto buf = fast::binary::to_string(container);
+			fructose_assert(buf == node_binary(container));
+			// And decoded without building nodes like loading the decoded node.
+			Task_container loaded, node_loaded;
+			loaded.from_string(buf);
+			node_loaded.load(fast::binary::load(buf));
+			fructose_assert_eq(loaded.to_string(), node_loaded.to_string());
+			fructose_assert(fast::binary::to_string(loaded) == fast::binary::to_string(node_loaded));
+		}
+		Time_measurement time_measurement(true);
+		time_measurement.tick("migrate");
+		time_measurement.tock("migrate");
+		for (const auto &results : {Result_container("vm migrated", {Result("vm1", "success", time_measurement, "details")}, "4"),
+				Result_container("vm started", {Result("vm1", "success"), Result("vm2", "error", time_measurement, "failed")})}) {
+			auto buf = fast::binary::to_string(results);
+			fructose_assert(buf == node_binary(results));
+			Result_container loaded, node_loaded;
+			loaded.from_string(buf);
+			node_loaded.load(fast::binary::load(buf));
+			fructose_assert_eq(loaded.to_string(), node_loaded.to_string());
+		}
+		// Unknown entries are skipped, missing entries are reported.
+		auto encode = [](const std::string &yaml) {
+			std::string buffer(1, fast::binary::content_type);
+			fast::binary::append_node(buffer, YAML::Load(yaml));
+			return buffer;
+		};
+		Task_container loaded;
+		loaded.from_string(encode("{task: suspend vm, list: [{vm-name: vm1, extra: [1, {a: b}]}], unknown: {x: y}, id: 5}"));
+		fructose_assert_eq(std::static_pointer_cast<Suspend>(loaded.tasks.at(0))->vm_name, "vm1");
+		fructose_assert(loaded.id == "5");
+		fructose_assert_exception(loaded.from_string(encode("{task: migrate vm, vm-name: vm1}")), std::runtime_error);
+		fructose_assert_exception(loaded.from_string(encode("{task: stop vm}")), std::runtime_error);
+		fructose_assert_exception(loaded.from_string(encode("{task: start vm, vm-configurations: [{vcpus: many}]}")), std::exception);
+		fructose_assert_exception(loaded.from_string(encode("{id: 1}")), Task_container::no_task_exception);
+	}
+
+	void task_cont_peek_id(const std::string &test_name)
+	{
+		(void) test_name;
+		Task_container tc1;
+		tc1.id = "42";
+		auto mig = std::make_shared<Migrate>();
+		mig->vm_name = "vm1";
+		mig->dest_hostname = "desthost";
+		mig->migration_type = "live";
+		tc1.tasks.push_back(mig);
+		std::string id;
+		fructose_assert(fast::yaml::peek_scalar(tc1.to_string(), "id", id));
+		fructose_assert_eq(id, "42");
+		// Nested keys and values spanning several lines are not peeked.
+		fructose_assert(!fast::yaml::peek_scalar(tc1.to_string(), "migration-type", id));
+		fructose_assert(!fast::yaml::peek_scalar(tc1.to_string(), "parameter", id));
+		fructose_assert(fast::yaml::peek_scalar("---\nid: 'it''s'\ntask: quit\n---", "id", id));
+		fructose_assert_eq(id, "it's");
+		fructose_assert(fast::yaml::peek_scalar("id: \"a \\\"b\\\"\"", "id", id));
+		fructose_assert_eq(id, "a \"b\"");
+		fructose_assert(!fast::yaml::peek_scalar("---\ntask: quit\n---\nid: 42\n", "id", id));
+	}
+
+	void task_cont_peek_scalar(const std::string &test_name)
+	{
+		(void) test_name;
+		// Peeked scalars match the scalars loaded by yaml-cpp, with comments stripped and escapes decoded.
+		const std::vector<std::string> strs = {
+			"id: 42 # comment",
+			"id: a#b\t# comment\r\n",
+			"id: 'it''s' # comment",
+			"id: \"a\\tb\\\\c\\\"d\\/e\\x41\\u00e9\\U0001F600\\N\\_\\ \" # comment",
+			"id:\t\"\\0\\a\\b\\e\\f\\n\\r\\v\\L\\P\""
+		};
+		for (const auto &str : strs) {
+			std::string id;
+			fructose_assert(fast::yaml::peek_scalar(str, "id", id));
+			fructose_assert_eq(id, YAML::Load(str)["id"].as<std::string>());
+		}
+		// Keys must be followed by ": " or the end of the line.
+		std::string id;
+		fructose_assert(!fast::yaml::peek_scalar("id:42\n", "id", id));
+		fructose_assert(!fast::yaml::peek_scalar("id:\n  42\n", "id", id));
+		fructose_assert(!fast::yaml::peek_scalar("id: # comment\n  42\n", "id", id));
+		// Escapes which are not decoded and quoted scalars spanning lines are not peeked.
+		fructose_assert(!fast::yaml::peek_scalar("id: \"\\q\"", "id", id));
+		fructose_assert(!fast::yaml::peek_scalar("id: \"\\ud800\"", "id", id));
+		fructose_assert(!fast::yaml::peek_scalar("id: \"\\x4\"", "id", id));
+		fructose_assert(!fast::yaml::peek_scalar("id: \"a\n  b\"", "id", id));
+		fructose_assert(!fast::yaml::peek_scalar("id: 'a' b", "id", id));
+		fructose_assert(!fast::yaml::peek_scalar("id: *anchor", "id", id));
+	}
+
+	void task_cont_peek_header(const std::string &test_name)
+	{
+		(void) test_name;
+		std::vector<std::shared_ptr<Task>> tasks;
+		for (int i = 0; i != 3; ++i)
+			tasks.push_back(std::make_shared<Start>("vm" + std::to_string(i), 2, 1024, std::vector<PCI_id>(), std::vector<PCI_addr>(), false));
+		Task_container tc(tasks, true, "id-1");
+		for (const auto &str : {tc.to_string(), fast::binary::to_string(tc)}) {
+			auto header = Task_container::peek_header(str);
+			fructose_assert_eq(header.task, "start vm");
+			fructose_assert(header.id == std::string("id-1"));
+		}
+		// Nested entries are skipped in the binary format as well.
+		std::string value;
+		fructose_assert(!fast::peek_scalar(fast::binary::to_string(tc), "vm-name", value));
+		fructose_assert(fast::peek_scalar(fast::binary::to_string(tc), "concurrent-execution", value));
+		fructose_assert_eq(value, "true");
+		tc.id.reset();
+		fructose_assert(!Task_container::peek_header(fast::binary::to_string(tc)).id.is_valid());
+		fructose_assert_exception(Task_container::peek_header("---\nid: 1\n---"), Task_container::no_task_exception);
+		// The peeked id equals the loaded one for comments and escapes.
+		for (const std::string str : {"task: quit # comment\nid: id-2 # comment\n",
+					      "task: 'quit'\nid: \"id \\\"3\\\"\\t\\u00e9\" # comment\n"}) {
+			auto header = Task_container::peek_header(str);
+			Task_container loaded;
+			loaded.from_string(str);
+			fructose_assert_eq(header.task, "quit");
+			fructose_assert(header.id.is_valid() && loaded.id.is_valid());
+			fructose_assert_eq(header.id.get(), loaded.id.get());
+		}
+		fructose_assert_exception(fast::peek_scalar(fast::binary::to_string(tc).substr(0, 20), "id", value), std::runtime_error);
+	}
 };
 
 int main(int argc, char **argv)
@@ -267,5 +539,12 @@ int main(int argc, char **argv)
 	tests.add_test("task_cont_start", &Task_tester::task_cont_start);
 	tests.add_test("task_cont_migrate", &Task_tester::task_cont_migrate);
 	tests.add_test("task_cont_repin", &Task_tester::task_cont_repin);
+	tests.add_test("task_cont_binary", &Task_tester::task_cont_binary);
+	tests.add_test("task_cont_stream", &Task_tester::task_cont_stream);
+	tests.add_test("task_cont_binary_direct", &Task_tester::task_cont_binary_direct);
+	tests.add_test("task_cont_peek_id", &Task_tester::task_cont_peek_id);
+	tests.add_test("task_cont_peek_scalar", &Task_tester::task_cont_peek_scalar);
+	tests.add_test("task_cont_peek_header", &Task_tester::task_cont_peek_header);
+	tests.add_test("task_cont_parallel", &Task_tester::task_cont_parallel);
 	return tests.run(argc, argv);
 }